@@ -26,6 +26,7 @@
 #define TARGET_REQ_DEBUGMSG_ASCII			0x01
 #define TARGET_REQ_DEBUGMSG_HEXMSG(size)	(0x01 | ((size & 0xff) << 8))
 #define TARGET_REQ_DEBUGCHAR				0x02
+#define TARGET_REQ_STREAM					0x04
 
 #if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__) || defined(__ARM_ARCH_6SM__)
 
@@ -153,3 +154,29 @@ void dbg_write_char(char msg)
 {
 	dbg_write(TARGET_REQ_DEBUGCHAR | ((msg & 0xff) << 16));
 }
+
+void dbg_write_stream(const unsigned char *val, long len)
+{
+	unsigned long dcc_data;
+
+	while (len > 0)
+	{
+		long chunk = (len > 0xffff) ? 0xffff : len;
+
+		dbg_write(TARGET_REQ_STREAM | (chunk << 16));
+
+		len -= chunk;
+		while (chunk > 0)
+		{
+			dcc_data = val[0]
+				| ((chunk > 1) ? val[1] << 8 : 0x00)
+				| ((chunk > 2) ? val[2] << 16 : 0x00)
+				| ((chunk > 3) ? val[3] << 24 : 0x00);
+
+			dbg_write(dcc_data);
+
+			val += (chunk > 4) ? 4 : chunk;
+			chunk -= 4;
+		}
+	}
+}
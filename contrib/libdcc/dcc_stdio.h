@@ -30,4 +30,7 @@ void dbg_write_u8(const unsigned char *val, long len);
 void dbg_write_str(const char *msg);
 void dbg_write_char(char msg);
 
+/* raw bytes for the "target_request stream" sink */
+void dbg_write_stream(const unsigned char *val, long len);
+
 #endif	/* DCC_STDIO_H */
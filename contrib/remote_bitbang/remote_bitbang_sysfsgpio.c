@@ -291,6 +291,45 @@ static void cleanup_all_fds(void)
 	cleanup_fd(srst_fd, srst_gpio);
 }
 
+/*
+ * Protocol v2 vector frame: 16-bit little endian cycle count followed by the
+ * TMS and TDI vectors, LSB first. Capture frames ('U') are answered with the
+ * TDO vector sampled before each rising edge of TCK.
+ */
+#define VECTOR_MAX_BITS 8192
+
+static void process_vector(int capture)
+{
+	unsigned char tms[VECTOR_MAX_BITS / 8];
+	unsigned char tdi[VECTOR_MAX_BITS / 8];
+	unsigned char tdo[VECTOR_MAX_BITS / 8];
+	int lo = getchar();
+	int hi = getchar();
+	unsigned bits = (lo & 0xff) | ((hi & 0xff) << 8);
+	unsigned bytes = (bits + 7) / 8;
+
+	if (lo == EOF || hi == EOF || bits > VECTOR_MAX_BITS
+			|| fread(tms, 1, bytes, stdin) != bytes
+			|| fread(tdi, 1, bytes, stdin) != bytes) {
+		LOG_ERROR("Malformed vector frame");
+		exit(1);
+	}
+
+	memset(tdo, 0, bytes);
+	for (unsigned i = 0; i < bits; i++) {
+		int tms_bit = (tms[i / 8] >> (i % 8)) & 1;
+		int tdi_bit = (tdi[i / 8] >> (i % 8)) & 1;
+
+		sysfsgpio_write(0, tms_bit, tdi_bit);
+		if (capture && sysfsgpio_read() == '1')
+			tdo[i / 8] |= 1 << (i % 8);
+		sysfsgpio_write(1, tms_bit, tdi_bit);
+	}
+
+	if (capture)
+		fwrite(tdo, 1, bytes, stdout);
+}
+
 static void process_remote_protocol(void)
 {
 	int c;
@@ -311,6 +350,10 @@ static void process_remote_protocol(void)
 					(d & 1));
 		} else if (c == 'R')
 			putchar(sysfsgpio_read());
+		else if (c == 'V') /* Protocol version */
+			putchar('2');
+		else if (c == 'T' || c == 'U') /* Vector frame */
+			process_vector(c == 'U');
 		else
 			LOG_ERROR("Unknown command '%c' received", c);
 	}
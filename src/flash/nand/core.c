@@ -24,6 +24,7 @@
 #endif
 
 #include "imp.h"
+#include <helper/time_support.h>
 
 /* configured NAND devices and NAND Flash command handler */
 struct nand_device *nand_devices;
@@ -684,6 +685,58 @@ int nand_read_page(struct nand_device *nand, uint32_t page,
 		return nand->controller->read_page(nand, page, data, data_size, oob, oob_size);
 }
 
+int nand_write_pages(struct nand_device *nand, uint32_t page, uint32_t count,
+	uint8_t *data, uint32_t data_size,
+	uint8_t *oob, uint32_t oob_size)
+{
+	struct duration bench;
+	int retval = ERROR_OK;
+
+	if (!nand->device)
+		return ERROR_NAND_DEVICE_NOT_PROBED;
+
+	duration_start(&bench);
+
+	for (uint32_t i = 0; retval == ERROR_OK && i < count; i++)
+		retval = nand_write_page(nand, page + i,
+				data ? data + i * data_size : NULL, data_size,
+				oob ? oob + i * oob_size : NULL, oob_size);
+
+	if (retval == ERROR_OK && duration_measure(&bench) == ERROR_OK) {
+		nand->stats.write_time += duration_elapsed(&bench);
+		nand->stats.bytes_written += (uint64_t)count *
+			((data ? data_size : 0) + (oob ? oob_size : 0));
+	}
+
+	return retval;
+}
+
+int nand_read_pages(struct nand_device *nand, uint32_t page, uint32_t count,
+	uint8_t *data, uint32_t data_size,
+	uint8_t *oob, uint32_t oob_size)
+{
+	struct duration bench;
+	int retval = ERROR_OK;
+
+	if (!nand->device)
+		return ERROR_NAND_DEVICE_NOT_PROBED;
+
+	duration_start(&bench);
+
+	for (uint32_t i = 0; retval == ERROR_OK && i < count; i++)
+		retval = nand_read_page(nand, page + i,
+				data ? data + i * data_size : NULL, data_size,
+				oob ? oob + i * oob_size : NULL, oob_size);
+
+	if (retval == ERROR_OK && duration_measure(&bench) == ERROR_OK) {
+		nand->stats.read_time += duration_elapsed(&bench);
+		nand->stats.bytes_read += (uint64_t)count *
+			((data ? data_size : 0) + (oob ? oob_size : 0));
+	}
+
+	return retval;
+}
+
 int nand_page_command(struct nand_device *nand, uint32_t page,
 	uint8_t cmd, bool oob_only)
 {
@@ -55,6 +55,18 @@ struct nand_ecclayout {
 	struct nand_oobfree oobfree[2];
 };
 
+/**
+ * Transfer statistics of a NAND device, kept by nand_read_pages()
+ * and nand_write_pages().
+ */
+struct nand_io_stats {
+	uint64_t bytes_read;
+	uint64_t bytes_written;
+	/** Time spent transferring, in seconds. */
+	double read_time;
+	double write_time;
+};
+
 struct nand_device {
 	const char *name;
 	struct target *target;
@@ -69,6 +81,7 @@ struct nand_device {
 	bool use_raw;
 	int num_blocks;
 	struct nand_block *blocks;
+	struct nand_io_stats stats;
 	struct nand_device *next;
 };
 
@@ -2,9 +2,8 @@
  * This file contains an ECC algorithm from Toshiba that allows for detection
  * and correction of 1-bit errors in a 256 byte block of data.
  *
- * [ Extracted from the initial code found in some early Linux versions.
- *   The current Linux code is bigger while being faster, but this is of
- *   no real benefit when the bottleneck largely remains the JTAG link.  ]
+ * [ Extracted from the initial code found in some early Linux versions,
+ *   with the parity computation reworked to handle 64-bit words.  ]
  *
  * Copyright (C) 2000-2004 Steven J. Hill (sjhill at realitydiluted.com)
  *                         Toshiba America Electronics Components, Inc.
@@ -64,30 +63,65 @@ static const uint8_t nand_ecc_precalc_table[] = {
 	0x00, 0x55, 0x56, 0x03, 0x59, 0x0c, 0x0f, 0x5a, 0x5a, 0x0f, 0x0c, 0x59, 0x03, 0x56, 0x55, 0x00
 };
 
+static inline uint8_t parity64(uint64_t x)
+{
+	x ^= x >> 32;
+	x ^= x >> 16;
+	x ^= x >> 8;
+	x ^= x >> 4;
+	return (0x6996 >> (x & 0xf)) & 1;
+}
+
 /*
  * nand_calculate_ecc - Calculate 3-byte ECC for 256-byte block
+ *
+ * The block is processed 64 bits at a time.  All parities are linear:
+ * the column parity is that of all words XORed together, and each line
+ * parity bit is the parity of the bytes whose index has that bit set.
+ * Index bits 0-2 select bytes within a word, bits 3-7 select words.
  */
 int nand_calculate_ecc(struct nand_device *nand, const uint8_t *dat, uint8_t *ecc_code)
 {
-	uint8_t idx, reg1, reg2, reg3, tmp1, tmp2;
+	uint64_t all = 0, line3 = 0, line4 = 0, line5 = 0, line6 = 0, line7 = 0;
+	uint8_t reg1, reg2, reg3, tmp1, tmp2;
+	uint32_t all32;
 	int i;
 
-	/* Initialize variables */
-	reg1 = reg2 = reg3 = 0;
-
-	/* Build up column parity */
-	for (i = 0; i < 256; i++) {
-		/* Get CP0 - CP5 from table */
-		idx = nand_ecc_precalc_table[*dat++];
-		reg1 ^= (idx & 0x3f);
-
-		/* All bit XOR = 1 ? */
-		if (idx & 0x40) {
-			reg3 ^= (uint8_t) i;
-			reg2 ^= ~((uint8_t) i);
-		}
+	for (i = 0; i < 32; i += 4) {
+		uint64_t w0 = le_to_h_u64(dat + 8 * i);
+		uint64_t w1 = le_to_h_u64(dat + 8 * i + 8);
+		uint64_t w2 = le_to_h_u64(dat + 8 * i + 16);
+		uint64_t w3 = le_to_h_u64(dat + 8 * i + 24);
+		uint64_t sum = w0 ^ w1 ^ w2 ^ w3;
+
+		line3 ^= w1 ^ w3;
+		line4 ^= w2 ^ w3;
+		if (i & 4)
+			line5 ^= sum;
+		if (i & 8)
+			line6 ^= sum;
+		if (i & 16)
+			line7 ^= sum;
+		all ^= sum;
 	}
 
+	/* Get CP0 - CP5 from table */
+	all32 = all ^ (all >> 32);
+	reg1 = nand_ecc_precalc_table[(uint8_t)(all32 ^ (all32 >> 8) ^ (all32 >> 16) ^ (all32 >> 24))] & 0x3f;
+
+	/* XOR of the indexes of all bytes with odd parity */
+	reg3 = parity64(all & 0xff00ff00ff00ff00ULL) << 0;
+	reg3 |= parity64(all & 0xffff0000ffff0000ULL) << 1;
+	reg3 |= parity64(all & 0xffffffff00000000ULL) << 2;
+	reg3 |= parity64(line3) << 3;
+	reg3 |= parity64(line4) << 4;
+	reg3 |= parity64(line5) << 5;
+	reg3 |= parity64(line6) << 6;
+	reg3 |= parity64(line7) << 7;
+
+	/* ... and of their complements */
+	reg2 = parity64(all) ? ~reg3 : reg3;
+
 	/* Create non-inverted ECC code from line parity */
 	tmp1  = (reg3 & 0x80) >> 0; /* B7 -> B7 */
 	tmp1 |= (reg2 & 0x80) >> 1; /* B7 -> B6 */
@@ -76,9 +76,11 @@ int nand_fileio_start(struct command_invocation *cmd,
 		state->file_opened = true;
 	}
 
+	state->pages = NAND_FILEIO_PAGES;
+
 	if (!(state->oob_format & NAND_OOB_ONLY)) {
 		state->page_size = nand->page_size;
-		state->page = malloc(nand->page_size);
+		state->page = malloc(nand->page_size * state->pages);
 	}
 
 	if (state->oob_format & (NAND_OOB_RAW | NAND_OOB_SW_ECC | NAND_OOB_SW_ECC_KW)) {
@@ -89,7 +91,7 @@ int nand_fileio_start(struct command_invocation *cmd,
 			state->oob_size = 64;
 			state->eccpos = nand_oob_64.eccpos;
 		}
-		state->oob = malloc(state->oob_size);
+		state->oob = malloc(state->oob_size * state->pages);
 	}
 
 	return ERROR_OK;
@@ -178,30 +180,27 @@ COMMAND_HELPER(nand_fileio_parse_args, struct nand_fileio_state *state,
 	return ERROR_OK;
 }
 
-/**
- * @returns If no error occurred, returns number of bytes consumed;
- * otherwise, returns a negative error code.)
- */
-int nand_fileio_read(struct nand_device *nand, struct nand_fileio_state *s)
+static size_t nand_fileio_read_page(struct nand_device *nand,
+		struct nand_fileio_state *s, uint8_t *page, uint8_t *oob)
 {
 	size_t total_read = 0;
 	size_t one_read;
 
-	if (NULL != s->page) {
-		fileio_read(s->fileio, s->page_size, s->page, &one_read);
+	if (NULL != page) {
+		fileio_read(s->fileio, s->page_size, page, &one_read);
 		if (one_read < s->page_size)
-			memset(s->page + one_read, 0xff, s->page_size - one_read);
+			memset(page + one_read, 0xff, s->page_size - one_read);
 		total_read += one_read;
 	}
 
 	if (s->oob_format & NAND_OOB_SW_ECC) {
 		uint8_t ecc[3];
-		memset(s->oob, 0xff, s->oob_size);
+		memset(oob, 0xff, s->oob_size);
 		for (uint32_t i = 0, j = 0; i < s->page_size; i += 256) {
-			nand_calculate_ecc(nand, s->page + i, ecc);
-			s->oob[s->eccpos[j++]] = ecc[0];
-			s->oob[s->eccpos[j++]] = ecc[1];
-			s->oob[s->eccpos[j++]] = ecc[2];
+			nand_calculate_ecc(nand, page + i, ecc);
+			oob[s->eccpos[j++]] = ecc[0];
+			oob[s->eccpos[j++]] = ecc[1];
+			oob[s->eccpos[j++]] = ecc[2];
 		}
 	} else if (s->oob_format & NAND_OOB_SW_ECC_KW)   {
 		/*
@@ -210,16 +209,37 @@ int nand_fileio_read(struct nand_device *nand, struct nand_fileio_state *s)
 		 * at the end of the OOB area.  It consists
 		 * of 10 bytes per 512-byte data block.
 		 */
-		uint8_t *ecc = s->oob + s->oob_size - s->page_size / 512 * 10;
-		memset(s->oob, 0xff, s->oob_size);
+		uint8_t *ecc = oob + s->oob_size - s->page_size / 512 * 10;
+		memset(oob, 0xff, s->oob_size);
 		for (uint32_t i = 0; i < s->page_size; i += 512) {
-			nand_calculate_ecc_kw(nand, s->page + i, ecc);
+			nand_calculate_ecc_kw(nand, page + i, ecc);
 			ecc += 10;
 		}
-	} else if (NULL != s->oob)   {
-		fileio_read(s->fileio, s->oob_size, s->oob, &one_read);
+	} else if (NULL != oob)   {
+		fileio_read(s->fileio, s->oob_size, oob, &one_read);
 		if (one_read < s->oob_size)
-			memset(s->oob + one_read, 0xff, s->oob_size - one_read);
+			memset(oob + one_read, 0xff, s->oob_size - one_read);
+		total_read += one_read;
+	}
+	return total_read;
+}
+
+/**
+ * Fills the page and oob buffers with up to @a s->pages pages from the
+ * file, computing their software ECC if requested, and sets @a s->count.
+ * @returns If no error occurred, returns number of bytes consumed;
+ * otherwise, returns a negative error code.)
+ */
+int nand_fileio_read(struct nand_device *nand, struct nand_fileio_state *s)
+{
+	size_t total_read = 0;
+
+	for (s->count = 0; s->count < s->pages && total_read < s->size; s->count++) {
+		size_t one_read = nand_fileio_read_page(nand, s,
+				s->page ? s->page + s->count * s->page_size : NULL,
+				s->oob ? s->oob + s->count * s->oob_size : NULL);
+		if (one_read == 0)
+			break;
 		total_read += one_read;
 	}
 	return total_read;
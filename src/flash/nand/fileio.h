@@ -21,6 +21,9 @@
 #include <helper/time_support.h>
 #include <helper/fileio.h>
 
+/* pages moved per device transfer by the file commands */
+#define NAND_FILEIO_PAGES 32
+
 struct nand_fileio_state {
 	uint32_t address;
 	uint32_t size;
@@ -34,6 +37,10 @@ struct nand_fileio_state {
 
 	const int *eccpos;
 
+	/** Number of pages the page and oob buffers hold, and hold now. */
+	uint32_t pages;
+	uint32_t count;
+
 	bool file_opened;
 	struct fileio *fileio;
 
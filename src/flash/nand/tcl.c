@@ -259,7 +259,7 @@ COMMAND_HANDLER(handle_nand_write_command)
 		}
 		s.size -= bytes_read;
 
-		retval = nand_write_page(nand, s.address / nand->page_size,
+		retval = nand_write_pages(nand, s.address / nand->page_size, s.count,
 				s.page, s.page_size, s.oob, s.oob_size);
 		if (ERROR_OK != retval) {
 			command_print(CMD, "failed writing file %s "
@@ -268,7 +268,7 @@ COMMAND_HANDLER(handle_nand_write_command)
 			nand_fileio_cleanup(&s);
 			return retval;
 		}
-		s.address += s.page_size;
+		s.address += s.count * nand->page_size;
 	}
 
 	if (nand_fileio_finish(&s) == ERROR_OK) {
@@ -299,15 +299,6 @@ COMMAND_HANDLER(handle_nand_verify_command)
 		return retval;
 
 	while (file.size > 0) {
-		retval = nand_read_page(nand, dev.address / dev.page_size,
-				dev.page, dev.page_size, dev.oob, dev.oob_size);
-		if (ERROR_OK != retval) {
-			command_print(CMD, "reading NAND flash page failed");
-			nand_fileio_cleanup(&dev);
-			nand_fileio_cleanup(&file);
-			return retval;
-		}
-
 		int bytes_read = nand_fileio_read(nand, &file);
 		if (bytes_read <= 0) {
 			command_print(CMD, "error while reading file");
@@ -316,17 +307,30 @@ COMMAND_HANDLER(handle_nand_verify_command)
 			return ERROR_FAIL;
 		}
 
-		if ((dev.page && memcmp(dev.page, file.page, dev.page_size)) ||
-				(dev.oob && memcmp(dev.oob, file.oob, dev.oob_size))) {
-			command_print(CMD, "NAND flash contents differ "
-				"at 0x%8.8" PRIx32, dev.address);
+		retval = nand_read_pages(nand, dev.address / nand->page_size, file.count,
+				dev.page, dev.page_size, dev.oob, dev.oob_size);
+		if (ERROR_OK != retval) {
+			command_print(CMD, "reading NAND flash page failed");
 			nand_fileio_cleanup(&dev);
 			nand_fileio_cleanup(&file);
-			return ERROR_FAIL;
+			return retval;
+		}
+
+		for (uint32_t i = 0; i < file.count; i++) {
+			if ((dev.page && memcmp(dev.page + i * dev.page_size,
+						file.page + i * file.page_size, dev.page_size)) ||
+					(dev.oob && memcmp(dev.oob + i * dev.oob_size,
+						file.oob + i * file.oob_size, dev.oob_size))) {
+				command_print(CMD, "NAND flash contents differ "
+					"at 0x%8.8" PRIx32, dev.address + i * nand->page_size);
+				nand_fileio_cleanup(&dev);
+				nand_fileio_cleanup(&file);
+				return ERROR_FAIL;
+			}
 		}
 
 		file.size -= bytes_read;
-		dev.address += nand->page_size;
+		dev.address += file.count * nand->page_size;
 	}
 
 	if (nand_fileio_finish(&file) == ERROR_OK) {
@@ -351,7 +355,9 @@ COMMAND_HANDLER(handle_nand_dump_command)
 
 	while (s.size > 0) {
 		size_t size_written;
-		retval = nand_read_page(nand, s.address / nand->page_size,
+		uint32_t count = MIN(s.size / nand->page_size, s.pages);
+
+		retval = nand_read_pages(nand, s.address / nand->page_size, count,
 				s.page, s.page_size, s.oob, s.oob_size);
 		if (ERROR_OK != retval) {
 			command_print(CMD, "reading NAND flash page failed");
@@ -359,14 +365,18 @@ COMMAND_HANDLER(handle_nand_dump_command)
 			return retval;
 		}
 
-		if (NULL != s.page)
-			fileio_write(s.fileio, s.page_size, s.page, &size_written);
+		for (uint32_t i = 0; i < count; i++) {
+			if (NULL != s.page)
+				fileio_write(s.fileio, s.page_size,
+						s.page + i * s.page_size, &size_written);
 
-		if (NULL != s.oob)
-			fileio_write(s.fileio, s.oob_size, s.oob, &size_written);
+			if (NULL != s.oob)
+				fileio_write(s.fileio, s.oob_size,
+						s.oob + i * s.oob_size, &size_written);
+		}
 
-		s.size -= nand->page_size;
-		s.address += nand->page_size;
+		s.size -= count * nand->page_size;
+		s.address += count * nand->page_size;
 	}
 
 	retval = fileio_size(s.fileio, &filesize);
@@ -381,6 +391,34 @@ COMMAND_HANDLER(handle_nand_dump_command)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(handle_nand_stats_command)
+{
+	if (CMD_ARGC < 1 || CMD_ARGC > 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	struct nand_device *p;
+	int retval = CALL_COMMAND_HANDLER(nand_command_get_device, 0, &p);
+	if (ERROR_OK != retval)
+		return retval;
+
+	if (CMD_ARGC == 2) {
+		if (strcmp(CMD_ARGV[1], "reset"))
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		memset(&p->stats, 0, sizeof(p->stats));
+		return ERROR_OK;
+	}
+
+	struct nand_io_stats *s = &p->stats;
+	command_print(CMD, "read %" PRIu64 " bytes in %fs (%0.3f MiB/s)",
+		s->bytes_read, s->read_time,
+		s->read_time > 0 ? s->bytes_read / s->read_time / (1024 * 1024) : 0.0);
+	command_print(CMD, "wrote %" PRIu64 " bytes in %fs (%0.3f MiB/s)",
+		s->bytes_written, s->write_time,
+		s->write_time > 0 ? s->bytes_written / s->write_time / (1024 * 1024) : 0.0);
+
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(handle_nand_raw_access_command)
 {
 	if ((CMD_ARGC < 1) || (CMD_ARGC > 2))
@@ -465,6 +503,13 @@ static const struct command_registration nand_exec_command_handlers[] = {
 			"['oob_raw'|'oob_only'|'oob_softecc'|'oob_softecc_kw']",
 		.help = "write to NAND flash device",
 	},
+	{
+		.name = "stats",
+		.handler = handle_nand_stats_command,
+		.mode = COMMAND_EXEC,
+		.usage = "bank_id ['reset']",
+		.help = "show or reset the transfer statistics of a NAND flash device",
+	},
 	{
 		.name = "raw_access",
 		.handler = handle_nand_raw_access_command,
@@ -549,6 +594,7 @@ static COMMAND_HELPER(create_nand_device, const char *bank_name,
 	c->address_cycles = 0;
 	c->page_size = 0;
 	c->use_raw = false;
+	memset(&c->stats, 0, sizeof(c->stats));
 	c->next = NULL;
 
 	retval = CALL_COMMAND_HANDLER(controller->nand_device_command, c);
@@ -696,47 +696,149 @@ static bool flash_write_check_gap(struct flash_bank *bank,
 }
 
 
-int flash_write_unlock(struct target *target, struct image *image,
-	uint32_t *written, int erase, bool unlock)
+/* image_read_section() wants the number of a section we only have
+ * a pointer to, from the list sorted by address */
+static int image_section_number(struct image *image, struct imagesection *section)
 {
-	int retval = ERROR_OK;
+	return section - image->sections;
+}
+
+/**
+ * A run made of a single image section which is only padded at its end
+ * can be written straight from the image data, except for the sector
+ * holding the last data byte and the padding, which has to be copied.
+ * @returns the number of bytes of the run that can be written from the
+ * image, 0 if the whole run has to be copied.
+ */
+static uint32_t flash_write_direct_size(struct flash_bank *bank,
+		uint32_t offset, uint32_t data_size, uint32_t run_size)
+{
+	if (data_size == run_size)
+		return run_size;
 
+	for (int i = 0; i < bank->num_sectors; i++) {
+		struct flash_sector *sector = &bank->sectors[i];
+
+		if (offset + data_size - 1 < sector->offset + sector->size)
+			return sector->offset > offset ? sector->offset - offset : 0;
+	}
+
+	return 0;
+}
+
+/**
+ * A contiguous range of a flash bank written from one or more image
+ * sections by flash_write_unlock().
+ */
+struct flash_write_run {
+	struct flash_bank *bank;
+	target_addr_t address;
+	uint32_t size;
+	uint32_t padding_at_start;
+	/* first and last section (in the sorted list) and where to start */
 	int section;
+	int section_last;
 	uint32_t section_offset;
-	struct flash_bank *c;
+	/* padding following each section, from section to section_last */
 	int *padding;
+	/* erase requested; erase started with erase_start(), to be waited for */
+	bool erased;
+	bool erase_pending;
+};
 
-	section = 0;
-	section_offset = 0;
+static int flash_driver_erase_start(struct flash_bank *bank, int first, int last)
+{
+	int retval;
 
-	if (written)
-		*written = 0;
+	if (!bank->driver->erase_start)
+		return flash_driver_erase(bank, first, last);
 
-	if (erase) {
-		/* assume all sectors need erasing - stops any problems
-		 * when flash_write is called multiple times */
+	retval = bank->driver->erase_start(bank, first, last);
+	if (retval != ERROR_OK)
+		LOG_ERROR("failed erasing sectors %d to %d", first, last);
 
-		flash_set_dirty();
+	return retval;
+}
+
+/**
+ * Unlock and erase the sectors of a run, if requested. Drivers providing
+ * erase_start() are left erasing while the caller goes on.
+ */
+static int flash_write_run_erase(struct target *target, struct flash_write_run *run,
+		int erase, bool unlock)
+{
+	int retval = ERROR_OK;
+
+	if (run->erased)
+		return ERROR_OK;
+	run->erased = true;
+
+	if (unlock)
+		retval = flash_unlock_address_range(target, run->address, run->size);
+
+	if (retval == ERROR_OK && erase) {
+		/* calculate and erase sectors */
+		retval = flash_iterate_address_range(target, "erase",
+				run->address, run->size, false, &flash_driver_erase_start);
+		if (retval == ERROR_OK && run->bank->driver->erase_start)
+			run->erase_pending = true;
 	}
 
-	/* allocate padding array */
-	padding = calloc(image->num_sections, sizeof(*padding));
+	return retval;
+}
 
-	/* This fn requires all sections to be in ascending order of addresses,
-	 * whereas an image can have sections out of order. */
+static int flash_write_run_erase_wait(struct flash_write_run *run)
+{
+	if (!run->erase_pending)
+		return ERROR_OK;
+	run->erase_pending = false;
+
+	int retval = run->bank->driver->erase_wait(run->bank);
+	if (retval != ERROR_OK)
+		LOG_ERROR("failed erasing flash bank %s", run->bank->name);
+
+	return retval;
+}
+
+/* The write functions require all sections to be in ascending order of
+ * addresses, whereas an image can have sections out of order. */
+static struct imagesection **flash_write_sort_sections(struct image *image)
+{
 	struct imagesection **sections = malloc(sizeof(struct imagesection *) *
 			image->num_sections);
-	int i;
-	for (i = 0; i < image->num_sections; i++)
+	for (int i = 0; i < image->num_sections; i++)
 		sections[i] = &image->sections[i];
 
 	qsort(sections, image->num_sections, sizeof(struct imagesection *),
 		compare_section);
 
+	return sections;
+}
+
+/**
+ * Split the image into runs of consecutive sections falling into the
+ * same flash bank, padded as required by the bank.
+ */
+static int flash_write_plan(struct target *target, struct image *image,
+		struct imagesection **sections, int erase, bool unlock,
+		struct flash_write_run **runs_out, int *num_runs_out)
+{
+	int retval = ERROR_OK;
+	int section = 0;
+	uint32_t section_offset = 0;
+	struct flash_bank *c;
+	struct flash_write_run *runs = NULL;
+	int num_runs = 0;
+
+	/* allocate padding array */
+	int *padding = calloc(image->num_sections, sizeof(*padding));
+	if (padding == NULL) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
 	/* loop until we reach end of the image */
 	while (section < image->num_sections) {
-		uint32_t buffer_idx;
-		uint8_t *buffer;
 		int section_last;
 		target_addr_t run_address = sections[section]->base_address + section_offset;
 		uint32_t run_size = sections[section]->size - section_offset;
@@ -864,78 +966,369 @@ int flash_write_unlock(struct target *target, struct image *image,
 			run_size += delta;
 		}
 
-		/* allocate buffer */
-		buffer = malloc(run_size);
-		if (buffer == NULL) {
-			LOG_ERROR("Out of memory for flash bank buffer");
+		struct flash_write_run *grown = realloc(runs, (num_runs + 1) * sizeof(*runs));
+		if (grown == NULL) {
+			LOG_ERROR("Out of memory");
 			retval = ERROR_FAIL;
 			goto done;
 		}
+		runs = grown;
+
+		struct flash_write_run *run = &runs[num_runs++];
+		memset(run, 0, sizeof(*run));
+		run->bank = c;
+		run->address = run_address;
+		run->size = run_size;
+		run->padding_at_start = padding_at_start;
+		run->section = section;
+		run->section_last = section_last;
+		run->section_offset = section_offset;
+		run->padding = malloc((section_last - section + 1) * sizeof(*padding));
+		if (run->padding == NULL) {
+			LOG_ERROR("Out of memory");
+			retval = ERROR_FAIL;
+			goto done;
+		}
+		memcpy(run->padding, &padding[section],
+				(section_last - section + 1) * sizeof(*padding));
 
-		if (padding_at_start)
-			memset(buffer, c->default_padded_value, padding_at_start);
-
-		buffer_idx = padding_at_start;
-
-		/* read sections to the buffer */
+		/* skip the image data consumed by this run, the same way
+		 * flash_write_run_prepare() will */
+		uint32_t buffer_idx = padding_at_start;
 		while (buffer_idx < run_size) {
-			size_t size_read;
-
-			size_read = run_size - buffer_idx;
+			uint32_t size_read = run_size - buffer_idx;
 			if (size_read > sections[section]->size - section_offset)
 				size_read = sections[section]->size - section_offset;
 
-			/* KLUDGE!
-			 *
-			 * #¤%#"%¤% we have to figure out the section # from the sorted
-			 * list of pointers to sections to invoke image_read_section()...
-			 */
-			intptr_t diff = (intptr_t)sections[section] - (intptr_t)image->sections;
-			int t_section_num = diff / sizeof(struct imagesection);
-
-			LOG_DEBUG("image_read_section: section = %d, t_section_num = %d, "
-					"section_offset = %"PRIu32", buffer_idx = %"PRIu32", size_read = %zu",
-				section, t_section_num, section_offset,
-				buffer_idx, size_read);
-			retval = image_read_section(image, t_section_num, section_offset,
-					size_read, buffer + buffer_idx, &size_read);
-			if (retval != ERROR_OK || size_read == 0) {
-				free(buffer);
-				goto done;
-			}
-
 			buffer_idx += size_read;
 			section_offset += size_read;
 
-			/* see if we need to pad the section */
-			if (padding[section]) {
-				memset(buffer + buffer_idx, c->default_padded_value, padding[section]);
+			if (padding[section])
 				buffer_idx += padding[section];
-			}
 
 			if (section_offset >= sections[section]->size) {
 				section++;
 				section_offset = 0;
 			}
 		}
+	}
 
-		retval = ERROR_OK;
+done:
+	free(padding);
+
+	*runs_out = runs;
+	*num_runs_out = num_runs;
+
+	return retval;
+}
+
+/**
+ * Build the data to write for a run. If the image data of the run can be
+ * used in place, @a direct points to it for the first @a direct_size bytes
+ * and @a buffer holds the rest.
+ */
+static int flash_write_run_prepare(struct image *image, struct imagesection **sections,
+		struct flash_write_run *run, const uint8_t **direct, uint32_t *direct_size,
+		uint8_t **buffer)
+{
+	struct flash_bank *c = run->bank;
+	int section = run->section;
+	uint32_t section_offset = run->section_offset;
+	uint32_t buffer_idx;
+	int retval = ERROR_OK;
+
+	/* write straight from the image data if it is held in host memory
+	 * (mapped file or parsed text format), avoiding a copy of large runs */
+	*direct = NULL;
+	*direct_size = 0;
+	if (run->section_last == section && run->padding_at_start == 0) {
+		uint32_t data_size = MIN(run->size, sections[section]->size - section_offset);
+		*direct_size = flash_write_direct_size(c, run->address - c->base,
+				data_size, run->size);
+		if (*direct_size && image_section_view(image, image_section_number(image, sections[section]),
+				section_offset, *direct_size, direct) != ERROR_OK)
+			*direct_size = 0;
+	}
+
+	/* allocate buffer for the rest */
+	*buffer = NULL;
+	if (run->size == *direct_size)
+		return ERROR_OK;
+
+	uint8_t *data = malloc(run->size - *direct_size);
+	if (data == NULL) {
+		LOG_ERROR("Out of memory for flash bank buffer");
+		return ERROR_FAIL;
+	}
+
+	if (run->padding_at_start)
+		memset(data, c->default_padded_value, run->padding_at_start);
+
+	buffer_idx = run->padding_at_start + *direct_size;
+	section_offset += *direct_size;
+
+	/* read sections to the buffer */
+	while (buffer_idx < run->size) {
+		size_t size_read;
+		int padding = run->padding[section - run->section];
+
+		size_read = run->size - buffer_idx;
+		if (size_read > sections[section]->size - section_offset)
+			size_read = sections[section]->size - section_offset;
+
+		int t_section_num = image_section_number(image, sections[section]);
+
+		LOG_DEBUG("image_read_section: section = %d, t_section_num = %d, "
+				"section_offset = %"PRIu32", buffer_idx = %"PRIu32", size_read = %zu",
+			section, t_section_num, section_offset,
+			buffer_idx, size_read);
+		retval = image_read_section(image, t_section_num, section_offset,
+				size_read, data + buffer_idx - *direct_size, &size_read);
+		if (retval != ERROR_OK || size_read == 0) {
+			free(data);
+			return retval != ERROR_OK ? retval : ERROR_FAIL;
+		}
+
+		buffer_idx += size_read;
+		section_offset += size_read;
+
+		/* see if we need to pad the section */
+		if (padding) {
+			memset(data + buffer_idx - *direct_size, c->default_padded_value, padding);
+			buffer_idx += padding;
+		}
+
+		if (section_offset >= sections[section]->size) {
+			section++;
+			section_offset = 0;
+		}
+	}
+
+	*buffer = data;
+	return ERROR_OK;
+}
+
+/**
+ * Write @a count bytes at @a idx of a run, from the image data and/or
+ * the buffer built by flash_write_run_prepare().
+ */
+static int flash_write_run_write(struct flash_write_run *run, const uint8_t *direct,
+		uint32_t direct_size, uint8_t *buffer, uint32_t idx, uint32_t count)
+{
+	uint32_t offset = run->address - run->bank->base;
+	int retval = ERROR_OK;
+
+	if (idx < direct_size && offset + idx == 0) {
+		/* some drivers (lpc2000) patch the vector table in the buffer
+		 * they are given, so the sector at the start of the bank gets
+		 * a copy; the image data may be shared by several writes */
+		uint32_t n = MIN(count, direct_size - idx);
+		if (run->bank->num_sectors)
+			n = MIN(n, run->bank->sectors[0].size);
+
+		uint8_t *copy = malloc(n);
+		if (copy == NULL) {
+			LOG_ERROR("Out of memory for flash bank buffer");
+			return ERROR_FAIL;
+		}
+		memcpy(copy, direct + idx, n);
+		retval = flash_driver_write(run->bank, copy, offset + idx, n);
+		free(copy);
+		idx += n;
+		count -= n;
+	}
+
+	if (retval == ERROR_OK && idx < direct_size && count) {
+		uint32_t n = MIN(count, direct_size - idx);
+
+		/* write flash sectors straight from the image data; past the
+		 * start of the bank no driver modifies it */
+		retval = flash_driver_write(run->bank, (uint8_t *)direct + idx, offset + idx, n);
+		idx += n;
+		count -= n;
+	}
 
-		if (unlock)
-			retval = flash_unlock_address_range(target, run_address, run_size);
-		if (retval == ERROR_OK) {
-			if (erase) {
-				/* calculate and erase sectors */
-				retval = flash_erase_address_range(target,
-						true, run_address, run_size);
+	if (retval == ERROR_OK && count) {
+		/* write flash sectors */
+		retval = flash_driver_write(run->bank, buffer + idx - direct_size,
+				offset + idx, count);
+	}
+
+	return retval;
+}
+
+/**
+ * Erase and write the changed part of a run [@a idx, @a idx + @a count).
+ */
+static int flash_write_run_changed(struct target *target, struct flash_write_run *run,
+		const uint8_t *direct, uint32_t direct_size, uint8_t *buffer,
+		uint32_t idx, uint32_t count, int erase, bool unlock)
+{
+	int retval = ERROR_OK;
+
+	if (unlock)
+		retval = flash_unlock_address_range(target, run->address + idx, count);
+	if (retval == ERROR_OK && erase)
+		retval = flash_erase_address_range(target, true, run->address + idx, count);
+	if (retval == ERROR_OK)
+		retval = flash_write_run_write(run, direct, direct_size, buffer, idx, count);
+
+	return retval;
+}
+
+/**
+ * Incremental write of a run: the CRC of each sector is computed on the
+ * target and compared with the image data, only consecutive sectors
+ * which differ are erased and written.
+ */
+static int flash_write_run_incremental(struct target *target, struct flash_write_run *run,
+		const uint8_t *direct, uint32_t direct_size, uint8_t *buffer,
+		int erase, bool unlock, uint32_t *written, unsigned int *skipped)
+{
+	struct flash_bank *c = run->bank;
+	uint32_t offset = run->address - c->base;
+	uint32_t changed_start = 0;
+	uint32_t changed_size = 0;
+	int retval;
+
+	for (int i = 0; i < c->num_sectors || i == 0; i++) {
+		uint32_t start = 0;
+		uint32_t end = run->size;
+
+		/* without a sector layout, compare the whole run */
+		if (c->num_sectors) {
+			struct flash_sector *sector = &c->sectors[i];
+
+			if (sector->offset + sector->size <= offset)
+				continue;
+			if (sector->offset >= offset + run->size)
+				break;
+			start = sector->offset > offset ? sector->offset - offset : 0;
+			end = MIN(sector->offset + sector->size - offset, run->size);
+		}
+
+		/* a sector lies either in the image data or in the buffer,
+		 * see flash_write_direct_size() */
+		uint8_t *data = start < direct_size ? (uint8_t *)direct + start
+				: buffer + start - direct_size;
+		uint32_t image_crc, target_crc;
+
+		retval = image_calculate_checksum(data, end - start, &image_crc);
+		if (retval != ERROR_OK)
+			return retval;
+
+		retval = target_checksum_memory(target, run->address + start, end - start,
+				&target_crc);
+		if (retval == ERROR_OK && image_crc == target_crc) {
+			LOG_DEBUG("skipping unchanged flash at " TARGET_ADDR_FMT,
+					run->address + start);
+			(*skipped)++;
+
+			if (changed_size) {
+				retval = flash_write_run_changed(target, run, direct, direct_size,
+						buffer, changed_start, changed_size, erase, unlock);
+				if (retval != ERROR_OK)
+					return retval;
+				*written += changed_size;
+				changed_size = 0;
 			}
+			continue;
+		}
+
+		/* checksum failures just make the sector count as changed */
+		if (changed_size == 0)
+			changed_start = start;
+		changed_size = end - changed_start;
+	}
+
+	if (changed_size) {
+		retval = flash_write_run_changed(target, run, direct, direct_size,
+				buffer, changed_start, changed_size, erase, unlock);
+		if (retval != ERROR_OK)
+			return retval;
+		*written += changed_size;
+	}
+
+	return ERROR_OK;
+}
+
+/**
+ * Write an image to flash. Writing is pipelined when the flash drivers
+ * support it: the erase of a run is started with erase_start() and the
+ * host prepares the data of the run while the flash is busy. If the next
+ * run is in another bank, its erase is started before the current run is
+ * written, which lets independent banks erase and program at once.
+ *
+ * In incremental mode, sectors whose content already matches the image
+ * are neither erased nor written; their number is returned in @a skipped.
+ */
+static int flash_write_image(struct target *target, struct image *image,
+	uint32_t *written, unsigned int *skipped, int erase, bool unlock,
+	bool incremental)
+{
+	int retval = ERROR_OK;
+	struct flash_write_run *runs = NULL;
+	int num_runs = 0;
+	uint32_t total = 0;
+	unsigned int sectors_skipped = 0;
+
+	if (erase) {
+		/* assume all sectors need erasing - stops any problems
+		 * when flash_write is called multiple times */
+
+		flash_set_dirty();
+	}
+
+	struct imagesection **sections = flash_write_sort_sections(image);
+	int i;
+
+	retval = flash_write_plan(target, image, sections, erase, unlock, &runs, &num_runs);
+	if (retval != ERROR_OK)
+		goto done;
+
+	for (i = 0; i < num_runs; i++) {
+		struct flash_write_run *run = &runs[i];
+		struct flash_write_run *next = i + 1 < num_runs ? &runs[i + 1] : NULL;
+		const uint8_t *direct;
+		uint32_t direct_size;
+		uint8_t *buffer;
+
+		if (incremental) {
+			/* the flash content has to be compared first */
+			retval = flash_write_run_prepare(image, sections, run, &direct,
+					&direct_size, &buffer);
+			if (retval != ERROR_OK)
+				goto done;
+
+			retval = flash_write_run_incremental(target, run, direct, direct_size,
+					buffer, erase, unlock, &total, &sectors_skipped);
+			free(buffer);
+			if (retval != ERROR_OK)
+				goto done;
+			continue;
 		}
 
-		if (retval == ERROR_OK) {
-			/* write flash sectors */
-			retval = flash_driver_write(c, buffer, run_address - c->base, run_size);
+		retval = flash_write_run_erase(target, run, erase, unlock);
+		if (retval != ERROR_OK)
+			goto done;
+
+		/* erase the next run in the background if that doesn't involve
+		 * the bank we are about to write; unlocking may have to go through
+		 * the controller of another bank, so leave that alone */
+		if (erase && !unlock && next && next->bank != run->bank
+				&& next->bank->driver->erase_start) {
+			retval = flash_write_run_erase(target, next, erase, unlock);
+			if (retval != ERROR_OK)
+				goto done;
 		}
 
+		retval = flash_write_run_prepare(image, sections, run, &direct, &direct_size, &buffer);
+		if (retval == ERROR_OK)
+			retval = flash_write_run_erase_wait(run);
+
+		if (retval == ERROR_OK)
+			retval = flash_write_run_write(run, direct, direct_size, buffer, 0, run->size);
+
 		free(buffer);
 
 		if (retval != ERROR_OK) {
@@ -943,13 +1336,142 @@ int flash_write_unlock(struct target *target, struct image *image,
 			goto done;
 		}
 
-		if (written != NULL)
-			*written += run_size;	/* add run size to total written counter */
+		total += run->size;	/* add run size to total written counter */
 	}
 
 done:
+	for (i = 0; i < num_runs; i++) {
+		/* don't leave a bank erasing behind us */
+		flash_write_run_erase_wait(&runs[i]);
+		free(runs[i].padding);
+	}
+	free(runs);
 	free(sections);
-	free(padding);
+
+	if (written)
+		*written = total;
+	if (skipped)
+		*skipped = sectors_skipped;
+
+	return retval;
+}
+
+int flash_write_unlock(struct target *target, struct image *image,
+	uint32_t *written, int erase, bool unlock)
+{
+	return flash_write_image(target, image, written, NULL, erase, unlock, false);
+}
+
+int flash_write_incremental(struct target *target, struct image *image,
+	uint32_t *written, unsigned int *skipped, int erase, bool unlock)
+{
+	return flash_write_image(target, image, written, skipped, erase, unlock, true);
+}
+
+/* per job state of flash_write_multi() */
+struct flash_write_multi_state {
+	struct imagesection **sections;
+	struct flash_write_run *runs;
+	int num_runs;
+	int next_run;
+	uint32_t size;
+};
+
+/* Write the next run of a job and start erasing the one after it. */
+static int flash_write_multi_step(struct flash_write_job *job,
+		struct flash_write_multi_state *state)
+{
+	struct flash_write_run *run = &state->runs[state->next_run++];
+	const uint8_t *direct;
+	uint32_t direct_size;
+	uint8_t *buffer;
+
+	int retval = flash_write_run_erase(job->target, run, job->erase, job->unlock);
+	if (retval != ERROR_OK)
+		return retval;
+
+	retval = flash_write_run_prepare(job->image, state->sections, run, &direct,
+			&direct_size, &buffer);
+	if (retval == ERROR_OK)
+		retval = flash_write_run_erase_wait(run);
+	if (retval == ERROR_OK)
+		retval = flash_write_run_write(run, direct, direct_size, buffer, 0, run->size);
+	free(buffer);
+	if (retval != ERROR_OK)
+		return retval;
+
+	job->written += run->size;
+	LOG_INFO("%s: wrote %" PRIu32 " of %" PRIu32 " bytes",
+			target_name(job->target), job->written, state->size);
+
+	/* nothing of this target is busy now, so its next run can erase
+	 * while the other targets are being written */
+	if (state->next_run < state->num_runs)
+		retval = flash_write_run_erase(job->target, &state->runs[state->next_run],
+				job->erase, job->unlock);
+
+	return retval;
+}
+
+int flash_write_multi(struct flash_write_job *jobs, unsigned int num_jobs)
+{
+	struct flash_write_multi_state *states = calloc(num_jobs, sizeof(*states));
+	if (states == NULL) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	for (unsigned int j = 0; j < num_jobs; j++) {
+		struct flash_write_job *job = &jobs[j];
+		struct flash_write_multi_state *state = &states[j];
+
+		job->written = 0;
+		if (job->erase)
+			flash_set_dirty();
+
+		state->sections = flash_write_sort_sections(job->image);
+		job->retval = flash_write_plan(job->target, job->image, state->sections,
+				job->erase, job->unlock, &state->runs, &state->num_runs);
+
+		for (int i = 0; i < state->num_runs; i++)
+			state->size += state->runs[i].size;
+	}
+
+	/* get every target erasing before writing the first one */
+	for (unsigned int j = 0; j < num_jobs; j++) {
+		if (jobs[j].retval == ERROR_OK && states[j].num_runs)
+			jobs[j].retval = flash_write_run_erase(jobs[j].target, &states[j].runs[0],
+					jobs[j].erase, jobs[j].unlock);
+	}
+
+	/* one run per target in turn; a failing target doesn't stop the others */
+	bool busy;
+	do {
+		busy = false;
+		for (unsigned int j = 0; j < num_jobs; j++) {
+			if (jobs[j].retval != ERROR_OK || states[j].next_run == states[j].num_runs)
+				continue;
+
+			jobs[j].retval = flash_write_multi_step(&jobs[j], &states[j]);
+			if (jobs[j].retval != ERROR_OK)
+				LOG_ERROR("%s: flash write failed", target_name(jobs[j].target));
+			busy = true;
+		}
+	} while (busy);
+
+	int retval = ERROR_OK;
+	for (unsigned int j = 0; j < num_jobs; j++) {
+		for (int i = 0; i < states[j].num_runs; i++) {
+			flash_write_run_erase_wait(&states[j].runs[i]);
+			free(states[j].runs[i].padding);
+		}
+		free(states[j].runs);
+		free(states[j].sections);
+
+		if (jobs[j].retval != ERROR_OK)
+			retval = ERROR_FAIL;
+	}
+	free(states);
 
 	return retval;
 }
@@ -106,6 +106,29 @@ struct flash_driver {
 	 */
 	int (*erase)(struct flash_bank *bank, int first, int last);
 
+	/**
+	 * Optional: start erasing sectors without waiting for the erase
+	 * to complete, so the host can prepare the data to write meanwhile.
+	 * Until erase_wait() is called, the driver may only be asked to
+	 * access other banks.  Drivers providing this must provide
+	 * erase_wait() too.
+	 *
+	 * @param bank The bank of flash to be erased.
+	 * @param first The number of the first sector to erase.
+	 * @param last The number of the last sector to erase.
+	 * @returns ERROR_OK if the erase is running or done; otherwise,
+	 * an error code.
+	 */
+	int (*erase_start)(struct flash_bank *bank, int first, int last);
+
+	/**
+	 * Wait for the erase started by erase_start() to complete.
+	 *
+	 * @param bank The bank of flash being erased.
+	 * @returns ERROR_OK if successful; otherwise, an error code.
+	 */
+	int (*erase_wait)(struct flash_bank *bank);
+
 	/**
 	 * Bank/sector protection routine (target-specific).
 	 *
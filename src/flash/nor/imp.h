@@ -46,4 +46,25 @@ int flash_driver_read(struct flash_bank *bank,
 int flash_write_unlock(struct target *target, struct image *image,
 		uint32_t *written, int erase, bool unlock);
 
+/* write an image to flash, leaving the sectors which already hold
+ * the right data alone */
+int flash_write_incremental(struct target *target, struct image *image,
+		uint32_t *written, unsigned int *skipped, int erase, bool unlock);
+
+/** One target's image for flash_write_multi(). */
+struct flash_write_job {
+	struct target *target;
+	struct image *image;
+	int erase;
+	bool unlock;
+	/** bytes written so far */
+	uint32_t written;
+	/** result for this target */
+	int retval;
+};
+
+/* write images to the flash of several targets, erasing the flash of
+ * each target while the others are being written */
+int flash_write_multi(struct flash_write_job *jobs, unsigned int num_jobs);
+
 #endif /* OPENOCD_FLASH_NOR_IMP_H */
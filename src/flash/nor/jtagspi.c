@@ -25,6 +25,9 @@
 #include <helper/time_support.h>
 
 #define JTAGSPI_MAX_TIMEOUT 3000
+/* bytes read by one SPI read command, and queued before a flush */
+#define JTAGSPI_READ_CHUNK (64 * 1024)
+#define JTAGSPI_READ_FLUSH (1024 * 1024)
 
 
 struct jtagspi_flash_bank {
@@ -75,7 +78,10 @@ static void flip_u8(uint8_t *in, uint8_t *out, int len)
 		out[i] = flip_u32(in[i], 8);
 }
 
-static int jtagspi_cmd(struct flash_bank *bank, uint8_t cmd,
+/* Queue a command. Data is sent if len > 0; if len < 0, -len bits are
+ * received into data once the queue has been executed, in the bit order
+ * of the wire: see jtagspi_cmd(). */
+static int jtagspi_queue_cmd(struct flash_bank *bank, uint8_t cmd,
 		uint32_t *addr, uint8_t *data, int len)
 {
 	struct jtagspi_flash_bank *info = bank->driver_priv;
@@ -126,13 +132,11 @@ static int jtagspi_cmd(struct flash_bank *bank, uint8_t cmd,
 		n++;
 	}
 
+	/* read data goes straight to the caller's buffer; data to be
+	 * written is flipped into a copy, the queue makes its own */
 	lenb = DIV_ROUND_UP(len, 8);
-	data_buf = malloc(lenb);
+	data_buf = NULL;
 	if (lenb > 0) {
-		if (data_buf == NULL) {
-			LOG_ERROR("no memory for spi buffer");
-			return ERROR_FAIL;
-		}
 		if (is_read) {
 			fields[n].num_bits = jtag_tap_count_enabled();
 			fields[n].out_value = NULL;
@@ -140,8 +144,13 @@ static int jtagspi_cmd(struct flash_bank *bank, uint8_t cmd,
 			n++;
 
 			fields[n].out_value = NULL;
-			fields[n].in_value = data_buf;
+			fields[n].in_value = data;
 		} else {
+			data_buf = malloc(lenb);
+			if (data_buf == NULL) {
+				LOG_ERROR("no memory for spi buffer");
+				return ERROR_FAIL;
+			}
 			flip_u8(data, data_buf, lenb);
 			fields[n].out_value = data_buf;
 			fields[n].in_value = NULL;
@@ -153,14 +162,27 @@ static int jtagspi_cmd(struct flash_bank *bank, uint8_t cmd,
 	jtagspi_set_ir(bank);
 	/* passing from an IR scan to SHIFT-DR clears BYPASS registers */
 	jtag_add_dr_scan(info->tap, n, fields, TAP_IDLE);
-	jtag_execute_queue();
 
-	if (is_read)
-		flip_u8(data_buf, data, lenb);
 	free(data_buf);
 	return ERROR_OK;
 }
 
+static int jtagspi_cmd(struct flash_bank *bank, uint8_t cmd,
+		uint32_t *addr, uint8_t *data, int len)
+{
+	int retval = jtagspi_queue_cmd(bank, cmd, addr, data, len);
+	if (retval != ERROR_OK)
+		return retval;
+
+	retval = jtag_execute_queue();
+	if (retval != ERROR_OK)
+		return retval;
+
+	if (len < 0)
+		flip_u8(data, data, DIV_ROUND_UP(-len, 8));
+	return ERROR_OK;
+}
+
 static int jtagspi_probe(struct flash_bank *bank)
 {
 	struct jtagspi_flash_bank *info = bank->driver_priv;
@@ -228,13 +250,15 @@ static int jtagspi_probe(struct flash_bank *bank)
 	return ERROR_OK;
 }
 
-static void jtagspi_read_status(struct flash_bank *bank, uint32_t *status)
+static int jtagspi_read_status(struct flash_bank *bank, uint32_t *status)
 {
 	uint8_t buf;
-	if (jtagspi_cmd(bank, SPIFLASH_READ_STATUS, NULL, &buf, -8) == ERROR_OK) {
+	int retval = jtagspi_cmd(bank, SPIFLASH_READ_STATUS, NULL, &buf, -8);
+	if (retval == ERROR_OK) {
 		*status = buf;
 		/* LOG_DEBUG("status=0x%08" PRIx32, *status); */
 	}
+	return retval;
 }
 
 static int jtagspi_wait(struct flash_bank *bank, int timeout_ms)
@@ -245,7 +269,9 @@ static int jtagspi_wait(struct flash_bank *bank, int timeout_ms)
 
 	do {
 		dt = timeval_ms() - t0;
-		jtagspi_read_status(bank, &status);
+		int retval = jtagspi_read_status(bank, &status);
+		if (retval != ERROR_OK)
+			return retval;
 		if ((status & SPIFLASH_BSY_BIT) == 0) {
 			LOG_DEBUG("waited %" PRId64 " ms", dt);
 			return ERROR_OK;
@@ -261,8 +287,11 @@ static int jtagspi_write_enable(struct flash_bank *bank)
 {
 	uint32_t status;
 
-	jtagspi_cmd(bank, SPIFLASH_WRITE_ENABLE, NULL, NULL, 0);
-	jtagspi_read_status(bank, &status);
+	int retval = jtagspi_cmd(bank, SPIFLASH_WRITE_ENABLE, NULL, NULL, 0);
+	if (retval == ERROR_OK)
+		retval = jtagspi_read_status(bank, &status);
+	if (retval != ERROR_OK)
+		return retval;
 	if ((status & SPIFLASH_WE_BIT) == 0) {
 		LOG_ERROR("Cannot enable write to flash. Status=0x%08" PRIx32, status);
 		return ERROR_FAIL;
@@ -364,24 +393,69 @@ static int jtagspi_protect(struct flash_bank *bank, int set, int first, int last
 static int jtagspi_read(struct flash_bank *bank, uint8_t *buffer, uint32_t offset, uint32_t count)
 {
 	struct jtagspi_flash_bank *info = bank->driver_priv;
+	uint32_t n = 0;
+	int retval;
 
 	if (!(info->probed)) {
 		LOG_ERROR("Flash bank not yet probed.");
 		return ERROR_FLASH_BANK_NOT_PROBED;
 	}
 
-	jtagspi_cmd(bank, SPIFLASH_READ, &offset, buffer, -count*8);
+	/* read in chunks straight into the buffer, several per flush,
+	 * rather than in one scan as large as the whole region */
+	while (n < count) {
+		uint32_t start = n;
+
+		while (n < count && n - start < JTAGSPI_READ_FLUSH) {
+			uint32_t chunk = MIN(count - n, JTAGSPI_READ_CHUNK);
+			uint32_t addr = offset + n;
+
+			retval = jtagspi_queue_cmd(bank, SPIFLASH_READ, &addr, buffer + n, -chunk * 8);
+			if (retval != ERROR_OK)
+				return retval;
+			n += chunk;
+		}
+
+		retval = jtag_execute_queue();
+		if (retval != ERROR_OK)
+			return retval;
+
+		flip_u8(buffer + start, buffer + start, n - start);
+		LOG_DEBUG("read 0x%08" PRIx32 " bytes at 0x%08" PRIx32, n - start, offset + start);
+	}
+
 	return ERROR_OK;
 }
 
 static int jtagspi_page_write(struct flash_bank *bank, const uint8_t *buffer, uint32_t offset, uint32_t count)
 {
+	uint8_t status[2] = { 0 };
 	int retval;
 
-	retval = jtagspi_write_enable(bank);
+	/* write enable, program and the status checks go out in a single
+	 * flush; only a page still busy afterwards needs polling */
+	retval = jtagspi_queue_cmd(bank, SPIFLASH_WRITE_ENABLE, NULL, NULL, 0);
+	if (retval == ERROR_OK)
+		retval = jtagspi_queue_cmd(bank, SPIFLASH_READ_STATUS, NULL, &status[0], -8);
+	if (retval == ERROR_OK)
+		retval = jtagspi_queue_cmd(bank, SPIFLASH_PAGE_PROGRAM, &offset, (uint8_t *) buffer, count*8);
+	if (retval == ERROR_OK)
+		retval = jtagspi_queue_cmd(bank, SPIFLASH_READ_STATUS, NULL, &status[1], -8);
+	if (retval == ERROR_OK)
+		retval = jtag_execute_queue();
 	if (retval != ERROR_OK)
 		return retval;
-	jtagspi_cmd(bank, SPIFLASH_PAGE_PROGRAM, &offset, (uint8_t *) buffer, count*8);
+
+	flip_u8(status, status, 2);
+
+	if ((status[0] & SPIFLASH_WE_BIT) == 0) {
+		LOG_ERROR("Cannot enable write to flash. Status=0x%02" PRIx8, status[0]);
+		return ERROR_FAIL;
+	}
+
+	if ((status[1] & SPIFLASH_BSY_BIT) == 0)
+		return ERROR_OK;
+
 	return jtagspi_wait(bank, JTAGSPI_MAX_TIMEOUT);
 }
 
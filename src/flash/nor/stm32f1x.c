@@ -126,9 +126,11 @@ struct stm32x_flash_bank {
 	int user_data_offset;
 	int option_offset;
 	uint32_t user_bank_size;
+	/* sectors left erasing by stm32x_erase_start() */
+	int erase_first;
+	int erase_last;
 };
 
-static int stm32x_mass_erase(struct flash_bank *bank);
 static int stm32x_get_device_id(struct flash_bank *bank, uint32_t *device_id);
 static int stm32x_write_block(struct flash_bank *bank, const uint8_t *buffer,
 		uint32_t address, uint32_t count);
@@ -379,8 +381,9 @@ static int stm32x_protect_check(struct flash_bank *bank)
 	return ERROR_OK;
 }
 
-static int stm32x_erase(struct flash_bank *bank, int first, int last)
+static int stm32x_erase_start(struct flash_bank *bank, int first, int last)
 {
+	struct stm32x_flash_bank *stm32x_info = bank->driver_priv;
 	struct target *target = bank->target;
 	int i;
 
@@ -389,9 +392,6 @@ static int stm32x_erase(struct flash_bank *bank, int first, int last)
 		return ERROR_TARGET_NOT_HALTED;
 	}
 
-	if ((first == 0) && (last == (bank->num_sectors - 1)))
-		return stm32x_mass_erase(bank);
-
 	/* unlock flash registers */
 	int retval = target_write_u32(target, stm32x_get_flash_reg(bank, STM32_FLASH_KEYR), KEY1);
 	if (retval != ERROR_OK)
@@ -400,6 +400,21 @@ static int stm32x_erase(struct flash_bank *bank, int first, int last)
 	if (retval != ERROR_OK)
 		return retval;
 
+	if ((first == 0) && (last == (bank->num_sectors - 1))) {
+		/* mass erase flash memory */
+		retval = target_write_u32(target, stm32x_get_flash_reg(bank, STM32_FLASH_CR), FLASH_MER);
+		if (retval != ERROR_OK)
+			return retval;
+		retval = target_write_u32(target, stm32x_get_flash_reg(bank, STM32_FLASH_CR),
+				FLASH_MER | FLASH_STRT);
+		if (retval != ERROR_OK)
+			return retval;
+
+		stm32x_info->erase_first = first;
+		stm32x_info->erase_last = last;
+		return ERROR_OK;
+	}
+
 	for (i = first; i <= last; i++) {
 		retval = target_write_u32(target, stm32x_get_flash_reg(bank, STM32_FLASH_CR), FLASH_PER);
 		if (retval != ERROR_OK)
@@ -413,6 +428,10 @@ static int stm32x_erase(struct flash_bank *bank, int first, int last)
 		if (retval != ERROR_OK)
 			return retval;
 
+		/* the last page is left erasing */
+		if (i == last)
+			break;
+
 		retval = stm32x_wait_status_busy(bank, FLASH_ERASE_TIMEOUT);
 		if (retval != ERROR_OK)
 			return retval;
@@ -420,6 +439,23 @@ static int stm32x_erase(struct flash_bank *bank, int first, int last)
 		bank->sectors[i].is_erased = 1;
 	}
 
+	stm32x_info->erase_first = last;
+	stm32x_info->erase_last = last;
+	return ERROR_OK;
+}
+
+static int stm32x_erase_wait(struct flash_bank *bank)
+{
+	struct stm32x_flash_bank *stm32x_info = bank->driver_priv;
+	struct target *target = bank->target;
+
+	int retval = stm32x_wait_status_busy(bank, FLASH_ERASE_TIMEOUT);
+	if (retval != ERROR_OK)
+		return retval;
+
+	for (int i = stm32x_info->erase_first; i <= stm32x_info->erase_last; i++)
+		bank->sectors[i].is_erased = 1;
+
 	retval = target_write_u32(target, stm32x_get_flash_reg(bank, STM32_FLASH_CR), FLASH_LOCK);
 	if (retval != ERROR_OK)
 		return retval;
@@ -427,6 +463,15 @@ static int stm32x_erase(struct flash_bank *bank, int first, int last)
 	return ERROR_OK;
 }
 
+static int stm32x_erase(struct flash_bank *bank, int first, int last)
+{
+	int retval = stm32x_erase_start(bank, first, last);
+	if (retval != ERROR_OK)
+		return retval;
+
+	return stm32x_erase_wait(bank);
+}
+
 static int stm32x_protect(struct flash_bank *bank, int set, int first, int last)
 {
 	struct target *target = bank->target;
@@ -1575,6 +1620,8 @@ const struct flash_driver stm32f1x_flash = {
 	.commands = stm32x_command_handlers,
 	.flash_bank_command = stm32x_flash_bank_command,
 	.erase = stm32x_erase,
+	.erase_start = stm32x_erase_start,
+	.erase_wait = stm32x_erase_wait,
 	.protect = stm32x_protect,
 	.write = stm32x_write,
 	.read = default_flash_read,
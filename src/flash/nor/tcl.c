@@ -415,6 +415,8 @@ COMMAND_HANDLER(handle_flash_write_image_command)
 	/* flash auto-erase is disabled by default*/
 	int auto_erase = 0;
 	bool auto_unlock = false;
+	bool incremental = false;
+	unsigned int skipped = 0;
 
 	while (CMD_ARGC) {
 		if (strcmp(CMD_ARGV[0], "erase") == 0) {
@@ -427,6 +429,11 @@ COMMAND_HANDLER(handle_flash_write_image_command)
 			CMD_ARGV++;
 			CMD_ARGC--;
 			command_print(CMD, "auto unlock enabled");
+		} else if (strcmp(CMD_ARGV[0], "incremental") == 0) {
+			incremental = true;
+			CMD_ARGV++;
+			CMD_ARGC--;
+			command_print(CMD, "incremental write enabled");
 		} else
 			break;
 	}
@@ -456,7 +463,11 @@ COMMAND_HANDLER(handle_flash_write_image_command)
 	if (retval != ERROR_OK)
 		return retval;
 
-	retval = flash_write_unlock(target, &image, &written, auto_erase, auto_unlock);
+	if (incremental)
+		retval = flash_write_incremental(target, &image, &written, &skipped,
+				auto_erase, auto_unlock);
+	else
+		retval = flash_write_unlock(target, &image, &written, auto_erase, auto_unlock);
 	if (retval != ERROR_OK) {
 		image_close(&image);
 		return retval;
@@ -466,6 +477,8 @@ COMMAND_HANDLER(handle_flash_write_image_command)
 		command_print(CMD, "wrote %" PRIu32 " bytes from file %s "
 			"in %fs (%0.3f KiB/s)", written, CMD_ARGV[0],
 			duration_elapsed(&bench), duration_kbps(&bench, written));
+		if (incremental)
+			command_print(CMD, "skipped %u unchanged sectors", skipped);
 	}
 
 	image_close(&image);
@@ -473,6 +486,121 @@ COMMAND_HANDLER(handle_flash_write_image_command)
 	return retval;
 }
 
+COMMAND_HANDLER(handle_flash_write_image_multi_command)
+{
+	struct flash_write_job *jobs = NULL;
+	unsigned int num_jobs = 0;
+	struct image image;
+	int auto_erase = 0;
+	bool auto_unlock = false;
+	int retval;
+
+	while (CMD_ARGC) {
+		if (strcmp(CMD_ARGV[0], "erase") == 0) {
+			auto_erase = 1;
+			CMD_ARGV++;
+			CMD_ARGC--;
+			command_print(CMD, "auto erase enabled");
+		} else if (strcmp(CMD_ARGV[0], "unlock") == 0) {
+			auto_unlock = true;
+			CMD_ARGV++;
+			CMD_ARGC--;
+			command_print(CMD, "auto unlock enabled");
+		} else
+			break;
+	}
+
+	if (CMD_ARGC < 2 || CMD_ARGC > 4)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	/* the target list is a single, blank separated argument */
+	char *names = strdup(CMD_ARGV[0]);
+	if (names == NULL) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	retval = ERROR_OK;
+	for (char *name = strtok(names, " \t"); name; name = strtok(NULL, " \t")) {
+		struct target *target = get_target(name);
+		if (target == NULL) {
+			command_print(CMD, "Target '%s' not found", name);
+			retval = ERROR_COMMAND_ARGUMENT_INVALID;
+			break;
+		}
+
+		struct flash_write_job *grown = realloc(jobs, (num_jobs + 1) * sizeof(*jobs));
+		if (grown == NULL) {
+			LOG_ERROR("Out of memory");
+			retval = ERROR_FAIL;
+			break;
+		}
+		jobs = grown;
+
+		memset(&jobs[num_jobs], 0, sizeof(*jobs));
+		jobs[num_jobs].target = target;
+		jobs[num_jobs].image = &image;
+		jobs[num_jobs].erase = auto_erase;
+		jobs[num_jobs].unlock = auto_unlock;
+		num_jobs++;
+	}
+	free(names);
+
+	if (retval == ERROR_OK && num_jobs == 0)
+		retval = ERROR_COMMAND_SYNTAX_ERROR;
+	if (retval != ERROR_OK) {
+		free(jobs);
+		return retval;
+	}
+
+	struct duration bench;
+	duration_start(&bench);
+
+	if (CMD_ARGC >= 3) {
+		image.base_address_set = 1;
+		if (parse_llong(CMD_ARGV[2], &image.base_address) != ERROR_OK) {
+			command_print(CMD, "Invalid offset: %s", CMD_ARGV[2]);
+			free(jobs);
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		}
+	} else {
+		image.base_address_set = 0;
+		image.base_address = 0x0;
+	}
+
+	image.start_address_set = 0;
+
+	/* every target gets the same image */
+	retval = image_open(&image, CMD_ARGV[1], (CMD_ARGC == 4) ? CMD_ARGV[3] : NULL);
+	if (retval != ERROR_OK) {
+		free(jobs);
+		return retval;
+	}
+
+	retval = flash_write_multi(jobs, num_jobs);
+
+	uint32_t total = 0;
+	for (unsigned int i = 0; i < num_jobs; i++) {
+		if (jobs[i].retval == ERROR_OK)
+			command_print(CMD, "%s: wrote %" PRIu32 " bytes",
+					target_name(jobs[i].target), jobs[i].written);
+		else
+			command_print(CMD, "%s: failed after %" PRIu32 " bytes",
+					target_name(jobs[i].target), jobs[i].written);
+		total += jobs[i].written;
+	}
+
+	if (duration_measure(&bench) == ERROR_OK)
+		command_print(CMD, "wrote %" PRIu32 " bytes from file %s to %u targets "
+			"in %fs (%0.3f KiB/s)", total, CMD_ARGV[1], num_jobs,
+			duration_elapsed(&bench), duration_kbps(&bench, total));
+
+	image_close(&image);
+	free(jobs);
+
+	return retval;
+}
+
 COMMAND_HANDLER(handle_flash_fill_command)
 {
 	target_addr_t address;
@@ -1038,11 +1166,20 @@ static const struct command_registration flash_exec_command_handlers[] = {
 		.name = "write_image",
 		.handler = handle_flash_write_image_command,
 		.mode = COMMAND_EXEC,
-		.usage = "[erase] [unlock] filename [offset [file_type]]",
+		.usage = "[erase] [unlock] [incremental] filename [offset [file_type]]",
 		.help = "Write an image to flash.  Optionally first unprotect "
-			"and/or erase the region to be used.  Allow optional "
+			"and/or erase the region to be used, optionally only "
+			"the sectors which differ from the image.  Allow optional "
 			"offset from beginning of bank (defaults to zero)",
 	},
+	{
+		.name = "write_image_multi",
+		.handler = handle_flash_write_image_multi_command,
+		.mode = COMMAND_EXEC,
+		.usage = "[erase] [unlock] target_list filename [offset [file_type]]",
+		.help = "Write the same image to the flash of several targets, "
+			"letting each target erase while the others are written.",
+	},
 	{
 		.name = "read_bank",
 		.handler = handle_flash_read_bank_command,
@@ -50,6 +50,33 @@ static const char hex_digits[] = {
 	'a', 'b', 'c', 'd', 'e', 'f'
 };
 
+/* the two hex digits of every byte value */
+static const char hex_pairs[] =
+	"000102030405060708090a0b0c0d0e0f"
+	"101112131415161718191a1b1c1d1e1f"
+	"202122232425262728292a2b2c2d2e2f"
+	"303132333435363738393a3b3c3d3e3f"
+	"404142434445464748494a4b4c4d4e4f"
+	"505152535455565758595a5b5c5d5e5f"
+	"606162636465666768696a6b6c6d6e6f"
+	"707172737475767778797a7b7c7d7e7f"
+	"808182838485868788898a8b8c8d8e8f"
+	"909192939495969798999a9b9c9d9e9f"
+	"a0a1a2a3a4a5a6a7a8a9aaabacadaeaf"
+	"b0b1b2b3b4b5b6b7b8b9babbbcbdbebf"
+	"c0c1c2c3c4c5c6c7c8c9cacbcccdcecf"
+	"d0d1d2d3d4d5d6d7d8d9dadbdcdddedf"
+	"e0e1e2e3e4e5e6e7e8e9eaebecedeeef"
+	"f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff";
+
+/* value of every hex digit plus one, zero for anything else */
+static const uint8_t hex_values[256] = {
+	['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5, ['5'] = 6,
+	['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10, ['a'] = 11, ['b'] = 12,
+	['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16, ['A'] = 11, ['B'] = 12,
+	['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16,
+};
+
 void *buf_cpy(const void *from, void *_to, unsigned size)
 {
 	if (NULL == from || NULL == _to)
@@ -128,48 +155,77 @@ void *buf_set_ones(void *_buf, unsigned size)
 	return buf;
 }
 
+/* up to 8 bits of @a src starting at bit @a pos, in the low bits */
+static inline uint8_t buf_get_bits(const uint8_t *src, unsigned pos, unsigned n)
+{
+	const uint8_t *p = src + pos / 8;
+	unsigned q = pos % 8;
+	unsigned v = p[0] >> q;
+
+	/* only touch the next byte when the bits extend into it */
+	if (q + n > 8)
+		v |= p[1] << (8 - q);
+
+	return v & ((1u << n) - 1);
+}
+
+/* merge the low @a n bits of @a v into @a dst at bit @a q */
+static inline void buf_put_bits(uint8_t *dst, unsigned q, unsigned n, uint8_t v)
+{
+	uint8_t mask = ((1u << n) - 1) << q;
+
+	*dst = (*dst & ~mask) | ((v << q) & mask);
+}
+
 void *buf_set_buf(const void *_src, unsigned src_start,
 	void *_dst, unsigned dst_start, unsigned len)
 {
 	const uint8_t *src = _src;
 	uint8_t *dst = _dst;
-	unsigned i, sb, db, sq, dq, lb, lq;
+	unsigned dq, sq;
 
-	sb = src_start / 8;
-	db = dst_start / 8;
-	sq = src_start % 8;
+	dst += dst_start / 8;
 	dq = dst_start % 8;
-	lb = len / 8;
-	lq = len % 8;
-
-	src += sb;
-	dst += db;
 
 	/* check if both buffers are on byte boundary and
 	 * len is a multiple of 8bit so we can simple copy
 	 * the buffer */
-	if ((sq == 0) && (dq == 0) &&  (lq == 0)) {
-		for (i = 0; i < lb; i++)
-			*dst++ = *src++;
+	if (dq == 0 && src_start % 8 == 0 && len % 8 == 0) {
+		memmove(dst, src + src_start / 8, len / 8);
 		return _dst;
 	}
 
-	/* fallback to slow bit copy */
-	for (i = 0; i < len; i++) {
-		if (((*src >> (sq&7)) & 1) == 1)
-			*dst |= 1 << (dq&7);
-		else
-			*dst &= ~(1 << (dq&7));
-		if (sq++ == 7) {
-			sq = 0;
-			src++;
-		}
-		if (dq++ == 7) {
-			dq = 0;
-			dst++;
-		}
+	/* fill up the first destination byte */
+	if (dq && len) {
+		unsigned n = MIN(8 - dq, len);
+
+		buf_put_bits(dst++, dq, n, buf_get_bits(src, src_start, n));
+		src_start += n;
+		len -= n;
+	}
+
+	/* the destination is now byte aligned; copy 64 bits at a time,
+	 * shifting the source into place. Copying upwards, this also
+	 * works for overlapping buffers when the destination comes first,
+	 * as in buffer_shr(). */
+	src += src_start / 8;
+	sq = src_start % 8;
+
+	for (; len >= 64; len -= 64) {
+		uint64_t w = le_to_h_u64(src) >> sq;
+		if (sq)
+			w |= (uint64_t)src[8] << (64 - sq);
+		h_u64_to_le(dst, w);
+		src += 8;
+		dst += 8;
 	}
 
+	for (; len >= 8; len -= 8)
+		*dst++ = buf_get_bits(src++, sq, 8);
+
+	if (len)
+		buf_put_bits(dst, 0, len, buf_get_bits(src, sq, len));
+
 	return _dst;
 }
 
@@ -389,27 +445,27 @@ void bit_copy_discard(struct bit_copy_queue *q)
 size_t unhexify(uint8_t *bin, const char *hex, size_t count)
 {
 	size_t i;
-	char tmp;
 
 	if (!bin || !hex)
 		return 0;
 
-	memset(bin, 0, count);
+	for (i = 0; i < count; i++) {
+		uint8_t hi = hex_values[(uint8_t)hex[2 * i]];
+		uint8_t lo = hi ? hex_values[(uint8_t)hex[2 * i + 1]] : 0;
 
-	for (i = 0; i < 2 * count; i++) {
-		if (hex[i] >= 'a' && hex[i] <= 'f')
-			tmp = hex[i] - 'a' + 10;
-		else if (hex[i] >= 'A' && hex[i] <= 'F')
-			tmp = hex[i] - 'A' + 10;
-		else if (hex[i] >= '0' && hex[i] <= '9')
-			tmp = hex[i] - '0';
-		else
-			return i / 2;
+		if (!lo) {
+			/* keep the digit converted before the bad one and clear
+			 * the rest of the buffer */
+			memset(bin + i, 0, count - i);
+			if (hi)
+				bin[i] = (hi - 1) << 4;
+			break;
+		}
 
-		bin[i / 2] |= tmp << (4 * ((i + 1) % 2));
+		bin[i] = ((hi - 1) << 4) | (lo - 1);
 	}
 
-	return i / 2;
+	return i;
 }
 
 /**
@@ -426,39 +482,43 @@ size_t unhexify(uint8_t *bin, const char *hex, size_t count)
  */
 size_t hexify(char *hex, const uint8_t *bin, size_t count, size_t length)
 {
-	size_t i;
-	uint8_t tmp;
+	size_t i, n;
 
 	if (!length)
 		return 0;
 
-	for (i = 0; i < length - 1 && i < 2 * count; i++) {
-		tmp = (bin[i / 2] >> (4 * ((i + 1) % 2))) & 0x0f;
-		hex[i] = hex_digits[tmp];
-	}
+	/* whole bytes that fit */
+	n = MIN(count, (length - 1) / 2);
+	for (i = 0; i < n; i++)
+		memcpy(hex + 2 * i, hex_pairs + 2 * bin[i], 2);
+	n *= 2;
 
-	hex[i] = 0;
+	/* a last high digit, if only one more character fits */
+	if (n < length - 1 && n < 2 * count)
+		hex[n++] = hex_digits[bin[i] >> 4];
 
-	return i;
+	hex[n] = 0;
+
+	return n;
 }
 
 void buffer_shr(void *_buf, unsigned buf_len, unsigned count)
 {
-	unsigned i;
-	unsigned char *buf = _buf;
-	unsigned bytes_to_remove;
-	unsigned shift;
-
-	bytes_to_remove = count / 8;
-	shift = count - (bytes_to_remove * 8);
+	uint8_t *buf = _buf;
+	unsigned bits = buf_len * 8;
 
-	for (i = 0; i < (buf_len - 1); i++)
-		buf[i] = (buf[i] >> shift) | ((buf[i+1] << (8 - shift)) & 0xff);
+	if (count >= bits) {
+		memset(buf, 0, buf_len);
+		return;
+	}
 
-	buf[(buf_len - 1)] = buf[(buf_len - 1)] >> shift;
+	buf_set_buf(buf, count, buf, 0, bits - count);
 
-	if (bytes_to_remove) {
-		memmove(buf, &buf[bytes_to_remove], buf_len - bytes_to_remove);
-		memset(&buf[buf_len - bytes_to_remove], 0, bytes_to_remove);
+	/* shift in zeros */
+	unsigned first = bits - count;
+	if (first % 8) {
+		buf[first / 8] &= (1u << (first % 8)) - 1;
+		first += 8 - first % 8;
 	}
+	memset(buf + first / 8, 0, buf_len - first / 8);
 }
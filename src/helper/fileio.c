@@ -30,12 +30,18 @@
 #include "configuration.h"
 #include "fileio.h"
 
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
 struct fileio {
 	char *url;
 	size_t size;
 	enum fileio_type type;
 	enum fileio_access access;
 	FILE *file;
+	/* private mapping of the whole file, see fileio_map() */
+	uint8_t *map;
 };
 
 static inline int fileio_close_local(struct fileio *fileio)
@@ -127,6 +133,7 @@ int fileio_open(struct fileio **fileio, const char *url,
 	tmp->type = type;
 	tmp->access = access_type;
 	tmp->url = strdup(url);
+	tmp->map = NULL;
 
 	retval = fileio_open_local(tmp);
 
@@ -145,6 +152,11 @@ int fileio_close(struct fileio *fileio)
 {
 	int retval;
 
+#ifdef HAVE_SYS_MMAN_H
+	if (fileio->map)
+		munmap(fileio->map, fileio->size);
+#endif
+
 	retval = fileio_close_local(fileio);
 
 	free(fileio->url);
@@ -205,6 +217,43 @@ int fileio_read_u32(struct fileio *fileio, uint32_t *data)
 	return retval;
 }
 
+/**
+ * Map the whole content of a file opened for reading into memory, so
+ * that large images can be accessed without copying them to the heap.
+ * The mapping stays valid until the file is closed.
+ *
+ * The mapping is private: the file is never modified through it.
+ *
+ * @returns ERROR_OK on success, ERROR_FILEIO_OPERATION_NOT_SUPPORTED if
+ * the host or the file (empty, not a regular file...) can't be mapped;
+ * the caller should then use fileio_read().
+ */
+int fileio_map(struct fileio *fileio, const uint8_t **data)
+{
+	if (fileio->map) {
+		*data = fileio->map;
+		return ERROR_OK;
+	}
+
+#ifdef HAVE_SYS_MMAN_H
+	if (fileio->access != FILEIO_READ || fileio->size == 0)
+		return ERROR_FILEIO_OPERATION_NOT_SUPPORTED;
+
+	void *map = mmap(NULL, fileio->size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+			fileno(fileio->file), 0);
+	if (map == MAP_FAILED) {
+		LOG_DEBUG("couldn't map %s: %s", fileio->url, strerror(errno));
+		return ERROR_FILEIO_OPERATION_NOT_SUPPORTED;
+	}
+
+	fileio->map = map;
+	*data = fileio->map;
+	return ERROR_OK;
+#else
+	return ERROR_FILEIO_OPERATION_NOT_SUPPORTED;
+#endif
+}
+
 static int fileio_local_fgets(struct fileio *fileio, size_t size, void *buffer)
 {
 	if (fgets(buffer, size, fileio->file) == NULL)
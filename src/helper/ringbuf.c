@@ -0,0 +1,103 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "ringbuf.h"
+#include "log.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+int ringbuf_init(struct ringbuf *ring, size_t size)
+{
+	size_t capacity = 1;
+
+	while (capacity < size)
+		capacity <<= 1;
+
+	ring->data = malloc(capacity);
+	if (ring->data == NULL) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	ring->size = capacity;
+	ring->head = 0;
+	ring->tail = 0;
+
+	return ERROR_OK;
+}
+
+void ringbuf_cleanup(struct ringbuf *ring)
+{
+	free(ring->data);
+	ring->data = NULL;
+	ring->size = 0;
+	ring->head = 0;
+	ring->tail = 0;
+}
+
+uint8_t *ringbuf_write_ptr(struct ringbuf *ring, size_t *len)
+{
+	size_t offset = ring->head & (ring->size - 1);
+	size_t space = ringbuf_space(ring);
+
+	/* up to the end of the storage */
+	*len = space < ring->size - offset ? space : ring->size - offset;
+	return ring->data + offset;
+}
+
+void ringbuf_commit(struct ringbuf *ring, size_t len)
+{
+	ring->head += len;
+}
+
+const uint8_t *ringbuf_read_ptr(struct ringbuf *ring, size_t *len)
+{
+	size_t offset = ring->tail & (ring->size - 1);
+	size_t used = ringbuf_used(ring);
+
+	*len = used < ring->size - offset ? used : ring->size - offset;
+	return ring->data + offset;
+}
+
+void ringbuf_consume(struct ringbuf *ring, size_t len)
+{
+	ring->tail += len;
+}
+
+size_t ringbuf_write(struct ringbuf *ring, const uint8_t *buf, size_t len)
+{
+	size_t done = 0;
+
+	while (done < len) {
+		size_t n;
+		uint8_t *dst = ringbuf_write_ptr(ring, &n);
+
+		if (n == 0)
+			break;
+		if (n > len - done)
+			n = len - done;
+
+		memcpy(dst, buf + done, n);
+		ringbuf_commit(ring, n);
+		done += n;
+	}
+
+	return done;
+}
@@ -0,0 +1,72 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifndef OPENOCD_HELPER_RINGBUF_H
+#define OPENOCD_HELPER_RINGBUF_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Byte ring buffer with a single producer and a single consumer.
+ *
+ * The producer only moves @a head and the consumer only moves @a tail,
+ * both as free running counters, so data can be handed over without
+ * copying: the producer fills the space returned by ringbuf_write_ptr()
+ * and commits it, the consumer processes the data returned by
+ * ringbuf_read_ptr() and consumes it.
+ */
+struct ringbuf {
+	uint8_t *data;
+	/** capacity, a power of two */
+	size_t size;
+	/** total number of bytes committed */
+	size_t head;
+	/** total number of bytes consumed */
+	size_t tail;
+};
+
+/** Allocates a ring of at least @a size bytes. */
+int ringbuf_init(struct ringbuf *ring, size_t size);
+void ringbuf_cleanup(struct ringbuf *ring);
+
+static inline size_t ringbuf_used(const struct ringbuf *ring)
+{
+	return ring->head - ring->tail;
+}
+
+static inline size_t ringbuf_space(const struct ringbuf *ring)
+{
+	return ring->size - ringbuf_used(ring);
+}
+
+/**
+ * @returns the start of the contiguous free space, its length in @a len;
+ * a full ring returns a length of 0.
+ */
+uint8_t *ringbuf_write_ptr(struct ringbuf *ring, size_t *len);
+void ringbuf_commit(struct ringbuf *ring, size_t len);
+
+/**
+ * @returns the start of the oldest contiguous data, its length in @a len;
+ * an empty ring returns a length of 0.
+ */
+const uint8_t *ringbuf_read_ptr(struct ringbuf *ring, size_t *len);
+void ringbuf_consume(struct ringbuf *ring, size_t len);
+
+/** Copies as much of @a buf as fits, @returns the number of bytes copied. */
+size_t ringbuf_write(struct ringbuf *ring, const uint8_t *buf, size_t len);
+
+#endif /* OPENOCD_HELPER_RINGBUF_H */
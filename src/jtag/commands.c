@@ -36,35 +36,66 @@
 struct cmd_queue_page {
 	struct cmd_queue_page *next;
 	void *address;
+	size_t size;
 	size_t used;
 };
 
 #define CMD_QUEUE_PAGE_SIZE (1024 * 1024)
-static struct cmd_queue_page *cmd_queue_pages;
-static struct cmd_queue_page *cmd_queue_pages_tail;
+/* pages kept by a queue for reuse after it has been reset */
+#define CMD_QUEUE_PAGES_KEPT 4
 
-struct jtag_command *jtag_command_queue;
-static struct jtag_command **next_command_pointer = &jtag_command_queue;
+static struct jtag_queue_stats jtag_queue_totals;
 
-void jtag_queue_command(struct jtag_command *cmd)
+static bool jtag_queue_optimizer;
+
+static struct jtag_queue jtag_default_queue = {
+	.next_command_pointer = &jtag_default_queue.head,
+};
+
+struct jtag_queue *jtag_active_queue = &jtag_default_queue;
+
+void jtag_queue_init(struct jtag_queue *queue)
+{
+	queue->head = NULL;
+	queue->next_command_pointer = &queue->head;
+	queue->pages = NULL;
+	queue->current_page = NULL;
+	queue->callback_head = NULL;
+	queue->callback_tail = NULL;
+	queue->num_commands = 0;
+	queue->num_callbacks = 0;
+	queue->num_allocs = 0;
+	queue->alloc_bytes = 0;
+}
+
+struct jtag_queue *jtag_queue_select(struct jtag_queue *queue)
+{
+	struct jtag_queue *previous = jtag_active_queue;
+
+	jtag_active_queue = queue ? queue : &jtag_default_queue;
+
+	return previous;
+}
+
+void jtag_queue_append(struct jtag_queue *queue, struct jtag_command *cmd)
 {
 	/* this command goes on the end, so ensure the queue terminates */
 	cmd->next = NULL;
 
-	struct jtag_command **last_cmd = next_command_pointer;
+	struct jtag_command **last_cmd = queue->next_command_pointer;
 	assert(NULL != last_cmd);
 	assert(NULL == *last_cmd);
 	*last_cmd = cmd;
 
 	/* store location where the next command pointer will be stored */
-	next_command_pointer = &cmd->next;
+	queue->next_command_pointer = &cmd->next;
+	queue->num_commands++;
 }
 
-void *cmd_queue_alloc(size_t size)
+void *jtag_queue_alloc(struct jtag_queue *queue, size_t size)
 {
-	struct cmd_queue_page **p_page = &cmd_queue_pages;
-	int offset;
-	uint8_t *t;
+	struct cmd_queue_page *page;
+	size_t offset;
 
 	/*
 	 * WARNING:
@@ -98,32 +129,43 @@ void *cmd_queue_alloc(size_t size)
 	size = (size + ALIGN_SIZE - 1) & (~(ALIGN_SIZE - 1));
 	/* Done... */
 
-	if (*p_page) {
-		p_page = &cmd_queue_pages_tail;
-		if (CMD_QUEUE_PAGE_SIZE - (*p_page)->used < size)
-			p_page = &((*p_page)->next);
-	}
+	/* pages following the current one are empty ones kept from a
+	 * previous use of the queue; only an oversized request skips any */
+	page = queue->current_page;
+	while (page && page->size - page->used < size)
+		page = page->next;
 
-	if (!*p_page) {
-		*p_page = malloc(sizeof(struct cmd_queue_page));
-		(*p_page)->used = 0;
-		size_t alloc_size = (size < CMD_QUEUE_PAGE_SIZE) ?
+	if (!page) {
+		page = malloc(sizeof(struct cmd_queue_page));
+		page->used = 0;
+		page->size = (size < CMD_QUEUE_PAGE_SIZE) ?
 					CMD_QUEUE_PAGE_SIZE : size;
-		(*p_page)->address = malloc(alloc_size);
-		(*p_page)->next = NULL;
-		cmd_queue_pages_tail = *p_page;
+		page->address = malloc(page->size);
+		page->next = NULL;
+		jtag_queue_totals.page_mallocs++;
+
+		struct cmd_queue_page **p_page = queue->current_page ?
+				&queue->current_page->next : &queue->pages;
+		while (*p_page)
+			p_page = &(*p_page)->next;
+		*p_page = page;
 	}
 
-	offset = (*p_page)->used;
-	(*p_page)->used += size;
+	queue->current_page = page;
+
+	offset = page->used;
+	page->used += size;
+
+	queue->num_allocs++;
+	queue->alloc_bytes += size;
 
-	t = (*p_page)->address;
-	return t + offset;
+	return (uint8_t *)page->address + offset;
 }
 
-static void cmd_queue_free(void)
+/* drop the pages from *p_page on */
+static void cmd_queue_free(struct cmd_queue_page **p_page)
 {
-	struct cmd_queue_page *page = cmd_queue_pages;
+	struct cmd_queue_page *page = *p_page;
 
 	while (page) {
 		struct cmd_queue_page *last = page;
@@ -132,16 +174,289 @@ static void cmd_queue_free(void)
 		free(last);
 	}
 
-	cmd_queue_pages = NULL;
-	cmd_queue_pages_tail = NULL;
+	*p_page = NULL;
 }
 
-void jtag_command_queue_reset(void)
+void jtag_queue_reset(struct jtag_queue *queue)
+{
+	if (queue->num_commands || queue->num_callbacks) {
+		struct jtag_queue_stats *totals = &jtag_queue_totals;
+
+		totals->flushes++;
+		totals->commands += queue->num_commands;
+		totals->callbacks += queue->num_callbacks;
+		totals->allocs += queue->num_allocs;
+		totals->alloc_bytes += queue->alloc_bytes;
+		totals->max_commands = MAX(totals->max_commands, queue->num_commands);
+		totals->max_alloc_bytes = MAX(totals->max_alloc_bytes, queue->alloc_bytes);
+	}
+
+	/* keep a few regular pages for the next commands rather than
+	 * handing them back to malloc after every flush */
+	struct cmd_queue_page **p_page = &queue->pages;
+	unsigned int kept = 0;
+
+	while (*p_page && kept < CMD_QUEUE_PAGES_KEPT) {
+		struct cmd_queue_page *page = *p_page;
+
+		if (page->size != CMD_QUEUE_PAGE_SIZE) {
+			*p_page = page->next;
+			free(page->address);
+			free(page);
+			continue;
+		}
+
+		page->used = 0;
+		p_page = &page->next;
+		kept++;
+	}
+	cmd_queue_free(p_page);
+
+	queue->current_page = queue->pages;
+	queue->head = NULL;
+	queue->next_command_pointer = &queue->head;
+	queue->callback_head = NULL;
+	queue->callback_tail = NULL;
+	queue->num_commands = 0;
+	queue->num_callbacks = 0;
+	queue->num_allocs = 0;
+	queue->alloc_bytes = 0;
+}
+
+void jtag_queue_release(struct jtag_queue *queue)
+{
+	cmd_queue_free(&queue->pages);
+	jtag_queue_init(queue);
+}
+
+void jtag_queue_get_stats(struct jtag_queue_stats *stats)
+{
+	*stats = jtag_queue_totals;
+}
+
+void jtag_queue_clear_stats(void)
+{
+	memset(&jtag_queue_totals, 0, sizeof(jtag_queue_totals));
+}
+
+void jtag_queue_set_optimize(bool enable)
+{
+	jtag_queue_optimizer = enable;
+}
+
+bool jtag_queue_get_optimize(void)
+{
+	return jtag_queue_optimizer;
+}
+
+/* TCK cycles spent on the payload of a command, not counting the state
+ * moves around it */
+static uint64_t jtag_command_bits(const struct jtag_command *cmd)
+{
+	switch (cmd->type) {
+	case JTAG_SCAN:
+		return jtag_scan_size(cmd->cmd.scan);
+	case JTAG_TLR_RESET:
+		return 5;
+	case JTAG_RUNTEST:
+		return cmd->cmd.runtest->num_cycles;
+	case JTAG_STABLECLOCKS:
+		return cmd->cmd.stableclocks->num_cycles;
+	case JTAG_PATHMOVE:
+		return cmd->cmd.pathmove->num_states;
+	case JTAG_TMS:
+		return cmd->cmd.tms->num_bits;
+	default:
+		return 0;
+	}
+}
+
+/* whether scanning @a cmd just shifts the instructions @a loaded left in
+ * the IR again, and nothing is captured from it */
+static bool jtag_scan_reloads_ir(const struct scan_command *loaded,
+		const struct scan_command *cmd)
+{
+	if (loaded->num_fields != cmd->num_fields)
+		return false;
+
+	for (int i = 0; i < cmd->num_fields; i++) {
+		const struct scan_field *a = &loaded->fields[i];
+		const struct scan_field *b = &cmd->fields[i];
+
+		if (b->in_value || a->num_bits != b->num_bits)
+			return false;
+		if (!a->out_value || !b->out_value)
+			return false;
+		if (buf_cmp(a->out_value, b->out_value, b->num_bits))
+			return false;
+	}
+
+	return true;
+}
+
+/* try to fold @a cmd into @a prev, the command before it */
+static bool jtag_command_merge(struct jtag_queue *queue, struct jtag_command *prev,
+		struct jtag_command *cmd)
+{
+	if (!prev || prev->type != cmd->type)
+		return false;
+
+	switch (cmd->type) {
+	case JTAG_RUNTEST: {
+		struct runtest_command *a = prev->cmd.runtest;
+		struct runtest_command *b = cmd->cmd.runtest;
+
+		/* the first one stays in Run-Test/Idle, where the second starts */
+		if (a->end_state != TAP_IDLE || a->num_cycles > INT_MAX - b->num_cycles)
+			return false;
+
+		a->num_cycles += b->num_cycles;
+		a->end_state = b->end_state;
+		return true;
+	}
+	case JTAG_STABLECLOCKS: {
+		struct stableclocks_command *a = prev->cmd.stableclocks;
+		struct stableclocks_command *b = cmd->cmd.stableclocks;
+
+		if (a->num_cycles > INT_MAX - b->num_cycles)
+			return false;
+
+		a->num_cycles += b->num_cycles;
+		return true;
+	}
+	case JTAG_PATHMOVE: {
+		struct pathmove_command *a = prev->cmd.pathmove;
+		struct pathmove_command *b = cmd->cmd.pathmove;
+		tap_state_t *path = jtag_queue_alloc(queue,
+				(a->num_states + b->num_states) * sizeof(*path));
+
+		memcpy(path, a->path, a->num_states * sizeof(*path));
+		memcpy(path + a->num_states, b->path, b->num_states * sizeof(*path));
+		a->path = path;
+		a->num_states += b->num_states;
+		return true;
+	}
+	case JTAG_TMS: {
+		struct tms_command *a = prev->cmd.tms;
+		struct tms_command *b = cmd->cmd.tms;
+		unsigned num_bits = a->num_bits + b->num_bits;
+		uint8_t *bits = jtag_queue_alloc(queue, DIV_ROUND_UP(num_bits, 8));
+
+		buf_set_buf(a->bits, 0, bits, 0, a->num_bits);
+		buf_set_buf(b->bits, 0, bits, a->num_bits, b->num_bits);
+		a->bits = bits;
+		a->num_bits = num_bits;
+		return true;
+	}
+	default:
+		return false;
+	}
+}
+
+/**
+ * Rewrite @a queue into an equivalent, shorter one before it is handed
+ * to the adapter driver: consecutive runtest, stableclocks, pathmove and
+ * TMS commands are merged, a TLR while in Test-Logic-Reset is dropped and
+ * so is an IR scan reloading the instructions already in the IR.
+ *
+ * The TAP state and the IR contents are only tracked from commands in
+ * the same queue, so nothing is assumed about the state the previous
+ * flush left the chain in.
+ */
+void jtag_queue_optimize(struct jtag_queue *queue)
 {
-	cmd_queue_free();
+	struct jtag_queue_stats *totals = &jtag_queue_totals;
+	struct jtag_command **link = &queue->head;
+	struct jtag_command *prev = NULL;
+	struct jtag_command *cmd;
+	/* last IR scan, while its instructions are known to be loaded */
+	const struct scan_command *loaded_ir = NULL;
+	tap_state_t state = TAP_INVALID;
+
+	if (!jtag_queue_optimizer || !queue->head)
+		return;
+
+	totals->optimized_flushes++;
+
+	while ((cmd = *link) != NULL) {
+		bool drop = false;
+
+		totals->optimizer_commands_in++;
+		totals->optimizer_bits_in += jtag_command_bits(cmd);
+
+		switch (cmd->type) {
+		case JTAG_SCAN:
+			if (cmd->cmd.scan->ir_scan) {
+				if (loaded_ir && state == cmd->cmd.scan->end_state
+						&& jtag_scan_reloads_ir(loaded_ir, cmd->cmd.scan)) {
+					totals->ir_scans_elided++;
+					drop = true;
+				} else {
+					loaded_ir = cmd->cmd.scan;
+				}
+			}
+			state = cmd->cmd.scan->end_state;
+			break;
+		case JTAG_TLR_RESET:
+			drop = (state == TAP_RESET);
+			state = TAP_RESET;
+			loaded_ir = NULL;
+			break;
+		case JTAG_RUNTEST:
+			drop = jtag_command_merge(queue, prev, cmd);
+			state = cmd->cmd.runtest->end_state;
+			break;
+		case JTAG_STABLECLOCKS:
+			drop = jtag_command_merge(queue, prev, cmd);
+			break;
+		case JTAG_PATHMOVE:
+			drop = jtag_command_merge(queue, prev, cmd);
+			if (cmd->cmd.pathmove->num_states)
+				state = cmd->cmd.pathmove->path[cmd->cmd.pathmove->num_states - 1];
+			loaded_ir = NULL;
+			break;
+		case JTAG_SLEEP:
+			break;
+		default:
+			/* resets and raw TMS sequences leave us guessing */
+			if (cmd->type == JTAG_TMS)
+				drop = jtag_command_merge(queue, prev, cmd);
+			state = TAP_INVALID;
+			loaded_ir = NULL;
+			break;
+		}
+
+		if (drop) {
+			*link = cmd->next;
+			queue->num_commands--;
+			continue;
+		}
+
+		prev = cmd;
+		link = &cmd->next;
+	}
 
-	jtag_command_queue = NULL;
-	next_command_pointer = &jtag_command_queue;
+	queue->next_command_pointer = link;
+
+	for (cmd = queue->head; cmd; cmd = cmd->next) {
+		totals->optimizer_commands_out++;
+		totals->optimizer_bits_out += jtag_command_bits(cmd);
+	}
+}
+
+void jtag_queue_command(struct jtag_command *cmd)
+{
+	jtag_queue_append(jtag_active_queue, cmd);
+}
+
+void *cmd_queue_alloc(size_t size)
+{
+	return jtag_queue_alloc(jtag_active_queue, size);
+}
+
+void jtag_command_queue_reset(void)
+{
+	jtag_queue_reset(jtag_active_queue);
 }
 
 /**
@@ -240,7 +555,12 @@ int jtag_read_buffer(uint8_t *buffer, const struct scan_command *cmd)
 		if (cmd->fields[i].in_value) {
 			int num_bits = cmd->fields[i].num_bits;
 			uint8_t *captured = buf_set_buf(buffer, bit_count,
-					malloc(DIV_ROUND_UP(num_bits, 8)), 0, num_bits);
+					cmd->fields[i].in_value, 0, num_bits);
+
+			/* mask out bits that don't belong to the field, as
+			 * buf_cpy() would */
+			if (num_bits % 8)
+				captured[num_bits / 8] &= (1 << (num_bits % 8)) - 1;
 
 			if (LOG_LEVEL_IS(LOG_LVL_DEBUG_IO)) {
 				char *char_buf = buf_to_str(captured,
@@ -252,11 +572,6 @@ int jtag_read_buffer(uint8_t *buffer, const struct scan_command *cmd)
 						i, num_bits, char_buf);
 				free(char_buf);
 			}
-
-			if (cmd->fields[i].in_value)
-				buf_cpy(captured, cmd->fields[i].in_value, num_bits);
-
-			free(captured);
 		}
 		bit_count += cmd->fields[i].num_bits;
 	}
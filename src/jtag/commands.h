@@ -160,8 +160,90 @@ struct jtag_command {
 	struct jtag_command *next;
 };
 
+struct cmd_queue_page;
+struct jtag_callback_entry;
+
+/**
+ * A queue of jtag_command_s structures, together with the memory the
+ * commands and their data are allocated from.
+ *
+ * The memory pages of a queue are recycled when the queue is reset, so
+ * a queue which is filled and executed over and over again doesn't go
+ * back to malloc. Several queues can be in use at the same time, e.g.
+ * one being built while another one is being executed.
+ */
+struct jtag_queue {
+	/** first command, NULL when the queue is empty */
+	struct jtag_command *head;
+	/** where the next command will be linked */
+	struct jtag_command **next_command_pointer;
+	/** memory pages, in allocation order */
+	struct cmd_queue_page *pages;
+	/** page allocations are made from */
+	struct cmd_queue_page *current_page;
+	/** callbacks to run once the commands have been executed */
+	struct jtag_callback_entry *callback_head;
+	struct jtag_callback_entry *callback_tail;
+	/** usage since the last reset */
+	unsigned int num_commands;
+	unsigned int num_callbacks;
+	unsigned int num_allocs;
+	size_t alloc_bytes;
+};
+
+/** Queue usage, summed over the flushes of all queues. */
+struct jtag_queue_stats {
+	/** resets of a queue which had been used */
+	uint64_t flushes;
+	uint64_t commands;
+	uint64_t callbacks;
+	/** allocations from the queue memory, and their size */
+	uint64_t allocs;
+	uint64_t alloc_bytes;
+	/** queue memory pages obtained from malloc */
+	uint64_t page_mallocs;
+	/** largest flush */
+	unsigned int max_commands;
+	size_t max_alloc_bytes;
+	/** flushes rewritten by jtag_queue_optimize() */
+	uint64_t optimized_flushes;
+	/** commands and TCK cycles of payload before and after */
+	uint64_t optimizer_commands_in;
+	uint64_t optimizer_commands_out;
+	uint64_t optimizer_bits_in;
+	uint64_t optimizer_bits_out;
+	uint64_t ir_scans_elided;
+};
+
+void jtag_queue_init(struct jtag_queue *queue);
+void jtag_queue_append(struct jtag_queue *queue, struct jtag_command *cmd);
+void *jtag_queue_alloc(struct jtag_queue *queue, size_t size);
+/** Empties @a queue, keeping some of its memory for reuse. */
+void jtag_queue_reset(struct jtag_queue *queue);
+/** Empties @a queue and frees all of its memory. */
+void jtag_queue_release(struct jtag_queue *queue);
+
+/**
+ * The queue the jtag_add_xxx() functions append to and the adapter
+ * driver executes.
+ */
+extern struct jtag_queue *jtag_active_queue;
+
+/**
+ * Makes @a queue the active queue, or the built-in queue if NULL.
+ * @returns the previously active queue
+ */
+struct jtag_queue *jtag_queue_select(struct jtag_queue *queue);
+
+void jtag_queue_get_stats(struct jtag_queue_stats *stats);
+void jtag_queue_clear_stats(void);
+
+void jtag_queue_set_optimize(bool enable);
+bool jtag_queue_get_optimize(void);
+void jtag_queue_optimize(struct jtag_queue *queue);
+
 /** The current queue of jtag_command_s structures. */
-extern struct jtag_command *jtag_command_queue;
+#define jtag_command_queue (jtag_active_queue->head)
 
 void *cmd_queue_alloc(size_t size);
 
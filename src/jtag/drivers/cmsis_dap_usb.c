@@ -181,6 +181,10 @@ struct pending_transfer_result {
 struct pending_request_block {
 	struct pending_transfer_result *transfers;
 	int transfer_count;
+	/** All transfers access the same AP register in the same direction */
+	bool uniform;
+	/** Sent as DAP_TransferBlock instead of DAP_Transfer */
+	bool transfer_block;
 };
 
 struct pending_scan_result {
@@ -194,13 +198,16 @@ struct pending_scan_result {
 	unsigned buffer_offset;
 };
 
-/* Up to MIN(packet_count, MAX_PENDING_REQUESTS) requests may be issued
+/* Up to MIN(packet_count, max_pending_requests) requests may be issued
  * until the first response arrives */
-#define MAX_PENDING_REQUESTS 3
+#define MAX_PENDING_REQUESTS 8
+static int max_pending_requests = 3;
 
 /* Pending requests are organized as a FIFO - circular buffer */
-/* Each block in FIFO can contain up to pending_queue_len transfers */
+/* Each block in FIFO can contain up to pending_queue_len transfers, or
+ * pending_block_len if they can be sent with DAP_TransferBlock */
 static int pending_queue_len;
+static int pending_block_len;
 static struct pending_request_block pending_fifo[MAX_PENDING_REQUESTS];
 static int pending_fifo_put_idx, pending_fifo_get_idx;
 static int pending_fifo_block_count;
@@ -219,6 +226,18 @@ static uint8_t queued_seq_buf[1024]; /* TODO: make dynamic / move into cmsis obj
 
 static int queued_retval;
 
+/* SWD queue statistics, see "cmsis-dap stats" */
+static struct {
+	uint64_t flushes;
+	uint64_t packets;
+	uint64_t block_packets;
+	uint64_t transfers;
+	int max_in_flight;
+	/* since the start of the current flush */
+	unsigned int flush_packets;
+	unsigned int flush_transfers;
+} cmsis_dap_stats;
+
 static uint8_t output_pins = SWJ_PIN_SRST | SWJ_PIN_TRST;
 
 static struct cmsis_dap *cmsis_dap_handle;
@@ -646,6 +665,31 @@ static void cmsis_dap_swd_write_from_queue(struct cmsis_dap *dap)
 
 	size_t idx = 0;
 	buffer[idx++] = 0;	/* report number */
+
+	/* A run of accesses to one AP register, e.g. MEM-AP DRW with address
+	 * auto-increment, needs a single request byte */
+	block->transfer_block = block->uniform && block->transfer_count > 1;
+	if (block->transfer_block) {
+		uint8_t cmd = block->transfers[0].cmd;
+
+		buffer[idx++] = CMD_DAP_TFER_BLOCK;
+		buffer[idx++] = 0x00;	/* DAP Index */
+		buffer[idx++] = block->transfer_count & 0xff;
+		buffer[idx++] = (block->transfer_count >> 8) & 0xff;
+		buffer[idx++] = (cmd >> 1) & 0x0f;
+
+		LOG_DEBUG_IO("AP %s reg %x block of %d", cmd & SWD_CMD_RnW ? "read" : "write",
+				(cmd & SWD_CMD_A32) >> 1, block->transfer_count);
+
+		if (!(cmd & SWD_CMD_RnW)) {
+			for (int i = 0; i < block->transfer_count; i++) {
+				h_u32_to_le(&buffer[idx], block->transfers[i].data);
+				idx += 4;
+			}
+		}
+		goto write;
+	}
+
 	buffer[idx++] = CMD_DAP_TFER;
 	buffer[idx++] = 0x00;	/* DAP Index */
 	buffer[idx++] = block->transfer_count;
@@ -688,6 +732,7 @@ static void cmsis_dap_swd_write_from_queue(struct cmsis_dap *dap)
 		}
 	}
 
+write:
 	queued_retval = cmsis_dap_usb_write(dap, idx);
 	if (queued_retval != ERROR_OK)
 		goto skip;
@@ -697,6 +742,15 @@ static void cmsis_dap_swd_write_from_queue(struct cmsis_dap *dap)
 	if (pending_fifo_block_count > dap->packet_count)
 		LOG_ERROR("too much pending writes %d", pending_fifo_block_count);
 
+	cmsis_dap_stats.packets++;
+	if (block->transfer_block)
+		cmsis_dap_stats.block_packets++;
+	cmsis_dap_stats.transfers += block->transfer_count;
+	cmsis_dap_stats.flush_packets++;
+	cmsis_dap_stats.flush_transfers += block->transfer_count;
+	if (pending_fifo_block_count > cmsis_dap_stats.max_in_flight)
+		cmsis_dap_stats.max_in_flight = pending_fifo_block_count;
+
 	return;
 
 skip:
@@ -722,26 +776,39 @@ static void cmsis_dap_swd_read_process(struct cmsis_dap *dap, int timeout_ms)
 		goto skip;
 	}
 
-	if (buffer[2] & 0x08) {
-		LOG_DEBUG("CMSIS-DAP Protocol Error @ %d (wrong parity)", buffer[1]);
+	/* DAP_TransferBlock replies with a 16 bit transfer count */
+	int transfer_count;
+	uint8_t response;
+	size_t idx;
+	if (block->transfer_block) {
+		transfer_count = le_to_h_u16(&buffer[1]);
+		response = buffer[3];
+		idx = 4;
+	} else {
+		transfer_count = buffer[1];
+		response = buffer[2];
+		idx = 3;
+	}
+
+	if (response & 0x08) {
+		LOG_DEBUG("CMSIS-DAP Protocol Error @ %d (wrong parity)", transfer_count);
 		queued_retval = ERROR_FAIL;
 		goto skip;
 	}
-	uint8_t ack = buffer[2] & 0x07;
+	uint8_t ack = response & 0x07;
 	if (ack != SWD_ACK_OK) {
-		LOG_DEBUG("SWD ack not OK @ %d %s", buffer[1],
+		LOG_DEBUG("SWD ack not OK @ %d %s", transfer_count,
 			  ack == SWD_ACK_WAIT ? "WAIT" : ack == SWD_ACK_FAULT ? "FAULT" : "JUNK");
 		queued_retval = ack == SWD_ACK_WAIT ? ERROR_WAIT : ERROR_FAIL;
 		goto skip;
 	}
 
-	if (block->transfer_count != buffer[1])
+	if (block->transfer_count != transfer_count)
 		LOG_ERROR("CMSIS-DAP transfer count mismatch: expected %d, got %d",
-			  block->transfer_count, buffer[1]);
+			  block->transfer_count, transfer_count);
 
-	LOG_DEBUG_IO("Received results of %d queued transactions FIFO index %d", buffer[1], pending_fifo_get_idx);
-	size_t idx = 3;
-	for (int i = 0; i < buffer[1]; i++) {
+	LOG_DEBUG_IO("Received results of %d queued transactions FIFO index %d", transfer_count, pending_fifo_get_idx);
+	for (int i = 0; i < transfer_count; i++) {
 		struct pending_transfer_result *transfer = &(block->transfers[i]);
 		if (transfer->cmd & SWD_CMD_RnW) {
 			static uint32_t last_read;
@@ -782,15 +849,33 @@ static int cmsis_dap_swd_run_queue(void)
 	pending_fifo_put_idx = 0;
 	pending_fifo_get_idx = 0;
 
+	LOG_DEBUG_IO("Flushed %u transfers in %u packets", cmsis_dap_stats.flush_transfers,
+			cmsis_dap_stats.flush_packets);
+	cmsis_dap_stats.flushes++;
+	cmsis_dap_stats.flush_packets = 0;
+	cmsis_dap_stats.flush_transfers = 0;
+
 	int retval = queued_retval;
 	queued_retval = ERROR_OK;
 
 	return retval;
 }
 
+/* Would queueing cmd overflow the request block being filled? */
+static bool cmsis_dap_swd_block_full(struct pending_request_block *block, uint8_t cmd)
+{
+	if (block->transfer_count == 0)
+		return false;
+
+	if (block->uniform && cmd == block->transfers[0].cmd)
+		return block->transfer_count >= pending_block_len;
+
+	return block->transfer_count >= pending_queue_len;
+}
+
 static void cmsis_dap_swd_queue_cmd(uint8_t cmd, uint32_t *dst, uint32_t data)
 {
-	if (pending_fifo[pending_fifo_put_idx].transfer_count == pending_queue_len) {
+	if (cmsis_dap_swd_block_full(&pending_fifo[pending_fifo_put_idx], cmd)) {
 		if (pending_fifo_block_count)
 			cmsis_dap_swd_read_process(cmsis_dap_handle, 0);
 
@@ -805,6 +890,11 @@ static void cmsis_dap_swd_queue_cmd(uint8_t cmd, uint32_t *dst, uint32_t data)
 		return;
 
 	struct pending_request_block *block = &pending_fifo[pending_fifo_put_idx];
+	if (block->transfer_count == 0)
+		block->uniform = cmd & SWD_CMD_APnDP;
+	else if (cmd != block->transfers[0].cmd)
+		block->uniform = false;
+
 	struct pending_transfer_result *transfer = &(block->transfers[block->transfer_count]);
 	transfer->data = data;
 	transfer->cmd = cmd;
@@ -1011,6 +1101,7 @@ static int cmsis_dap_init(void)
 	 * until we get packet count info from the adaptor */
 	cmsis_dap_handle->packet_count = 1;
 	pending_queue_len = 12;
+	pending_block_len = 14;
 
 	/* INFO_ID_PKT_SZ - short */
 	retval = cmsis_dap_cmd_DAP_Info(INFO_ID_PKT_SZ, &data);
@@ -1025,6 +1116,10 @@ static int cmsis_dap_init(void)
 		 * needed per transfer, so this is suboptimal. */
 		pending_queue_len = (pkt_sz - 4) / 5;
 
+		/* DAP_TransferBlock: 5 bytes of command header + 4 bytes
+		 * per register write, 4 bytes per read in the response. */
+		pending_block_len = (pkt_sz - 5) / 4;
+
 		if (cmsis_dap_handle->packet_size != pkt_sz + 1) {
 			/* reallocate buffer */
 			cmsis_dap_handle->packet_size = pkt_sz + 1;
@@ -1047,14 +1142,15 @@ static int cmsis_dap_init(void)
 	if (data[0] == 1) { /* byte */
 		int pkt_cnt = data[1];
 		if (pkt_cnt > 1)
-			cmsis_dap_handle->packet_count = MIN(MAX_PENDING_REQUESTS, pkt_cnt);
+			cmsis_dap_handle->packet_count = MIN(max_pending_requests, pkt_cnt);
 
 		LOG_DEBUG("CMSIS-DAP: Packet Count = %d", pkt_cnt);
 	}
 
 	LOG_DEBUG("Allocating FIFO for %d pending HID requests", cmsis_dap_handle->packet_count);
 	for (int i = 0; i < cmsis_dap_handle->packet_count; i++) {
-		pending_fifo[i].transfers = malloc(pending_queue_len * sizeof(struct pending_transfer_result));
+		pending_fifo[i].transfers = malloc(MAX(pending_queue_len, pending_block_len)
+				* sizeof(struct pending_transfer_result));
 		if (!pending_fifo[i].transfers) {
 			LOG_ERROR("Unable to allocate memory for CMSIS-DAP queue");
 			return ERROR_FAIL;
@@ -1685,6 +1781,50 @@ COMMAND_HANDLER(cmsis_dap_handle_cmd_command)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(cmsis_dap_handle_stats_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		if (strcmp(CMD_ARGV[0], "reset") != 0)
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		memset(&cmsis_dap_stats, 0, sizeof(cmsis_dap_stats));
+		return ERROR_OK;
+	}
+
+	uint64_t flushes = cmsis_dap_stats.flushes;
+	uint64_t packets = cmsis_dap_stats.packets;
+
+	command_print(CMD, "%" PRIu64 " flushes, %" PRIu64 " packets (%" PRIu64 " DAP_TransferBlock), "
+			"%" PRIu64 " transfers",
+			flushes, packets, cmsis_dap_stats.block_packets, cmsis_dap_stats.transfers);
+	command_print(CMD, "%.1f packets per flush, %.1f transfers per packet, "
+			"up to %d of %d packets in flight",
+			flushes ? (double)packets / flushes : 0.0,
+			packets ? (double)cmsis_dap_stats.transfers / packets : 0.0,
+			cmsis_dap_stats.max_in_flight,
+			cmsis_dap_handle ? cmsis_dap_handle->packet_count : 0);
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(cmsis_dap_handle_max_pending_command)
+{
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	int count;
+	COMMAND_PARSE_NUMBER(int, CMD_ARGV[0], count);
+	if (count < 1 || count > MAX_PENDING_REQUESTS) {
+		LOG_ERROR("packet count must be between 1 and %d", MAX_PENDING_REQUESTS);
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+
+	max_pending_requests = count;
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(cmsis_dap_handle_vid_pid_command)
 {
 	if (CMD_ARGC > MAX_USB_IDS * 2) {
@@ -1751,6 +1891,13 @@ static const struct command_registration cmsis_dap_subcommand_handlers[] = {
 		.usage = "",
 		.help = "issue cmsis-dap command",
 	},
+	{
+		.name = "stats",
+		.handler = &cmsis_dap_handle_stats_command,
+		.mode = COMMAND_EXEC,
+		.usage = "['reset']",
+		.help = "show or reset SWD transfer queue statistics",
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
@@ -1776,6 +1923,13 @@ static const struct command_registration cmsis_dap_command_handlers[] = {
 		.help = "set the serial number of the adapter",
 		.usage = "serial_string",
 	},
+	{
+		.name = "cmsis_dap_max_pending",
+		.handler = &cmsis_dap_handle_max_pending_command,
+		.mode = COMMAND_CONFIG,
+		.help = "set the maximum number of SWD transfer packets in flight",
+		.usage = "count",
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
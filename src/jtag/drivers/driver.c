@@ -46,15 +46,6 @@ struct jtag_callback_entry {
 	jtag_callback_data_t data3;
 };
 
-static struct jtag_callback_entry *jtag_callback_queue_head;
-static struct jtag_callback_entry *jtag_callback_queue_tail;
-
-static void jtag_callback_queue_reset(void)
-{
-	jtag_callback_queue_head = NULL;
-	jtag_callback_queue_tail = NULL;
-}
-
 /**
  * see jtag_add_ir_scan()
  *
@@ -341,7 +332,10 @@ void interface_jtag_add_callback4(jtag_callback_t callback,
 		jtag_callback_data_t data0, jtag_callback_data_t data1,
 		jtag_callback_data_t data2, jtag_callback_data_t data3)
 {
-	struct jtag_callback_entry *entry = cmd_queue_alloc(sizeof(struct jtag_callback_entry));
+	/* callbacks live in the queue memory too and go away with the
+	 * commands when the queue is reset */
+	struct jtag_queue *queue = jtag_active_queue;
+	struct jtag_callback_entry *entry = jtag_queue_alloc(queue, sizeof(struct jtag_callback_entry));
 
 	entry->next = NULL;
 	entry->callback = callback;
@@ -350,13 +344,14 @@ void interface_jtag_add_callback4(jtag_callback_t callback,
 	entry->data2 = data2;
 	entry->data3 = data3;
 
-	if (jtag_callback_queue_head == NULL) {
-		jtag_callback_queue_head = entry;
-		jtag_callback_queue_tail = entry;
+	if (queue->callback_head == NULL) {
+		queue->callback_head = entry;
+		queue->callback_tail = entry;
 	} else {
-		jtag_callback_queue_tail->next = entry;
-		jtag_callback_queue_tail = entry;
+		queue->callback_tail->next = entry;
+		queue->callback_tail = entry;
 	}
+	queue->num_callbacks++;
 }
 
 int interface_jtag_execute_queue(void)
@@ -366,10 +361,12 @@ int interface_jtag_execute_queue(void)
 	assert(reentry == 0);
 	reentry++;
 
+	jtag_queue_optimize(jtag_active_queue);
+
 	int retval = default_interface_jtag_execute_queue();
 	if (retval == ERROR_OK) {
 		struct jtag_callback_entry *entry;
-		for (entry = jtag_callback_queue_head; entry != NULL; entry = entry->next) {
+		for (entry = jtag_active_queue->callback_head; entry != NULL; entry = entry->next) {
 			retval = entry->callback(entry->data0, entry->data1, entry->data2, entry->data3);
 			if (retval != ERROR_OK)
 				break;
@@ -377,7 +374,6 @@ int interface_jtag_execute_queue(void)
 	}
 
 	jtag_command_queue_reset();
-	jtag_callback_queue_reset();
 
 	reentry--;
 
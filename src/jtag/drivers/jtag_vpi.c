@@ -46,6 +46,27 @@
 #define CMD_SCAN_CHAIN		2
 #define CMD_SCAN_CHAIN_FLIP_TMS	3
 #define CMD_STOP_SIMU		4
+#define CMD_PROTOCOL		5
+/* protocol v2: the server answers this record with its TDO bits */
+#define CMD_CAPTURE_TDO		0x80
+
+/*
+ * Protocol v2
+ *
+ * Requested with a legacy CMD_PROTOCOL command whose nb_bits is 2; a v2
+ * server echoes it back unchanged, servers that do not know it stay silent.
+ * From then on OpenOCD sends messages made of a little endian 32-bit payload
+ * length and a payload of records, each one a command byte, a little endian
+ * 32-bit bit count and DIV_ROUND_UP(bit count, 8) bytes of TMS (CMD_TMS_SEQ)
+ * or TDI (CMD_SCAN_CHAIN*) data.  Records have the legacy meaning; the server
+ * reads a whole message, executes it, and then sends the TDO bytes of the
+ * records flagged with CMD_CAPTURE_TDO back to back, and nothing else.
+ */
+#define JTAG_VPI_PROTOCOL_V2	2
+/* how long "auto" waits for a v2 server to answer */
+#define JTAG_VPI_PROBE_MS	500
+#define JTAG_VPI_MSG_HEADER	4
+#define JTAG_VPI_RECORD_HEADER	5
 
 int server_port = SERVER_PORT;
 char *server_address;
@@ -61,6 +82,33 @@ struct vpi_cmd {
 	int nb_bits;
 };
 
+enum jtag_vpi_protocol {
+	JTAG_VPI_AUTO,
+	JTAG_VPI_LEGACY,
+	JTAG_VPI_V2,
+};
+
+static enum jtag_vpi_protocol jtag_vpi_protocol;
+static bool jtag_vpi_v2;
+
+/* scan whose buffer is handed back to the JTAG core once its message ran */
+struct jtag_vpi_pending_scan {
+	struct scan_command *cmd;
+	uint8_t *buf;
+	int nb_bytes;
+	bool capture;
+};
+
+/* protocol v2 message collecting the current command queue */
+static struct {
+	uint8_t *data;
+	size_t used;
+	size_t size;
+	struct jtag_vpi_pending_scan *scans;
+	unsigned int num_scans;
+	unsigned int max_scans;
+} jtag_vpi_msg;
+
 static int jtag_vpi_send_cmd(struct vpi_cmd *vpi)
 {
 	int retval = write_socket(sockfd, vpi, sizeof(struct vpi_cmd));
@@ -79,6 +127,150 @@ static int jtag_vpi_receive_cmd(struct vpi_cmd *vpi)
 	return ERROR_OK;
 }
 
+static int jtag_vpi_write_exact(const uint8_t *buf, size_t len)
+{
+	while (len > 0) {
+		int retval = write_socket(sockfd, buf, len);
+		if (retval <= 0) {
+			LOG_ERROR("jtag_vpi: write failed");
+			return ERROR_FAIL;
+		}
+		buf += retval;
+		len -= retval;
+	}
+
+	return ERROR_OK;
+}
+
+static int jtag_vpi_read_exact(uint8_t *buf, size_t len)
+{
+	while (len > 0) {
+		int retval = read_socket(sockfd, buf, len);
+		if (retval <= 0) {
+			LOG_ERROR("jtag_vpi: read failed");
+			return ERROR_FAIL;
+		}
+		buf += retval;
+		len -= retval;
+	}
+
+	return ERROR_OK;
+}
+
+/**
+ * jtag_vpi_msg_add - append a record to the protocol v2 message
+ * @cmd: CMD_xxx, possibly with CMD_CAPTURE_TDO
+ * @bits: TMS or TDI bits (or NULL if 1 are to be sent)
+ * @nb_bits: number of bits
+ */
+static int jtag_vpi_msg_add(int cmd, const uint8_t *bits, int nb_bits)
+{
+	int nb_bytes = DIV_ROUND_UP(nb_bits, 8);
+	size_t needed = jtag_vpi_msg.used + JTAG_VPI_RECORD_HEADER + nb_bytes;
+
+	if (needed > jtag_vpi_msg.size) {
+		size_t size = jtag_vpi_msg.size * 2;
+		while (size < needed)
+			size *= 2;
+		uint8_t *data = realloc(jtag_vpi_msg.data, size);
+		if (data == NULL) {
+			LOG_ERROR("Out of memory");
+			return ERROR_FAIL;
+		}
+		jtag_vpi_msg.data = data;
+		jtag_vpi_msg.size = size;
+	}
+
+	uint8_t *record = jtag_vpi_msg.data + jtag_vpi_msg.used;
+	record[0] = cmd;
+	h_u32_to_le(record + 1, nb_bits);
+	if (bits)
+		memcpy(record + JTAG_VPI_RECORD_HEADER, bits, nb_bytes);
+	else
+		memset(record + JTAG_VPI_RECORD_HEADER, 0xff, nb_bytes);
+
+	jtag_vpi_msg.used = needed;
+	return ERROR_OK;
+}
+
+/**
+ * jtag_vpi_msg_add_scan - append a scan to the protocol v2 message
+ * @cmd: the scan command
+ * @buf: scan buffer from jtag_build_buffer(), owned by the message from now on
+ * @nb_bits: number of bits
+ * @tap_shift: TAP_SHIFT to leave the shift state with the last bit
+ *
+ * TDO is only asked for when the scan has fields to read; the buffer goes
+ * back to the JTAG core in jtag_vpi_flush().
+ */
+static int jtag_vpi_msg_add_scan(struct scan_command *cmd, uint8_t *buf, int nb_bits, int tap_shift)
+{
+	bool capture = jtag_scan_type(cmd) != SCAN_OUT;
+	int vpi_cmd = tap_shift ? CMD_SCAN_CHAIN_FLIP_TMS : CMD_SCAN_CHAIN;
+
+	if (jtag_vpi_msg.num_scans == jtag_vpi_msg.max_scans) {
+		unsigned int max_scans = jtag_vpi_msg.max_scans ? jtag_vpi_msg.max_scans * 2 : 64;
+		struct jtag_vpi_pending_scan *scans = realloc(jtag_vpi_msg.scans,
+				max_scans * sizeof(*scans));
+		if (scans == NULL) {
+			LOG_ERROR("Out of memory");
+			free(buf);
+			return ERROR_FAIL;
+		}
+		jtag_vpi_msg.scans = scans;
+		jtag_vpi_msg.max_scans = max_scans;
+	}
+
+	struct jtag_vpi_pending_scan *scan = &jtag_vpi_msg.scans[jtag_vpi_msg.num_scans++];
+	scan->cmd = cmd;
+	scan->buf = buf;
+	scan->nb_bytes = DIV_ROUND_UP(nb_bits, 8);
+	scan->capture = capture;
+
+	return jtag_vpi_msg_add(vpi_cmd | (capture ? CMD_CAPTURE_TDO : 0), buf, nb_bits);
+}
+
+/**
+ * jtag_vpi_flush - send the protocol v2 message and collect its TDO bits
+ *
+ * Returns ERROR_OK at once with the legacy protocol, which does not batch.
+ */
+static int jtag_vpi_flush(void)
+{
+	if (!jtag_vpi_v2)
+		return ERROR_OK;
+
+	int io = ERROR_OK;
+	if (jtag_vpi_msg.used > JTAG_VPI_MSG_HEADER) {
+		h_u32_to_le(jtag_vpi_msg.data, jtag_vpi_msg.used - JTAG_VPI_MSG_HEADER);
+		io = jtag_vpi_write_exact(jtag_vpi_msg.data, jtag_vpi_msg.used);
+	}
+
+	int retval = io;
+	for (unsigned int i = 0; i < jtag_vpi_msg.num_scans; i++) {
+		struct jtag_vpi_pending_scan *scan = &jtag_vpi_msg.scans[i];
+
+		if (io == ERROR_OK && scan->capture) {
+			io = jtag_vpi_read_exact(scan->buf, scan->nb_bytes);
+			if (io != ERROR_OK)
+				retval = io;
+		}
+
+		/* keep reading the remaining replies after a check failure */
+		if (io == ERROR_OK) {
+			int check = jtag_read_buffer(scan->buf, scan->cmd);
+			if (retval == ERROR_OK)
+				retval = check;
+		}
+
+		free(scan->buf);
+	}
+
+	jtag_vpi_msg.used = JTAG_VPI_MSG_HEADER;
+	jtag_vpi_msg.num_scans = 0;
+	return retval;
+}
+
 /**
  * jtag_vpi_reset - ask to reset the JTAG device
  * @trst: 1 if TRST is to be asserted
@@ -88,6 +280,9 @@ static int jtag_vpi_reset(int trst, int srst)
 {
 	struct vpi_cmd vpi;
 
+	if (jtag_vpi_v2)
+		return jtag_vpi_msg_add(CMD_RESET, NULL, 0);
+
 	vpi.cmd = CMD_RESET;
 	vpi.length = 0;
 	return jtag_vpi_send_cmd(&vpi);
@@ -109,6 +304,9 @@ static int jtag_vpi_tms_seq(const uint8_t *bits, int nb_bits)
 	struct vpi_cmd vpi;
 	int nb_bytes;
 
+	if (jtag_vpi_v2)
+		return jtag_vpi_msg_add(CMD_TMS_SEQ, bits, nb_bits);
+
 	nb_bytes = DIV_ROUND_UP(nb_bits, 8);
 
 	vpi.cmd = CMD_TMS_SEQ;
@@ -210,6 +408,11 @@ static int jtag_vpi_queue_tdi(uint8_t *bits, int nb_bits, int tap_shift)
 	int nb_xfer = DIV_ROUND_UP(nb_bits, XFERT_MAX_SIZE * 8);
 	int retval;
 
+	/* no transfer size limit, and nothing to read back */
+	if (jtag_vpi_v2)
+		return jtag_vpi_msg_add(tap_shift ? CMD_SCAN_CHAIN_FLIP_TMS : CMD_SCAN_CHAIN,
+				bits, nb_bits);
+
 	while (nb_xfer) {
 		if (nb_xfer ==  1) {
 			retval = jtag_vpi_queue_tdi_xfer(bits, nb_bits, tap_shift);
@@ -257,6 +460,7 @@ static int jtag_vpi_scan(struct scan_command *cmd)
 	int scan_bits;
 	uint8_t *buf = NULL;
 	int retval = ERROR_OK;
+	int tap_shift;
 
 	scan_bits = jtag_build_buffer(cmd, &buf);
 
@@ -270,15 +474,15 @@ static int jtag_vpi_scan(struct scan_command *cmd)
 			return retval;
 	}
 
-	if (cmd->end_state == TAP_DRSHIFT) {
-		retval = jtag_vpi_queue_tdi(buf, scan_bits, NO_TAP_SHIFT);
-		if (retval != ERROR_OK)
-			return retval;
+	tap_shift = (cmd->end_state == TAP_DRSHIFT) ? NO_TAP_SHIFT : TAP_SHIFT;
+	if (jtag_vpi_v2) {
+		retval = jtag_vpi_msg_add_scan(cmd, buf, scan_bits, tap_shift);
+		buf = NULL;
 	} else {
-		retval = jtag_vpi_queue_tdi(buf, scan_bits, TAP_SHIFT);
-		if (retval != ERROR_OK)
-			return retval;
+		retval = jtag_vpi_queue_tdi(buf, scan_bits, tap_shift);
 	}
+	if (retval != ERROR_OK)
+		return retval;
 
 	if (cmd->end_state != TAP_DRSHIFT) {
 		/*
@@ -295,9 +499,11 @@ static int jtag_vpi_scan(struct scan_command *cmd)
 			tap_set_state(TAP_DRPAUSE);
 	}
 
-	retval = jtag_read_buffer(buf, cmd);
-	if (retval != ERROR_OK)
-		return retval;
+	if (!jtag_vpi_v2) {
+		retval = jtag_read_buffer(buf, cmd);
+		if (retval != ERROR_OK)
+			return retval;
+	}
 
 	if (buf)
 		free(buf);
@@ -379,6 +585,7 @@ static int jtag_vpi_execute_queue(void)
 			retval = jtag_vpi_tms(cmd->cmd.tms);
 			break;
 		case JTAG_SLEEP:
+			retval = jtag_vpi_flush();
 			jtag_sleep(cmd->cmd.sleep->us);
 			break;
 		case JTAG_SCAN:
@@ -387,9 +594,63 @@ static int jtag_vpi_execute_queue(void)
 		}
 	}
 
+	int flush = jtag_vpi_flush();
+	if (retval == ERROR_OK)
+		retval = flush;
+
 	return retval;
 }
 
+/* Ask the server for protocol v2; legacy servers ignore the request. */
+static int jtag_vpi_negotiate(void)
+{
+	struct vpi_cmd vpi;
+
+	if (jtag_vpi_protocol == JTAG_VPI_LEGACY)
+		return ERROR_OK;
+
+	memset(&vpi, 0, sizeof(vpi));
+	vpi.cmd = CMD_PROTOCOL;
+	vpi.nb_bits = JTAG_VPI_PROTOCOL_V2;
+	if (jtag_vpi_send_cmd(&vpi) != ERROR_OK)
+		return ERROR_FAIL;
+
+	if (jtag_vpi_protocol == JTAG_VPI_AUTO) {
+		fd_set read_fds;
+		struct timeval tv = {
+			.tv_sec = JTAG_VPI_PROBE_MS / 1000,
+			.tv_usec = (JTAG_VPI_PROBE_MS % 1000) * 1000,
+		};
+
+		FD_ZERO(&read_fds);
+		FD_SET(sockfd, &read_fds);
+		if (socket_select(sockfd + 1, &read_fds, NULL, NULL, &tv) <= 0) {
+			LOG_INFO("VPI server does not support protocol v2, using legacy protocol");
+			return ERROR_OK;
+		}
+	}
+
+	if (jtag_vpi_receive_cmd(&vpi) != ERROR_OK)
+		return ERROR_FAIL;
+	if (vpi.cmd != CMD_PROTOCOL || vpi.nb_bits != JTAG_VPI_PROTOCOL_V2) {
+		LOG_ERROR("Unexpected reply to protocol request: cmd %d, version %d",
+				vpi.cmd, vpi.nb_bits);
+		return ERROR_FAIL;
+	}
+
+	jtag_vpi_msg.size = XFERT_MAX_SIZE * 8;
+	jtag_vpi_msg.data = malloc(jtag_vpi_msg.size);
+	if (jtag_vpi_msg.data == NULL) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+	jtag_vpi_msg.used = JTAG_VPI_MSG_HEADER;
+
+	LOG_INFO("Using VPI protocol v2");
+	jtag_vpi_v2 = true;
+	return ERROR_OK;
+}
+
 static int jtag_vpi_init(void)
 {
 	int flag = 1;
@@ -430,11 +691,21 @@ static int jtag_vpi_init(void)
 
 	LOG_INFO("Connection to %s : %u succeed", server_address, server_port);
 
+	if (jtag_vpi_negotiate() != ERROR_OK) {
+		close(sockfd);
+		return ERROR_FAIL;
+	}
+
 	return ERROR_OK;
 }
 
 static int jtag_vpi_quit(void)
 {
+	free(jtag_vpi_msg.data);
+	free(jtag_vpi_msg.scans);
+	memset(&jtag_vpi_msg, 0, sizeof(jtag_vpi_msg));
+	jtag_vpi_v2 = false;
+
 	free(server_address);
 	return close(sockfd);
 }
@@ -466,6 +737,25 @@ COMMAND_HANDLER(jtag_vpi_set_address)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(jtag_vpi_set_protocol)
+{
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (strcmp(CMD_ARGV[0], "auto") == 0)
+		jtag_vpi_protocol = JTAG_VPI_AUTO;
+	else if (strcmp(CMD_ARGV[0], "legacy") == 0)
+		jtag_vpi_protocol = JTAG_VPI_LEGACY;
+	else if (strcmp(CMD_ARGV[0], "v2") == 0)
+		jtag_vpi_protocol = JTAG_VPI_V2;
+	else
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	LOG_INFO("Set VPI protocol to %s", CMD_ARGV[0]);
+
+	return ERROR_OK;
+}
+
 static const struct command_registration jtag_vpi_command_handlers[] = {
 	{
 		.name = "jtag_vpi_set_port",
@@ -481,6 +771,13 @@ static const struct command_registration jtag_vpi_command_handlers[] = {
 		.help = "set the address of the VPI server",
 		.usage = "description_string",
 	},
+	{
+		.name = "jtag_vpi_set_protocol",
+		.handler = &jtag_vpi_set_protocol,
+		.mode = COMMAND_CONFIG,
+		.help = "select the protocol spoken with the VPI server",
+		.usage = "('auto'|'legacy'|'v2')",
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
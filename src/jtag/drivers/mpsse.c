@@ -60,6 +60,32 @@
 #define SIO_RESET_PURGE_RX 1
 #define SIO_RESET_PURGE_TX 2
 
+struct mpsse_ctx;
+
+/* Context needed by the callbacks */
+struct transfer_result {
+	struct mpsse_ctx *ctx;
+	struct mpsse_batch *batch;
+	bool done;
+	unsigned transferred;
+};
+
+/* Commands on the bus, in the buffers they were queued in. While a batch
+ * is being transferred, the next one is queued in the context's buffers. */
+struct mpsse_batch {
+	uint8_t *write_buffer;
+	unsigned write_count;
+	uint8_t *read_buffer;
+	unsigned read_count;
+	uint8_t *read_chunk;
+	struct bit_copy_queue read_queue;
+	struct libusb_transfer *write_transfer;
+	struct libusb_transfer *read_transfer;
+	struct transfer_result write_result;
+	struct transfer_result read_result;
+	bool busy;
+};
+
 struct mpsse_ctx {
 	libusb_context *usb_ctx;
 	libusb_device_handle *usb_dev;
@@ -80,9 +106,13 @@ struct mpsse_ctx {
 	uint8_t *read_chunk;
 	unsigned read_chunk_size;
 	struct bit_copy_queue read_queue;
+	struct mpsse_batch batch;
 	int retval;
 };
 
+static void mpsse_batch_cancel(struct mpsse_ctx *ctx);
+static int mpsse_flush_async(struct mpsse_ctx *ctx);
+
 /* Returns true if the string descriptor indexed by str_index in device matches string */
 static bool string_descriptor_equal(libusb_device_handle *device, uint8_t str_index,
 	const char *string)
@@ -326,19 +356,24 @@ struct mpsse_ctx *mpsse_open(const uint16_t *vid, const uint16_t *pid, const cha
 		return 0;
 
 	bit_copy_queue_init(&ctx->read_queue);
+	bit_copy_queue_init(&ctx->batch.read_queue);
 	ctx->read_chunk_size = 16384;
 	ctx->read_size = 16384;
 	ctx->write_size = 16384;
 	ctx->read_chunk = malloc(ctx->read_chunk_size);
 	ctx->read_buffer = malloc(ctx->read_size);
+	ctx->batch.read_chunk = malloc(ctx->read_chunk_size);
+	ctx->batch.read_buffer = malloc(ctx->read_size);
 
 	/* Use calloc to make valgrind happy: buffer_write() sets payload
 	 * on bit basis, so some bits can be left uninitialized in write_buffer.
 	 * Although this is perfectly ok with MPSSE, valgrind reports
 	 * Syscall param ioctl(USBDEVFS_SUBMITURB).buffer points to uninitialised byte(s) */
 	ctx->write_buffer = calloc(1, ctx->write_size);
+	ctx->batch.write_buffer = calloc(1, ctx->write_size);
 
-	if (!ctx->read_chunk || !ctx->read_buffer || !ctx->write_buffer)
+	if (!ctx->read_chunk || !ctx->read_buffer || !ctx->write_buffer ||
+			!ctx->batch.read_chunk || !ctx->batch.read_buffer || !ctx->batch.write_buffer)
 		goto error;
 
 	ctx->interface = channel;
@@ -398,6 +433,7 @@ error:
 
 void mpsse_close(struct mpsse_ctx *ctx)
 {
+	mpsse_batch_cancel(ctx);
 	if (ctx->usb_dev)
 		libusb_close(ctx->usb_dev);
 	if (ctx->usb_ctx)
@@ -409,6 +445,9 @@ void mpsse_close(struct mpsse_ctx *ctx)
 		free(ctx->read_buffer);
 	if (ctx->read_chunk)
 		free(ctx->read_chunk);
+	free(ctx->batch.write_buffer);
+	free(ctx->batch.read_buffer);
+	free(ctx->batch.read_chunk);
 
 	free(ctx);
 }
@@ -422,6 +461,7 @@ void mpsse_purge(struct mpsse_ctx *ctx)
 {
 	int err;
 	LOG_DEBUG("-");
+	mpsse_batch_cancel(ctx);
 	ctx->write_count = 0;
 	ctx->read_count = 0;
 	ctx->retval = ERROR_OK;
@@ -513,7 +553,7 @@ void mpsse_clock_data(struct mpsse_ctx *ctx, const uint8_t *out, unsigned out_of
 		/* Guarantee buffer space enough for a minimum size transfer */
 		if (buffer_write_space(ctx) + (length < 8) < (out || (!out && !in) ? 4 : 3)
 				|| (in && buffer_read_space(ctx) < 1))
-			ctx->retval = mpsse_flush(ctx);
+			ctx->retval = mpsse_flush_async(ctx);
 
 		if (length < 8) {
 			/* Transfer remaining bits in bit mode */
@@ -587,7 +627,7 @@ void mpsse_clock_tms_cs(struct mpsse_ctx *ctx, const uint8_t *out, unsigned out_
 	while (length > 0) {
 		/* Guarantee buffer space enough for a minimum size transfer */
 		if (buffer_write_space(ctx) < 3 || (in && buffer_read_space(ctx) < 1))
-			ctx->retval = mpsse_flush(ctx);
+			ctx->retval = mpsse_flush_async(ctx);
 
 		/* Byte transfer */
 		unsigned this_bits = length;
@@ -630,7 +670,7 @@ void mpsse_set_data_bits_low_byte(struct mpsse_ctx *ctx, uint8_t data, uint8_t d
 	}
 
 	if (buffer_write_space(ctx) < 3)
-		ctx->retval = mpsse_flush(ctx);
+		ctx->retval = mpsse_flush_async(ctx);
 
 	buffer_write_byte(ctx, 0x80);
 	buffer_write_byte(ctx, data);
@@ -647,7 +687,7 @@ void mpsse_set_data_bits_high_byte(struct mpsse_ctx *ctx, uint8_t data, uint8_t
 	}
 
 	if (buffer_write_space(ctx) < 3)
-		ctx->retval = mpsse_flush(ctx);
+		ctx->retval = mpsse_flush_async(ctx);
 
 	buffer_write_byte(ctx, 0x82);
 	buffer_write_byte(ctx, data);
@@ -664,7 +704,7 @@ void mpsse_read_data_bits_low_byte(struct mpsse_ctx *ctx, uint8_t *data)
 	}
 
 	if (buffer_write_space(ctx) < 1 || buffer_read_space(ctx) < 1)
-		ctx->retval = mpsse_flush(ctx);
+		ctx->retval = mpsse_flush_async(ctx);
 
 	buffer_write_byte(ctx, 0x81);
 	buffer_add_read(ctx, data, 0, 8, 0);
@@ -680,7 +720,7 @@ void mpsse_read_data_bits_high_byte(struct mpsse_ctx *ctx, uint8_t *data)
 	}
 
 	if (buffer_write_space(ctx) < 1 || buffer_read_space(ctx) < 1)
-		ctx->retval = mpsse_flush(ctx);
+		ctx->retval = mpsse_flush_async(ctx);
 
 	buffer_write_byte(ctx, 0x83);
 	buffer_add_read(ctx, data, 0, 8, 0);
@@ -695,7 +735,7 @@ static void single_byte_boolean_helper(struct mpsse_ctx *ctx, bool var, uint8_t
 	}
 
 	if (buffer_write_space(ctx) < 1)
-		ctx->retval = mpsse_flush(ctx);
+		ctx->retval = mpsse_flush_async(ctx);
 
 	buffer_write_byte(ctx, var ? val_if_true : val_if_false);
 }
@@ -716,7 +756,7 @@ void mpsse_set_divisor(struct mpsse_ctx *ctx, uint16_t divisor)
 	}
 
 	if (buffer_write_space(ctx) < 3)
-		ctx->retval = mpsse_flush(ctx);
+		ctx->retval = mpsse_flush_async(ctx);
 
 	buffer_write_byte(ctx, 0x86);
 	buffer_write_byte(ctx, divisor & 0xff);
@@ -776,17 +816,11 @@ int mpsse_set_frequency(struct mpsse_ctx *ctx, int frequency)
 	return frequency;
 }
 
-/* Context needed by the callbacks */
-struct transfer_result {
-	struct mpsse_ctx *ctx;
-	bool done;
-	unsigned transferred;
-};
-
 static LIBUSB_CALL void read_cb(struct libusb_transfer *transfer)
 {
 	struct transfer_result *res = transfer->user_data;
 	struct mpsse_ctx *ctx = res->ctx;
+	struct mpsse_batch *batch = res->batch;
 
 	unsigned packet_size = ctx->max_packet_size;
 
@@ -800,21 +834,21 @@ static LIBUSB_CALL void read_cb(struct libusb_transfer *transfer)
 		unsigned this_size = packet_size - 2;
 		if (this_size > chunk_remains - 2)
 			this_size = chunk_remains - 2;
-		if (this_size > ctx->read_count - res->transferred)
-			this_size = ctx->read_count - res->transferred;
-		memcpy(ctx->read_buffer + res->transferred,
-			ctx->read_chunk + packet_size * i + 2,
+		if (this_size > batch->read_count - res->transferred)
+			this_size = batch->read_count - res->transferred;
+		memcpy(batch->read_buffer + res->transferred,
+			batch->read_chunk + packet_size * i + 2,
 			this_size);
 		res->transferred += this_size;
 		chunk_remains -= this_size + 2;
-		if (res->transferred == ctx->read_count) {
+		if (res->transferred == batch->read_count) {
 			res->done = true;
 			break;
 		}
 	}
 
 	LOG_DEBUG_IO("raw chunk %d, transferred %d of %d", transfer->actual_length, res->transferred,
-		ctx->read_count);
+		batch->read_count);
 
 	if (!res->done)
 		if (libusb_submit_transfer(transfer) != LIBUSB_SUCCESS)
@@ -824,71 +858,42 @@ static LIBUSB_CALL void read_cb(struct libusb_transfer *transfer)
 static LIBUSB_CALL void write_cb(struct libusb_transfer *transfer)
 {
 	struct transfer_result *res = transfer->user_data;
-	struct mpsse_ctx *ctx = res->ctx;
+	struct mpsse_batch *batch = res->batch;
 
 	res->transferred += transfer->actual_length;
 
-	LOG_DEBUG_IO("transferred %d of %d", res->transferred, ctx->write_count);
+	LOG_DEBUG_IO("transferred %d of %d", res->transferred, batch->write_count);
 
 	DEBUG_PRINT_BUF(transfer->buffer, transfer->actual_length);
 
-	if (res->transferred == ctx->write_count)
+	if (res->transferred == batch->write_count)
 		res->done = true;
 	else {
-		transfer->length = ctx->write_count - res->transferred;
-		transfer->buffer = ctx->write_buffer + res->transferred;
+		transfer->length = batch->write_count - res->transferred;
+		transfer->buffer = batch->write_buffer + res->transferred;
 		if (libusb_submit_transfer(transfer) != LIBUSB_SUCCESS)
 			res->done = true;
 	}
 }
 
-int mpsse_flush(struct mpsse_ctx *ctx)
+static void mpsse_batch_free(struct mpsse_batch *batch)
 {
-	int retval = ctx->retval;
-
-	if (retval != ERROR_OK) {
-		LOG_DEBUG_IO("Ignoring flush due to previous error");
-		assert(ctx->write_count == 0 && ctx->read_count == 0);
-		ctx->retval = ERROR_OK;
-		return retval;
-	}
-
-	LOG_DEBUG_IO("write %d%s, read %d", ctx->write_count, ctx->read_count ? "+1" : "",
-			ctx->read_count);
-	assert(ctx->write_count > 0 || ctx->read_count == 0); /* No read data without write data */
-
-	if (ctx->write_count == 0)
-		return retval;
+	libusb_free_transfer(batch->write_transfer);
+	batch->write_transfer = NULL;
+	if (batch->read_transfer)
+		libusb_free_transfer(batch->read_transfer);
+	batch->read_transfer = NULL;
+	batch->busy = false;
+}
 
-	struct libusb_transfer *read_transfer = 0;
-	struct transfer_result read_result = { .ctx = ctx, .done = true };
-	if (ctx->read_count) {
-		buffer_write_byte(ctx, 0x87); /* SEND_IMMEDIATE */
-		read_result.done = false;
-		/* delay read transaction to ensure the FTDI chip can support us with data
-		   immediately after processing the MPSSE commands in the write transaction */
-	}
-
-	struct transfer_result write_result = { .ctx = ctx, .done = false };
-	struct libusb_transfer *write_transfer = libusb_alloc_transfer(0);
-	libusb_fill_bulk_transfer(write_transfer, ctx->usb_dev, ctx->out_ep, ctx->write_buffer,
-		ctx->write_count, write_cb, &write_result, ctx->usb_write_timeout);
-	retval = libusb_submit_transfer(write_transfer);
-	if (retval != LIBUSB_SUCCESS)
-		goto error_check;
-
-	if (ctx->read_count) {
-		read_transfer = libusb_alloc_transfer(0);
-		libusb_fill_bulk_transfer(read_transfer, ctx->usb_dev, ctx->in_ep, ctx->read_chunk,
-			ctx->read_chunk_size, read_cb, &read_result,
-			ctx->usb_read_timeout);
-		retval = libusb_submit_transfer(read_transfer);
-		if (retval != LIBUSB_SUCCESS)
-			goto error_check;
-	}
+/* Handle USB events until the transfers of the batch are done */
+static int mpsse_batch_wait_events(struct mpsse_ctx *ctx)
+{
+	struct mpsse_batch *batch = &ctx->batch;
+	int retval = LIBUSB_SUCCESS;
 
 	/* Polling loop, more or less taken from libftdi */
-	while (!write_result.done || !read_result.done) {
+	while (!batch->write_result.done || !batch->read_result.done) {
 		struct timeval timeout_usb;
 
 		timeout_usb.tv_sec = 1;
@@ -900,10 +905,10 @@ int mpsse_flush(struct mpsse_ctx *ctx)
 			break;
 
 		if (retval != LIBUSB_SUCCESS) {
-			libusb_cancel_transfer(write_transfer);
-			if (read_transfer)
-				libusb_cancel_transfer(read_transfer);
-			while (!write_result.done || !read_result.done) {
+			libusb_cancel_transfer(batch->write_transfer);
+			if (batch->read_transfer)
+				libusb_cancel_transfer(batch->read_transfer);
+			while (!batch->write_result.done || !batch->read_result.done) {
 				retval = libusb_handle_events_timeout_completed(ctx->usb_ctx,
 								&timeout_usb, NULL);
 				if (retval != LIBUSB_SUCCESS)
@@ -912,34 +917,166 @@ int mpsse_flush(struct mpsse_ctx *ctx)
 		}
 	}
 
-error_check:
+	return retval;
+}
+
+/* Move the queued commands to the batch and start transferring them */
+static int mpsse_batch_start(struct mpsse_ctx *ctx)
+{
+	struct mpsse_batch *batch = &ctx->batch;
+	uint8_t *buffer;
+	int retval;
+
+	assert(!batch->busy);
+
+	LOG_DEBUG_IO("write %d%s, read %d", ctx->write_count, ctx->read_count ? "+1" : "",
+			ctx->read_count);
+	assert(ctx->write_count > 0 || ctx->read_count == 0); /* No read data without write data */
+
+	if (ctx->read_count)
+		buffer_write_byte(ctx, 0x87); /* SEND_IMMEDIATE */
+
+	/* swap buffers, the context gets the ones of the previous batch */
+	buffer = batch->write_buffer;
+	batch->write_buffer = ctx->write_buffer;
+	ctx->write_buffer = buffer;
+	buffer = batch->read_buffer;
+	batch->read_buffer = ctx->read_buffer;
+	ctx->read_buffer = buffer;
+	buffer = batch->read_chunk;
+	batch->read_chunk = ctx->read_chunk;
+	ctx->read_chunk = buffer;
+
+	batch->write_count = ctx->write_count;
+	batch->read_count = ctx->read_count;
+	ctx->write_count = 0;
+	ctx->read_count = 0;
+	list_splice_tail(&ctx->read_queue.list, &batch->read_queue.list);
+	bit_copy_queue_init(&ctx->read_queue);
+
+	batch->write_result = (struct transfer_result) { .ctx = ctx, .batch = batch, .done = false };
+	batch->read_result = (struct transfer_result) { .ctx = ctx, .batch = batch,
+		.done = batch->read_count == 0 };
+	batch->busy = true;
+
+	batch->write_transfer = libusb_alloc_transfer(0);
+	libusb_fill_bulk_transfer(batch->write_transfer, ctx->usb_dev, ctx->out_ep,
+		batch->write_buffer, batch->write_count, write_cb, &batch->write_result,
+		ctx->usb_write_timeout);
+	retval = libusb_submit_transfer(batch->write_transfer);
+	if (retval != LIBUSB_SUCCESS) {
+		LOG_ERROR("libusb_submit_transfer() failed with %s", libusb_error_name(retval));
+		batch->write_result.done = true;
+		batch->read_result.done = true;
+		return ERROR_FAIL;
+	}
+
+	/* the read transaction follows the write, to ensure the FTDI chip can
+	 * support us with data immediately after processing the MPSSE commands */
+	if (batch->read_count) {
+		batch->read_transfer = libusb_alloc_transfer(0);
+		libusb_fill_bulk_transfer(batch->read_transfer, ctx->usb_dev, ctx->in_ep,
+			batch->read_chunk, ctx->read_chunk_size, read_cb, &batch->read_result,
+			ctx->usb_read_timeout);
+		retval = libusb_submit_transfer(batch->read_transfer);
+		if (retval != LIBUSB_SUCCESS) {
+			LOG_ERROR("libusb_submit_transfer() failed with %s", libusb_error_name(retval));
+			batch->read_result.done = true;
+			libusb_cancel_transfer(batch->write_transfer);
+			return ERROR_FAIL;
+		}
+	}
+
+	return ERROR_OK;
+}
+
+/* Wait for the batch on the bus, if any, and deliver its read data */
+static int mpsse_batch_wait(struct mpsse_ctx *ctx)
+{
+	struct mpsse_batch *batch = &ctx->batch;
+	int retval;
+
+	if (!batch->busy)
+		return ERROR_OK;
+
+	retval = mpsse_batch_wait_events(ctx);
+
 	if (retval != LIBUSB_SUCCESS) {
 		LOG_ERROR("libusb_handle_events() failed with %s", libusb_error_name(retval));
 		retval = ERROR_FAIL;
-	} else if (write_result.transferred < ctx->write_count) {
+	} else if (batch->write_result.transferred < batch->write_count) {
 		LOG_ERROR("ftdi device did not accept all data: %d, tried %d",
-			write_result.transferred,
-			ctx->write_count);
+			batch->write_result.transferred,
+			batch->write_count);
 		retval = ERROR_FAIL;
-	} else if (read_result.transferred < ctx->read_count) {
+	} else if (batch->read_result.transferred < batch->read_count) {
 		LOG_ERROR("ftdi device did not return all data: %d, expected %d",
-			read_result.transferred,
-			ctx->read_count);
+			batch->read_result.transferred,
+			batch->read_count);
 		retval = ERROR_FAIL;
-	} else if (ctx->read_count) {
-		ctx->write_count = 0;
-		ctx->read_count = 0;
-		bit_copy_execute(&ctx->read_queue);
-		retval = ERROR_OK;
 	} else {
-		ctx->write_count = 0;
-		bit_copy_discard(&ctx->read_queue);
+		bit_copy_execute(&batch->read_queue);
 		retval = ERROR_OK;
 	}
 
-	libusb_free_transfer(write_transfer);
-	if (read_transfer)
-		libusb_free_transfer(read_transfer);
+	bit_copy_discard(&batch->read_queue);
+	mpsse_batch_free(batch);
+
+	return retval;
+}
+
+/* Abort the batch on the bus, if any, dropping its read data */
+static void mpsse_batch_cancel(struct mpsse_ctx *ctx)
+{
+	struct mpsse_batch *batch = &ctx->batch;
+
+	if (!batch->busy)
+		return;
+
+	if (!batch->write_result.done)
+		libusb_cancel_transfer(batch->write_transfer);
+	if (batch->read_transfer && !batch->read_result.done)
+		libusb_cancel_transfer(batch->read_transfer);
+	mpsse_batch_wait_events(ctx);
+
+	bit_copy_discard(&batch->read_queue);
+	mpsse_batch_free(batch);
+}
+
+/* Called when the buffers are full in the middle of a queue: wait for the
+ * previous batch, then put this one on the bus and let the caller queue the
+ * next commands while it is being transferred. The read data is delivered
+ * when the batch completes, by the time mpsse_flush() returns. */
+static int mpsse_flush_async(struct mpsse_ctx *ctx)
+{
+	int retval = mpsse_batch_wait(ctx);
+
+	if (retval == ERROR_OK && ctx->write_count)
+		retval = mpsse_batch_start(ctx);
+
+	if (retval != ERROR_OK)
+		mpsse_purge(ctx);
+
+	return retval;
+}
+
+int mpsse_flush(struct mpsse_ctx *ctx)
+{
+	int retval = ctx->retval;
+
+	if (retval != ERROR_OK) {
+		LOG_DEBUG_IO("Ignoring flush due to previous error");
+		assert(ctx->write_count == 0 && ctx->read_count == 0);
+		ctx->retval = ERROR_OK;
+		return retval;
+	}
+
+	retval = mpsse_batch_wait(ctx);
+	if (retval == ERROR_OK && ctx->write_count) {
+		retval = mpsse_batch_start(ctx);
+		if (retval == ERROR_OK)
+			retval = mpsse_batch_wait(ctx);
+	}
 
 	if (retval != ERROR_OK)
 		mpsse_purge(ctx);
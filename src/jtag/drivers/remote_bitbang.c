@@ -41,6 +41,48 @@ static char remote_bitbang_buf[64];
 static unsigned remote_bitbang_start;
 static unsigned remote_bitbang_end;
 
+/* Protocol v2: the character set above plus 'V' (version query) and the
+ * binary 'T'/'U' vector frames, see doc/manual/jtag/drivers/remote_bitbang.txt */
+#define REMOTE_BITBANG_V2_VERSION	'2'
+/* TDO samples that may be in flight, also the longest frame in bits */
+#define REMOTE_BITBANG_V2_WINDOW	8192
+/* how long "auto" waits for an answer to 'V' before assuming a legacy server */
+#define REMOTE_BITBANG_V2_PROBE_MS	500
+
+enum remote_bitbang_protocol {
+	REMOTE_BITBANG_PROTOCOL_AUTO,
+	REMOTE_BITBANG_PROTOCOL_LEGACY,
+	REMOTE_BITBANG_PROTOCOL_V2,
+};
+
+static enum remote_bitbang_protocol remote_bitbang_protocol;
+
+/* clock cycles collected for the next 'T' (no capture) or 'U' (capture) frame */
+static struct {
+	uint8_t tms[REMOTE_BITBANG_V2_WINDOW / 8];
+	uint8_t tdi[REMOTE_BITBANG_V2_WINDOW / 8];
+	unsigned int bits;
+	bool capture;
+} remote_bitbang_frame;
+
+/* pins last written with TCK low, waiting for the rising edge that turns
+ * them into a frame cycle */
+static bool remote_bitbang_low_pending;
+static int remote_bitbang_low_tms;
+static int remote_bitbang_low_tdi;
+static bool remote_bitbang_low_sample;
+
+/* replies still owed by the server, in request order: the number of packed
+ * TDO bits of a 'U' frame, or 0 for the ASCII answer to a plain 'R' */
+static uint16_t remote_bitbang_replies[REMOTE_BITBANG_V2_WINDOW];
+static unsigned int remote_bitbang_replies_head;
+static unsigned int remote_bitbang_replies_count;
+
+/* 'U' frame reply being handed out by remote_bitbang_read_sample_v2() */
+static uint8_t remote_bitbang_rx[REMOTE_BITBANG_V2_WINDOW / 8];
+static unsigned int remote_bitbang_rx_bits;
+static unsigned int remote_bitbang_rx_pos;
+
 static int remote_bitbang_buf_full(void)
 {
 	return remote_bitbang_end ==
@@ -95,8 +137,86 @@ static int remote_bitbang_putc(int c)
 	return ERROR_OK;
 }
 
+static int remote_bitbang_fwrite(const void *buf, size_t len)
+{
+	if (fwrite(buf, 1, len, remote_bitbang_file) != len) {
+		LOG_ERROR("remote_bitbang_fwrite: %s", strerror(errno));
+		return ERROR_FAIL;
+	}
+	return ERROR_OK;
+}
+
+static int remote_bitbang_queue_reply(unsigned int bits)
+{
+	if (remote_bitbang_replies_count == REMOTE_BITBANG_V2_WINDOW) {
+		LOG_ERROR("remote_bitbang: too many outstanding TDO samples");
+		return ERROR_FAIL;
+	}
+
+	unsigned int idx = (remote_bitbang_replies_head + remote_bitbang_replies_count) %
+		REMOTE_BITBANG_V2_WINDOW;
+	remote_bitbang_replies[idx] = bits;
+	remote_bitbang_replies_count++;
+	return ERROR_OK;
+}
+
+/* Send the cycles collected so far as one vector frame. */
+static int remote_bitbang_flush_frame(void)
+{
+	unsigned int bits = remote_bitbang_frame.bits;
+	if (bits == 0)
+		return ERROR_OK;
+
+	unsigned int bytes = DIV_ROUND_UP(bits, 8);
+	uint8_t header[3] = {
+		remote_bitbang_frame.capture ? 'U' : 'T',
+		bits & 0xff,
+		bits >> 8,
+	};
+
+	int retval = remote_bitbang_fwrite(header, sizeof(header));
+	if (retval == ERROR_OK)
+		retval = remote_bitbang_fwrite(remote_bitbang_frame.tms, bytes);
+	if (retval == ERROR_OK)
+		retval = remote_bitbang_fwrite(remote_bitbang_frame.tdi, bytes);
+	if (retval == ERROR_OK && remote_bitbang_frame.capture)
+		retval = remote_bitbang_queue_reply(bits);
+
+	memset(remote_bitbang_frame.tms, 0, bytes);
+	memset(remote_bitbang_frame.tdi, 0, bytes);
+	remote_bitbang_frame.bits = 0;
+	return retval;
+}
+
+/* Send the pins written with TCK low as a plain write request, for when no
+ * rising edge follows (end of queue, reset, blink, quit). */
+static int remote_bitbang_flush_low(void)
+{
+	if (!remote_bitbang_low_pending)
+		return ERROR_OK;
+
+	remote_bitbang_low_pending = false;
+
+	int retval = remote_bitbang_flush_frame();
+	if (retval != ERROR_OK)
+		return retval;
+
+	char c = '0' + ((remote_bitbang_low_tms ? 0x2 : 0x0) | (remote_bitbang_low_tdi ? 0x1 : 0x0));
+	retval = remote_bitbang_putc(c);
+	if (retval != ERROR_OK || !remote_bitbang_low_sample)
+		return retval;
+
+	remote_bitbang_low_sample = false;
+	retval = remote_bitbang_putc('R');
+	if (retval != ERROR_OK)
+		return retval;
+	return remote_bitbang_queue_reply(0);
+}
+
 static int remote_bitbang_quit(void)
 {
+	remote_bitbang_flush_low();
+
 	if (EOF == fputc('Q', remote_bitbang_file)) {
 		LOG_ERROR("fputs: %s", strerror(errno));
 		return ERROR_FAIL;
@@ -184,16 +304,144 @@ static int remote_bitbang_write(int tck, int tms, int tdi)
 
 static int remote_bitbang_reset(int trst, int srst)
 {
+	int retval = remote_bitbang_flush_low();
+	if (retval != ERROR_OK)
+		return retval;
+
 	char c = 'r' + ((trst ? 0x2 : 0x0) | (srst ? 0x1 : 0x0));
 	return remote_bitbang_putc(c);
 }
 
 static int remote_bitbang_blink(int on)
 {
+	int retval = remote_bitbang_flush_low();
+	if (retval != ERROR_OK)
+		return retval;
+
 	char c = on ? 'B' : 'b';
 	return remote_bitbang_putc(c);
 }
 
+/* Read exactly len bytes, blocking. */
+static int remote_bitbang_read_exact(uint8_t *buf, size_t len)
+{
+	if (EOF == fflush(remote_bitbang_file)) {
+		LOG_ERROR("fflush: %s", strerror(errno));
+		return ERROR_FAIL;
+	}
+
+	socket_block(remote_bitbang_fd);
+	while (len > 0) {
+		ssize_t count = read(remote_bitbang_fd, buf, len);
+		if (count <= 0) {
+			LOG_ERROR("read: count=%d, error=%s", (int) count, strerror(errno));
+			return ERROR_FAIL;
+		}
+		buf += count;
+		len -= count;
+	}
+
+	return ERROR_OK;
+}
+
+/*
+ * Protocol v2 keeps the interface of the legacy protocol: bitbang.c still
+ * writes one TCK edge at a time, but a TCK low write followed by a TCK high
+ * write is collected as one cycle of a vector frame instead of being sent as
+ * two characters.  A sample taken between them marks the cycle for capture.
+ * Anything else is sent with the legacy characters, which v2 servers also
+ * understand.
+ */
+static int remote_bitbang_write_v2(int tck, int tms, int tdi)
+{
+	if (!tck) {
+		remote_bitbang_low_pending = true;
+		remote_bitbang_low_tms = tms;
+		remote_bitbang_low_tdi = tdi;
+		return ERROR_OK;
+	}
+
+	if (!remote_bitbang_low_pending) {
+		/* TCK is already high, only the data pins change */
+		int retval = remote_bitbang_flush_frame();
+		if (retval != ERROR_OK)
+			return retval;
+		return remote_bitbang_write(tck, tms, tdi);
+	}
+
+	bool capture = remote_bitbang_low_sample;
+	unsigned int bits = remote_bitbang_frame.bits;
+	if (bits && (remote_bitbang_frame.capture != capture || bits == REMOTE_BITBANG_V2_WINDOW)) {
+		int retval = remote_bitbang_flush_frame();
+		if (retval != ERROR_OK)
+			return retval;
+		bits = 0;
+	}
+
+	remote_bitbang_frame.capture = capture;
+	if (tms)
+		remote_bitbang_frame.tms[bits / 8] |= 1 << (bits % 8);
+	if (tdi)
+		remote_bitbang_frame.tdi[bits / 8] |= 1 << (bits % 8);
+	remote_bitbang_frame.bits = bits + 1;
+
+	remote_bitbang_low_pending = false;
+	remote_bitbang_low_sample = false;
+	return ERROR_OK;
+}
+
+static int remote_bitbang_sample_v2(void)
+{
+	if (remote_bitbang_low_pending && !remote_bitbang_low_sample) {
+		remote_bitbang_low_sample = true;
+		return ERROR_OK;
+	}
+
+	/* not between the edges of a cycle, fall back to a plain read request */
+	int retval = remote_bitbang_flush_low();
+	if (retval == ERROR_OK)
+		retval = remote_bitbang_flush_frame();
+	if (retval == ERROR_OK)
+		retval = remote_bitbang_putc('R');
+	if (retval != ERROR_OK)
+		return retval;
+	return remote_bitbang_queue_reply(0);
+}
+
+static bb_value_t remote_bitbang_read_sample_v2(void)
+{
+	if (remote_bitbang_rx_pos == remote_bitbang_rx_bits) {
+		/* the sample may still be sitting in the frame being collected */
+		if (remote_bitbang_replies_count == 0 && remote_bitbang_flush_frame() != ERROR_OK)
+			return BB_ERROR;
+		if (remote_bitbang_replies_count == 0 && remote_bitbang_flush_low() != ERROR_OK)
+			return BB_ERROR;
+		if (remote_bitbang_replies_count == 0) {
+			LOG_ERROR("remote_bitbang: no TDO sample requested");
+			return BB_ERROR;
+		}
+
+		unsigned int bits = remote_bitbang_replies[remote_bitbang_replies_head];
+		remote_bitbang_replies_head = (remote_bitbang_replies_head + 1) % REMOTE_BITBANG_V2_WINDOW;
+		remote_bitbang_replies_count--;
+
+		if (bits == 0) {
+			uint8_t c;
+			if (remote_bitbang_read_exact(&c, 1) != ERROR_OK)
+				return BB_ERROR;
+			return char_to_int(c);
+		}
+
+		if (remote_bitbang_read_exact(remote_bitbang_rx, DIV_ROUND_UP(bits, 8)) != ERROR_OK)
+			return BB_ERROR;
+		remote_bitbang_rx_bits = bits;
+		remote_bitbang_rx_pos = 0;
+	}
+
+	unsigned int pos = remote_bitbang_rx_pos++;
+	return (remote_bitbang_rx[pos / 8] >> (pos % 8)) & 1 ? BB_HIGH : BB_LOW;
+}
+
 static struct bitbang_interface remote_bitbang_bitbang = {
 	.buf_size = sizeof(remote_bitbang_buf) - 1,
 	.sample = &remote_bitbang_sample,
@@ -203,6 +451,74 @@ static struct bitbang_interface remote_bitbang_bitbang = {
 	.blink = &remote_bitbang_blink,
 };
 
+static struct bitbang_interface remote_bitbang_bitbang_v2 = {
+	.buf_size = REMOTE_BITBANG_V2_WINDOW,
+	.sample = &remote_bitbang_sample_v2,
+	.read_sample = &remote_bitbang_read_sample_v2,
+	.write = &remote_bitbang_write_v2,
+	.reset = &remote_bitbang_reset,
+	.blink = &remote_bitbang_blink,
+};
+
+static int remote_bitbang_execute_queue(void)
+{
+	int retval = bitbang_execute_queue();
+
+	/* leave TCK low and hand everything to the server before returning */
+	if (remote_bitbang_flush_low() != ERROR_OK)
+		retval = ERROR_FAIL;
+	if (remote_bitbang_flush_frame() != ERROR_OK)
+		retval = ERROR_FAIL;
+	if (EOF == fflush(remote_bitbang_file)) {
+		LOG_ERROR("fflush: %s", strerror(errno));
+		retval = ERROR_FAIL;
+	}
+
+	return retval;
+}
+
+/* Ask the server for protocol v2; legacy servers ignore the request. */
+static int remote_bitbang_negotiate(void)
+{
+	if (remote_bitbang_protocol == REMOTE_BITBANG_PROTOCOL_LEGACY)
+		return ERROR_OK;
+
+	if (remote_bitbang_putc('V') != ERROR_OK)
+		return ERROR_FAIL;
+	if (EOF == fflush(remote_bitbang_file)) {
+		LOG_ERROR("fflush: %s", strerror(errno));
+		return ERROR_FAIL;
+	}
+
+	if (remote_bitbang_protocol == REMOTE_BITBANG_PROTOCOL_AUTO) {
+		fd_set read_fds;
+		struct timeval tv = {
+			.tv_sec = REMOTE_BITBANG_V2_PROBE_MS / 1000,
+			.tv_usec = (REMOTE_BITBANG_V2_PROBE_MS % 1000) * 1000,
+		};
+
+		FD_ZERO(&read_fds);
+		FD_SET(remote_bitbang_fd, &read_fds);
+		if (socket_select(remote_bitbang_fd + 1, &read_fds, NULL, NULL, &tv) <= 0) {
+			LOG_INFO("remote_bitbang server does not support protocol v2, using legacy protocol");
+			return ERROR_OK;
+		}
+	}
+
+	uint8_t version;
+	if (remote_bitbang_read_exact(&version, 1) != ERROR_OK)
+		return ERROR_FAIL;
+	if (version != REMOTE_BITBANG_V2_VERSION) {
+		LOG_ERROR("remote_bitbang: unexpected reply to version request: %c(%i)",
+				version, version);
+		return ERROR_FAIL;
+	}
+
+	LOG_INFO("remote_bitbang using protocol v2");
+	bitbang_interface = &remote_bitbang_bitbang_v2;
+	return ERROR_OK;
+}
+
 static int remote_bitbang_init_tcp(void)
 {
 	struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
@@ -279,6 +595,13 @@ static int remote_bitbang_init(void)
 
 	remote_bitbang_start = 0;
 	remote_bitbang_end = 0;
+	remote_bitbang_frame.bits = 0;
+	remote_bitbang_low_pending = false;
+	remote_bitbang_low_sample = false;
+	remote_bitbang_replies_head = 0;
+	remote_bitbang_replies_count = 0;
+	remote_bitbang_rx_bits = 0;
+	remote_bitbang_rx_pos = 0;
 
 	LOG_INFO("Initializing remote_bitbang driver");
 	if (remote_bitbang_port == NULL)
@@ -296,6 +619,11 @@ static int remote_bitbang_init(void)
 		return ERROR_FAIL;
 	}
 
+	if (remote_bitbang_negotiate() != ERROR_OK) {
+		fclose(remote_bitbang_file);
+		return ERROR_FAIL;
+	}
+
 	LOG_INFO("remote_bitbang driver initialized");
 	return ERROR_OK;
 }
@@ -322,6 +650,23 @@ COMMAND_HANDLER(remote_bitbang_handle_remote_bitbang_host_command)
 	return ERROR_COMMAND_SYNTAX_ERROR;
 }
 
+COMMAND_HANDLER(remote_bitbang_handle_remote_bitbang_protocol_command)
+{
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (strcmp(CMD_ARGV[0], "auto") == 0)
+		remote_bitbang_protocol = REMOTE_BITBANG_PROTOCOL_AUTO;
+	else if (strcmp(CMD_ARGV[0], "legacy") == 0)
+		remote_bitbang_protocol = REMOTE_BITBANG_PROTOCOL_LEGACY;
+	else if (strcmp(CMD_ARGV[0], "v2") == 0)
+		remote_bitbang_protocol = REMOTE_BITBANG_PROTOCOL_V2;
+	else
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	return ERROR_OK;
+}
+
 static const struct command_registration remote_bitbang_command_handlers[] = {
 	{
 		.name = "remote_bitbang_port",
@@ -339,12 +684,20 @@ static const struct command_registration remote_bitbang_command_handlers[] = {
 			"  if port is 0 or unset, this is the name of the unix socket to use.",
 		.usage = "host_name",
 	},
+	{
+		.name = "remote_bitbang_protocol",
+		.handler = remote_bitbang_handle_remote_bitbang_protocol_command,
+		.mode = COMMAND_CONFIG,
+		.help = "Select the protocol spoken with the remote jtag.\n"
+			"  auto (default) uses v2 if the server answers the version request.",
+		.usage = "('auto'|'legacy'|'v2')",
+	},
 	COMMAND_REGISTRATION_DONE,
 };
 
 struct jtag_interface remote_bitbang_interface = {
 	.name = "remote_bitbang",
-	.execute_queue = &bitbang_execute_queue,
+	.execute_queue = &remote_bitbang_execute_queue,
 	.transports = jtag_only,
 	.commands = remote_bitbang_command_handlers,
 	.init = &remote_bitbang_init,
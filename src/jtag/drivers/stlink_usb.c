@@ -86,6 +86,10 @@
  */
 #define MAX_WAIT_RETRIES 8
 
+/* 32 bit memory commands queued back to back by stlink_usb_mem32_burst() */
+#define STLINK_V2_MEM_BURST	4
+#define STLINKV3_MEM_BURST	8
+
 enum stlink_jtag_api_version {
 	STLINK_JTAG_API_V1 = 1,
 	STLINK_JTAG_API_V2,
@@ -2253,6 +2257,113 @@ static uint32_t stlink_max_block_size(uint32_t tar_autoincr_block, uint32_t addr
 	return max_tar_block;
 }
 
+/* Number of 32 bit memory commands to queue before checking their status,
+ * 1 if every command has to be checked on its own */
+static unsigned int stlink_usb_mem_burst(void *handle)
+{
+#ifdef USE_LIBUSB_ASYNCIO
+	struct stlink_usb_handle_s *h = handle;
+
+	/* a burst checks every chunk with GETLASTRWSTATUS2, older firmware
+	 * only has the status of the last command */
+	if (h->transport == HL_TRANSPORT_SWIM ||
+			!(h->version.flags & STLINK_F_HAS_GETLASTRWSTATUS2))
+		return 1;
+
+	return h->version.stlink == 3 ? STLINKV3_MEM_BURST : STLINK_V2_MEM_BURST;
+#else
+	return 1;
+#endif
+}
+
+#ifdef USE_LIBUSB_ASYNCIO
+/**
+ * Read or write up to stlink_usb_mem_burst() chunks of 32 bit memory,
+ * each bounded by the TAR autoincrement block, as one set of USB transfers.
+ * Every chunk is followed by its own GETLASTRWSTATUS2 request, the replies
+ * are checked once the whole burst has completed.
+ *
+ * @param addr word aligned address
+ * @param count bytes left to transfer, a multiple of 4
+ * @param done set to the number of bytes the burst covered
+ */
+static int stlink_usb_mem32_burst(void *handle, bool write, uint32_t addr,
+		uint32_t count, uint8_t *buffer, uint32_t *done)
+{
+	struct stlink_usb_handle_s *h = handle;
+	uint8_t cmds[STLINKV3_MEM_BURST][STLINK_CMD_SIZE_V2];
+	uint8_t status_cmds[STLINKV3_MEM_BURST][STLINK_CMD_SIZE_V2];
+	uint8_t status[STLINKV3_MEM_BURST][12];
+	uint32_t chunk_addr[STLINKV3_MEM_BURST];
+	struct jtag_xfer transfers[4 * STLINKV3_MEM_BURST];
+	unsigned int burst = stlink_usb_mem_burst(h);
+	unsigned int n_chunks = 0;
+	size_t n_transfers = 0;
+	uint32_t total = 0;
+
+	memset(cmds, 0, sizeof(cmds));
+	memset(status_cmds, 0, sizeof(status_cmds));
+	memset(transfers, 0, sizeof(transfers));
+
+	while (n_chunks < burst && total < count) {
+		unsigned int i = n_chunks++;
+		uint32_t len = MIN(stlink_max_block_size(h->max_mem_packet, addr + total),
+				count - total);
+
+		cmds[i][0] = STLINK_DEBUG_COMMAND;
+		cmds[i][1] = write ? STLINK_DEBUG_WRITEMEM_32BIT : STLINK_DEBUG_READMEM_32BIT;
+		h_u32_to_le(&cmds[i][2], addr + total);
+		h_u16_to_le(&cmds[i][6], len);
+		chunk_addr[i] = addr + total;
+
+		transfers[n_transfers].ep = h->tx_ep;
+		transfers[n_transfers].buf = cmds[i];
+		transfers[n_transfers].size = STLINK_CMD_SIZE_V2;
+		n_transfers++;
+
+		transfers[n_transfers].ep = write ? h->tx_ep : h->rx_ep;
+		transfers[n_transfers].buf = buffer + total;
+		transfers[n_transfers].size = len;
+		n_transfers++;
+
+		status_cmds[i][0] = STLINK_DEBUG_COMMAND;
+		status_cmds[i][1] = STLINK_DEBUG_APIV2_GETLASTRWSTATUS2;
+
+		transfers[n_transfers].ep = h->tx_ep;
+		transfers[n_transfers].buf = status_cmds[i];
+		transfers[n_transfers].size = STLINK_CMD_SIZE_V2;
+		n_transfers++;
+
+		transfers[n_transfers].ep = h->rx_ep;
+		transfers[n_transfers].buf = status[i];
+		transfers[n_transfers].size = sizeof(status[i]);
+		n_transfers++;
+
+		total += len;
+	}
+
+	int retval = jtag_libusb_bulk_transfer_n(h->fd, transfers, n_transfers,
+			STLINK_WRITE_TIMEOUT);
+	if (retval != ERROR_OK)
+		return retval;
+
+	/* report the first chunk that failed, the whole burst is retried
+	 * on a WAIT status */
+	for (unsigned int i = 0; i < n_chunks; i++) {
+		h->databuf[0] = status[i][0];
+		retval = stlink_usb_error_check(handle);
+		if (retval != ERROR_OK) {
+			LOG_DEBUG("%s of 32 bit chunk at 0x%08" PRIx32 " failed",
+					write ? "write" : "read", chunk_addr[i]);
+			return retval;
+		}
+	}
+
+	*done = total;
+	return ERROR_OK;
+}
+#endif
+
 static int stlink_usb_read_mem(void *handle, uint32_t addr, uint32_t size,
 		uint32_t count, uint8_t *buffer)
 {
@@ -2318,6 +2429,11 @@ static int stlink_usb_read_mem(void *handle, uint32_t addr, uint32_t size,
 				retval = stlink_usb_read_mem(handle, addr, 1, bytes_remaining, buffer);
 			else if (size == 2)
 				retval = stlink_usb_read_mem16(handle, addr, bytes_remaining, buffer);
+#ifdef USE_LIBUSB_ASYNCIO
+			else if (stlink_usb_mem_burst(h) > 1 && count > bytes_remaining)
+				retval = stlink_usb_mem32_burst(handle, false, addr,
+						count & ~3, buffer, &bytes_remaining);
+#endif
 			else
 				retval = stlink_usb_read_mem32(handle, addr, bytes_remaining, buffer);
 		} else
@@ -2403,6 +2519,11 @@ static int stlink_usb_write_mem(void *handle, uint32_t addr, uint32_t size,
 				retval = stlink_usb_write_mem(handle, addr, 1, bytes_remaining, buffer);
 			else if (size == 2)
 				retval = stlink_usb_write_mem16(handle, addr, bytes_remaining, buffer);
+#ifdef USE_LIBUSB_ASYNCIO
+			else if (stlink_usb_mem_burst(h) > 1 && count > bytes_remaining)
+				retval = stlink_usb_mem32_burst(handle, true, addr,
+						count & ~3, (uint8_t *)buffer, &bytes_remaining);
+#endif
 			else
 				retval = stlink_usb_write_mem32(handle, addr, bytes_remaining, buffer);
 
@@ -119,7 +119,7 @@ static int hl_interface_quit(void)
 	if (hl_if.layout->api->close)
 		hl_if.layout->api->close(hl_if.handle);
 
-	jtag_command_queue_reset();
+	jtag_queue_release(jtag_active_queue);
 
 	free((void *)hl_if.param.device_desc);
 	free((void *)hl_if.param.serial);
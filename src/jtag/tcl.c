@@ -854,6 +854,62 @@ COMMAND_HANDLER(handle_jtag_init_command)
 	return jtag_init(CMD_CTX);
 }
 
+COMMAND_HANDLER(handle_jtag_queue_stats_command)
+{
+	struct jtag_queue_stats stats;
+
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		if (strcmp(CMD_ARGV[0], "reset") != 0)
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		jtag_queue_clear_stats();
+		return ERROR_OK;
+	}
+
+	jtag_queue_get_stats(&stats);
+
+	command_print(CMD, "flushes:     %" PRIu64, stats.flushes);
+	command_print(CMD, "commands:    %" PRIu64 " (at most %u per flush)",
+			stats.commands, stats.max_commands);
+	command_print(CMD, "callbacks:   %" PRIu64, stats.callbacks);
+	command_print(CMD, "allocations: %" PRIu64 ", %" PRIu64 " bytes (at most %zu bytes per flush)",
+			stats.allocs, stats.alloc_bytes, stats.max_alloc_bytes);
+	if (stats.flushes)
+		command_print(CMD, "per flush:   %" PRIu64 " allocations, %" PRIu64 " bytes",
+				stats.allocs / stats.flushes, stats.alloc_bytes / stats.flushes);
+	command_print(CMD, "pages from malloc: %" PRIu64, stats.page_mallocs);
+
+	if (stats.optimized_flushes) {
+		command_print(CMD, "optimized flushes: %" PRIu64, stats.optimized_flushes);
+		command_print(CMD, "  commands:  %" PRIu64 " -> %" PRIu64,
+				stats.optimizer_commands_in, stats.optimizer_commands_out);
+		command_print(CMD, "  bits:      %" PRIu64 " -> %" PRIu64,
+				stats.optimizer_bits_in, stats.optimizer_bits_out);
+		command_print(CMD, "  IR scans elided: %" PRIu64, stats.ir_scans_elided);
+	}
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_jtag_queue_optimize_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		bool enable;
+		COMMAND_PARSE_ON_OFF(CMD_ARGV[0], enable);
+		jtag_queue_set_optimize(enable);
+	}
+
+	command_print(CMD, "queue optimizer %s",
+			jtag_queue_get_optimize() ? "on" : "off");
+
+	return ERROR_OK;
+}
+
 static const struct command_registration jtag_subcommand_handlers[] = {
 	{
 		.name = "init",
@@ -936,6 +992,22 @@ static const struct command_registration jtag_subcommand_handlers[] = {
 		.jim_handler = jim_jtag_names,
 		.help = "Returns list of all JTAG tap names.",
 	},
+	{
+		.name = "queue_stats",
+		.mode = COMMAND_ANY,
+		.handler = handle_jtag_queue_stats_command,
+		.help = "Show how many commands, callbacks and allocations "
+			"went through the JTAG command queue, or clear the counters.",
+		.usage = "['reset']",
+	},
+	{
+		.name = "queue_optimize",
+		.mode = COMMAND_ANY,
+		.handler = handle_jtag_queue_optimize_command,
+		.help = "Merge and drop redundant commands of the JTAG queue "
+			"before handing it to the adapter driver.",
+		.usage = "['on'|'off']",
+	},
 	{
 		.chain = jtag_command_handlers_to_move,
 	},
@@ -280,53 +280,82 @@ static int FreeRTOS_update_threads(struct rtos *rtos)
 	list_of_lists[num_lists++] = rtos->symbols[FreeRTOS_VAL_xSuspendedTaskList].address;
 	list_of_lists[num_lists++] = rtos->symbols[FreeRTOS_VAL_xTasksWaitingTermination].address;
 
+	/* Read the number of threads and the location of the first item of
+	 * all the lists at once, they don't depend on each other */
+	struct {
+		int64_t thread_count;
+		uint64_t first_elem_ptr;
+	} *list_heads = calloc(num_lists, sizeof(*list_heads));
+	struct target_memory_transfer *transfers = calloc(2 * num_lists, sizeof(*transfers));
+	if (!list_heads || !transfers) {
+		LOG_ERROR("Error allocating memory for %d lists", num_lists);
+		free(transfers);
+		free(list_heads);
+		free(list_of_lists);
+		return ERROR_FAIL;
+	}
+
+	unsigned int num_transfers = 0;
 	for (i = 0; i < num_lists; i++) {
 		if (list_of_lists[i] == 0)
 			continue;
-
-		/* Read the number of threads in this list */
-		int64_t list_thread_count = 0;
-		retval = target_read_buffer(rtos->target,
+		target_memory_transfer_init(&transfers[num_transfers++],
 				list_of_lists[i],
 				param->thread_count_width,
-				(uint8_t *)&list_thread_count);
-		if (retval != ERROR_OK) {
-			LOG_ERROR("Error reading number of threads in FreeRTOS thread list");
-			free(list_of_lists);
-			return retval;
-		}
+				(uint8_t *)&list_heads[i].thread_count);
+		target_memory_transfer_init(&transfers[num_transfers++],
+				list_of_lists[i] + param->list_next_offset,
+				param->pointer_width,
+				(uint8_t *)&list_heads[i].first_elem_ptr);
+	}
+
+	retval = target_read_memory_batch(rtos->target, transfers, num_transfers);
+	free(transfers);
+	if (retval != ERROR_OK) {
+		LOG_ERROR("Error reading FreeRTOS thread lists");
+		free(list_heads);
+		free(list_of_lists);
+		return retval;
+	}
+
+	for (i = 0; i < num_lists; i++) {
+		if (list_of_lists[i] == 0)
+			continue;
+
+		/* Number of threads in this list */
+		int64_t list_thread_count = list_heads[i].thread_count;
 		LOG_DEBUG("FreeRTOS: Read thread count for list %d at 0x%" PRIx64 ", value %" PRId64 "\r\n",
 										i, list_of_lists[i], list_thread_count);
 
 		if (list_thread_count == 0)
 			continue;
 
-		/* Read the location of first list item */
+		/* Location of first list item */
 		uint64_t prev_list_elem_ptr = -1;
-		uint64_t list_elem_ptr = 0;
-		retval = target_read_buffer(rtos->target,
-				list_of_lists[i] + param->list_next_offset,
-				param->pointer_width,
-				(uint8_t *)&list_elem_ptr);
-		if (retval != ERROR_OK) {
-			LOG_ERROR("Error reading first thread item location in FreeRTOS thread list");
-			free(list_of_lists);
-			return retval;
-		}
+		uint64_t list_elem_ptr = list_heads[i].first_elem_ptr;
 		LOG_DEBUG("FreeRTOS: Read first item for list %d at 0x%" PRIx64 ", value 0x%" PRIx64 "\r\n",
 										i, list_of_lists[i] + param->list_next_offset, list_elem_ptr);
 
 		while ((list_thread_count > 0) && (list_elem_ptr != 0) &&
 				(list_elem_ptr != prev_list_elem_ptr) &&
 				(tasks_found < thread_list_size)) {
-			/* Get the location of the thread structure. */
+			/* Get the location of the thread structure and of the next
+			 * list item together */
+			uint64_t next_list_elem_ptr = 0;
 			rtos->thread_details[tasks_found].threadid = 0;
-			retval = target_read_buffer(rtos->target,
+			struct target_memory_transfer elem_transfers[2];
+			target_memory_transfer_init(&elem_transfers[0],
 					list_elem_ptr + param->list_elem_content_offset,
 					param->pointer_width,
 					(uint8_t *)&(rtos->thread_details[tasks_found].threadid));
+			target_memory_transfer_init(&elem_transfers[1],
+					list_elem_ptr + param->list_elem_next_offset,
+					param->pointer_width,
+					(uint8_t *)&next_list_elem_ptr);
+			retval = target_read_memory_batch(rtos->target, elem_transfers, 2);
 			if (retval != ERROR_OK) {
 				LOG_ERROR("Error reading thread list item object in FreeRTOS thread list");
+				free(list_heads);
 				free(list_of_lists);
 				return retval;
 			}
@@ -346,6 +375,7 @@ static int FreeRTOS_update_threads(struct rtos *rtos)
 					(uint8_t *)&tmp_str);
 			if (retval != ERROR_OK) {
 				LOG_ERROR("Error reading first thread item location in FreeRTOS thread list");
+				free(list_heads);
 				free(list_of_lists);
 				return retval;
 			}
@@ -375,22 +405,14 @@ static int FreeRTOS_update_threads(struct rtos *rtos)
 			list_thread_count--;
 
 			prev_list_elem_ptr = list_elem_ptr;
-			list_elem_ptr = 0;
-			retval = target_read_buffer(rtos->target,
-					prev_list_elem_ptr + param->list_elem_next_offset,
-					param->pointer_width,
-					(uint8_t *)&list_elem_ptr);
-			if (retval != ERROR_OK) {
-				LOG_ERROR("Error reading next thread item location in FreeRTOS thread list");
-				free(list_of_lists);
-				return retval;
-			}
+			list_elem_ptr = next_list_elem_ptr;
 			LOG_DEBUG("FreeRTOS: Read next thread location at 0x%" PRIx64 ", value 0x%" PRIx64 "\r\n",
 										prev_list_elem_ptr + param->list_elem_next_offset,
 										list_elem_ptr);
 		}
 	}
 
+	free(list_heads);
 	free(list_of_lists);
 	rtos->thread_count = tasks_found;
 	return 0;
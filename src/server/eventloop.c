@@ -0,0 +1,324 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "eventloop.h"
+#include <helper/log.h>
+#include <helper/replacements.h>
+
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+
+/* growable array of registered sources, shared by the backends */
+struct source_list {
+	struct eventloop_source **items;
+	unsigned int count;
+	unsigned int size;
+};
+
+static int source_list_add(struct source_list *list, struct eventloop_source *source)
+{
+	if (list->count == list->size) {
+		unsigned int size = list->size ? list->size * 2 : 16;
+		struct eventloop_source **items = realloc(list->items, size * sizeof(*items));
+		if (items == NULL) {
+			LOG_ERROR("out of memory");
+			return ERROR_FAIL;
+		}
+		list->items = items;
+		list->size = size;
+	}
+
+	list->items[list->count++] = source;
+	return ERROR_OK;
+}
+
+static bool source_list_remove(struct source_list *list, struct eventloop_source *source)
+{
+	for (unsigned int i = 0; i < list->count; i++) {
+		if (list->items[i] == source) {
+			list->items[i] = list->items[--list->count];
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void source_list_free(struct source_list *list)
+{
+	free(list->items);
+	list->items = NULL;
+	list->count = 0;
+	list->size = 0;
+}
+
+static int eventloop_interrupted(void)
+{
+#ifdef _WIN32
+	errno = WSAGetLastError();
+	return errno == WSAEINTR;
+#else
+	return errno == EINTR;
+#endif
+}
+
+/* select() backend, available on every host */
+
+static struct source_list select_sources;
+
+static int select_init(void)
+{
+	return ERROR_OK;
+}
+
+static void select_quit(void)
+{
+	source_list_free(&select_sources);
+}
+
+static int select_add(struct eventloop_source *source)
+{
+	return source_list_add(&select_sources, source);
+}
+
+static int select_remove(struct eventloop_source *source)
+{
+	source_list_remove(&select_sources, source);
+	return ERROR_OK;
+}
+
+static int select_wait(int timeout_ms)
+{
+	fd_set read_fds;
+	int fd_max = 0;
+	struct timeval tv;
+
+	FD_ZERO(&read_fds);
+	for (unsigned int i = 0; i < select_sources.count; i++) {
+		int fd = select_sources.items[i]->fd;
+		FD_SET(fd, &read_fds);
+		if (fd > fd_max)
+			fd_max = fd;
+	}
+
+	tv.tv_sec = timeout_ms / 1000;
+	tv.tv_usec = (timeout_ms % 1000) * 1000;
+
+	int retval = socket_select(fd_max + 1, &read_fds, NULL, NULL, &tv);
+	if (retval == -1) {
+		if (eventloop_interrupted())
+			return 0;
+		LOG_ERROR("error during select: %s", strerror(errno));
+		return -1;
+	}
+
+	/* eCos leaves read_fds unchanged on timeout */
+	if (retval == 0)
+		return 0;
+
+	for (unsigned int i = 0; i < select_sources.count; i++) {
+		if (FD_ISSET(select_sources.items[i]->fd, &read_fds))
+			select_sources.items[i]->readable = true;
+	}
+
+	return retval;
+}
+
+static const struct eventloop_backend select_backend = {
+	.name = "select",
+	.init = select_init,
+	.quit = select_quit,
+	.add = select_add,
+	.remove = select_remove,
+	.wait = select_wait,
+};
+
+#ifdef HAVE_SYS_EPOLL_H
+
+/* epoll() backend: the kernel keeps the watch set between iterations */
+
+#define EPOLL_MAX_EVENTS	64
+
+static int epoll_fd = -1;
+
+/* descriptors epoll refuses to watch (regular files) are always readable */
+static struct source_list epoll_always_readable;
+
+static int epoll_init(void)
+{
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (epoll_fd == -1) {
+		LOG_DEBUG("epoll_create1 failed: %s", strerror(errno));
+		return ERROR_FAIL;
+	}
+
+	return ERROR_OK;
+}
+
+static void epoll_quit(void)
+{
+	if (epoll_fd != -1)
+		close(epoll_fd);
+	epoll_fd = -1;
+	source_list_free(&epoll_always_readable);
+}
+
+static int epoll_add(struct eventloop_source *source)
+{
+	struct epoll_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = source;
+
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, source->fd, &ev) == 0)
+		return ERROR_OK;
+
+	if (errno == EPERM)
+		return source_list_add(&epoll_always_readable, source);
+
+	LOG_ERROR("cannot watch fd %d: %s", source->fd, strerror(errno));
+	return ERROR_FAIL;
+}
+
+static int epoll_remove(struct eventloop_source *source)
+{
+	if (source_list_remove(&epoll_always_readable, source))
+		return ERROR_OK;
+
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_DEL, source->fd, NULL) != 0) {
+		LOG_ERROR("cannot stop watching fd %d: %s", source->fd, strerror(errno));
+		return ERROR_FAIL;
+	}
+
+	return ERROR_OK;
+}
+
+static int epoll_wait_sources(int timeout_ms)
+{
+	struct epoll_event events[EPOLL_MAX_EVENTS];
+
+	if (epoll_always_readable.count)
+		timeout_ms = 0;
+
+	int retval = epoll_wait(epoll_fd, events, EPOLL_MAX_EVENTS, timeout_ms);
+	if (retval == -1) {
+		if (errno == EINTR)
+			return 0;
+		LOG_ERROR("error during epoll_wait: %s", strerror(errno));
+		return -1;
+	}
+
+	for (int i = 0; i < retval; i++) {
+		struct eventloop_source *source = events[i].data.ptr;
+		source->readable = true;
+	}
+
+	for (unsigned int i = 0; i < epoll_always_readable.count; i++)
+		epoll_always_readable.items[i]->readable = true;
+
+	return retval + epoll_always_readable.count;
+}
+
+static const struct eventloop_backend epoll_backend = {
+	.name = "epoll",
+	.init = epoll_init,
+	.quit = epoll_quit,
+	.add = epoll_add,
+	.remove = epoll_remove,
+	.wait = epoll_wait_sources,
+};
+
+#endif /* HAVE_SYS_EPOLL_H */
+
+/* backends in order of preference; the first one that initializes wins */
+static const struct eventloop_backend * const eventloop_backends[] = {
+#ifdef HAVE_SYS_EPOLL_H
+	&epoll_backend,
+#endif
+	&select_backend,
+	NULL,
+};
+
+static const struct eventloop_backend *backend;
+
+int eventloop_init(void)
+{
+	for (unsigned int i = 0; eventloop_backends[i]; i++) {
+		if (eventloop_backends[i]->init() == ERROR_OK) {
+			backend = eventloop_backends[i];
+			LOG_DEBUG("using %s event loop", backend->name);
+			return ERROR_OK;
+		}
+	}
+
+	LOG_ERROR("no usable event loop backend");
+	return ERROR_FAIL;
+}
+
+void eventloop_quit(void)
+{
+	if (backend)
+		backend->quit();
+	backend = NULL;
+}
+
+const char *eventloop_backend_name(void)
+{
+	return backend ? backend->name : "none";
+}
+
+int eventloop_add(struct eventloop_source *source, int fd)
+{
+	source->fd = fd;
+	source->readable = false;
+	source->registered = false;
+
+	if (fd == -1)
+		return ERROR_OK;
+
+	int retval = backend->add(source);
+	if (retval == ERROR_OK)
+		source->registered = true;
+
+	return retval;
+}
+
+int eventloop_remove(struct eventloop_source *source)
+{
+	int retval = ERROR_OK;
+
+	if (source->registered)
+		retval = backend->remove(source);
+
+	source->registered = false;
+	source->readable = false;
+	source->fd = -1;
+
+	return retval;
+}
+
+int eventloop_wait(int timeout_ms)
+{
+	if (timeout_ms < 0)
+		timeout_ms = 0;
+
+	return backend->wait(timeout_ms);
+}
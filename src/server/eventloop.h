@@ -0,0 +1,67 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifndef OPENOCD_SERVER_EVENTLOOP_H
+#define OPENOCD_SERVER_EVENTLOOP_H
+
+#include <stdbool.h>
+
+/**
+ * A file descriptor watched by the server event loop.
+ *
+ * Sources are embedded in the objects that own the descriptor (services
+ * and connections) and are registered once, when the descriptor is
+ * created, instead of being collected again on every loop iteration.
+ */
+struct eventloop_source {
+	int fd;
+	/** set by the backend when @a fd has input, cleared by the consumer */
+	bool readable;
+	/** private to the backend */
+	bool registered;
+};
+
+/**
+ * Operations implemented by an event loop backend.
+ */
+struct eventloop_backend {
+	/** name used in log messages */
+	const char *name;
+	/** prepares the backend; may fail if not supported by the host */
+	int (*init)(void);
+	/** releases all backend resources */
+	void (*quit)(void);
+	/** starts watching @a source->fd for input */
+	int (*add)(struct eventloop_source *source);
+	/** stops watching @a source->fd; must be called before closing it */
+	int (*remove)(struct eventloop_source *source);
+	/**
+	 * Waits for input on any registered source for at most
+	 * @a timeout_ms milliseconds (0 only polls) and sets the
+	 * readable flag of the sources that have input pending.
+	 * @returns number of readable sources, 0 on timeout or -1 on error
+	 */
+	int (*wait)(int timeout_ms);
+};
+
+int eventloop_init(void);
+void eventloop_quit(void);
+const char *eventloop_backend_name(void);
+
+int eventloop_add(struct eventloop_source *source, int fd);
+int eventloop_remove(struct eventloop_source *source);
+int eventloop_wait(int timeout_ms);
+
+#endif /* OPENOCD_SERVER_EVENTLOOP_H */
@@ -70,6 +70,13 @@ struct gdb_connection {
 	char buffer[GDB_BUFFER_SIZE + 1]; /* Extra byte for nul-termination */
 	char *buf_p;
 	int buf_cnt;
+	/* incoming packet, gdb_max_packet_size bytes plus nul-termination */
+	char *packet_buffer;
+	/* reusable buffer for framed outgoing packets and memory reads */
+	char *out_buffer;
+	size_t out_buffer_size;
+	uint8_t *mem_buffer;
+	size_t mem_buffer_size;
 	int ctrl_c;
 	enum target_state frontend_state;
 	struct image *vflash_image;
@@ -94,6 +101,9 @@ struct gdb_connection {
 	struct target_desc_format target_desc;
 	/* temporarily used for thread list support */
 	char *thread_list;
+	/* last 'g' reply, valid until the target or its registers change */
+	char *reg_packet;
+	int reg_packet_size;
 };
 
 #if 0
@@ -139,6 +149,9 @@ static int gdb_report_register_access_error;
 /* enabled by default */
 static int gdb_use_target_description = 1;
 
+/* PacketSize announced in the qSupported reply */
+static unsigned int gdb_max_packet_size = GDB_PACKET_SIZE_DEFAULT;
+
 /* current processing free-run type, used by file-I/O */
 static char gdb_running_type;
 
@@ -354,11 +367,45 @@ static int gdb_write(struct connection *connection, void *data, int len)
 	return ERROR_SERVER_REMOTE_CLOSED;
 }
 
-static int gdb_put_packet_inner(struct connection *connection,
-		char *buffer, int len)
+/* grow a reusable per-connection buffer to at least @a size bytes */
+static int gdb_reserve_buffer(void **buffer, size_t *buffer_size, size_t size)
+{
+	if (size <= *buffer_size)
+		return ERROR_OK;
+
+	void *t = realloc(*buffer, size);
+	if (t == NULL) {
+		LOG_ERROR("out of memory");
+		return ERROR_FAIL;
+	}
+
+	*buffer = t;
+	*buffer_size = size;
+	return ERROR_OK;
+}
+
+static int gdb_reserve_out_buffer(struct gdb_connection *gdb_con, size_t size)
+{
+	return gdb_reserve_buffer((void **)&gdb_con->out_buffer, &gdb_con->out_buffer_size, size);
+}
+
+/* append '#' and the checksum to a frame started with '$' in out_buffer
+ * and return the total frame length */
+static size_t gdb_finish_frame(struct gdb_connection *gdb_con, size_t pos, unsigned char checksum)
+{
+	static const char hex_digits[] = "0123456789abcdef";
+
+	gdb_con->out_buffer[pos++] = '#';
+	gdb_con->out_buffer[pos++] = hex_digits[checksum >> 4];
+	gdb_con->out_buffer[pos++] = hex_digits[checksum & 0xf];
+
+	return pos;
+}
+
+/* Send the complete frame in the connection's out_buffer and wait for
+ * gdb to acknowledge it, resending on negative replies. */
+static int gdb_put_frame(struct connection *connection, size_t frame_len)
 {
-	int i;
-	unsigned char my_checksum = 0;
 #ifdef _DEBUG_GDB_IO_
 	char *debug_buffer;
 #endif
@@ -366,9 +413,6 @@ static int gdb_put_packet_inner(struct connection *connection,
 	int retval;
 	struct gdb_connection *gdb_con = connection->priv;
 
-	for (i = 0; i < len; i++)
-		my_checksum += buffer[i];
-
 #ifdef _DEBUG_GDB_IO_
 	/*
 	 * At this point we should have nothing in the input queue from GDB,
@@ -398,34 +442,16 @@ static int gdb_put_packet_inner(struct connection *connection,
 
 	while (1) {
 #ifdef _DEBUG_GDB_IO_
-		debug_buffer = strndup(buffer, len);
-		LOG_DEBUG("sending packet '$%s#%2.2x'", debug_buffer, my_checksum);
+		debug_buffer = strndup(gdb_con->out_buffer, frame_len);
+		LOG_DEBUG("sending packet '%s'", debug_buffer);
 		free(debug_buffer);
 #endif
 
-		char local_buffer[1024];
-		local_buffer[0] = '$';
-		if ((size_t)len + 4 <= sizeof(local_buffer)) {
-			/* performance gain on smaller packets by only a single call to gdb_write() */
-			memcpy(local_buffer + 1, buffer, len++);
-			len += snprintf(local_buffer + len, sizeof(local_buffer) - len, "#%02x", my_checksum);
-			retval = gdb_write(connection, local_buffer, len);
-			if (retval != ERROR_OK)
-				return retval;
-		} else {
-			/* larger packets are transmitted directly from caller supplied buffer
-			 * by several calls to gdb_write() to avoid dynamic allocation */
-			snprintf(local_buffer + 1, sizeof(local_buffer) - 1, "#%02x", my_checksum);
-			retval = gdb_write(connection, local_buffer, 1);
-			if (retval != ERROR_OK)
-				return retval;
-			retval = gdb_write(connection, buffer, len);
-			if (retval != ERROR_OK)
-				return retval;
-			retval = gdb_write(connection, local_buffer + 1, 3);
-			if (retval != ERROR_OK)
-				return retval;
-		}
+		/* the whole frame is written at once, so it goes out in as few
+		 * TCP segments as possible */
+		retval = gdb_write(connection, gdb_con->out_buffer, frame_len);
+		if (retval != ERROR_OK)
+			return retval;
 
 		if (gdb_con->noack_mode)
 			break;
@@ -477,6 +503,26 @@ static int gdb_put_packet_inner(struct connection *connection,
 	return ERROR_OK;
 }
 
+static int gdb_put_packet_inner(struct connection *connection,
+		char *buffer, int len)
+{
+	struct gdb_connection *gdb_con = connection->priv;
+	unsigned char my_checksum = 0;
+
+	if (gdb_reserve_out_buffer(gdb_con, len + 4) != ERROR_OK)
+		return ERROR_FAIL;
+
+	/* copy the payload into the frame and checksum it in the same pass */
+	char *out = gdb_con->out_buffer;
+	out[0] = '$';
+	for (int i = 0; i < len; i++) {
+		out[i + 1] = buffer[i];
+		my_checksum += buffer[i];
+	}
+
+	return gdb_put_frame(connection, gdb_finish_frame(gdb_con, len + 1, my_checksum));
+}
+
 int gdb_put_packet(struct connection *connection, char *buffer, int len)
 {
 	struct gdb_connection *gdb_con = connection->priv;
@@ -490,6 +536,94 @@ int gdb_put_packet(struct connection *connection, char *buffer, int len)
 	return retval;
 }
 
+/* characters with a special meaning that must be escaped in binary data */
+static inline bool gdb_binary_needs_escape(uint8_t c)
+{
+	return c == '#' || c == '$' || c == '}' || c == '*';
+}
+
+/**
+ * Send memory contents to gdb, hex encoded for 'm' packets or, for 'x'
+ * packets, as escaped and run-length encoded binary data prefixed by 'b'.
+ * The payload is encoded and checksummed in a single pass straight into
+ * the connection's output buffer. Binary replies are cut short rather
+ * than exceeding the announced PacketSize.
+ */
+static int gdb_put_memory_packet(struct connection *connection,
+		const uint8_t *data, uint32_t len, bool binary)
+{
+	static const char hex_digits[] = "0123456789abcdef";
+	struct gdb_connection *gdb_con = connection->priv;
+	unsigned char checksum = 0;
+	size_t pos = 1;
+
+	/* worst case is every byte escaped, plus '$', 'b' and "#xx" */
+	if (gdb_reserve_out_buffer(gdb_con, 2 * (size_t)len + 5) != ERROR_OK)
+		return ERROR_FAIL;
+
+	char *out = gdb_con->out_buffer;
+	out[0] = '$';
+
+	if (!binary) {
+		for (uint32_t i = 0; i < len; i++) {
+			out[pos] = hex_digits[data[i] >> 4];
+			out[pos + 1] = hex_digits[data[i] & 0xf];
+			checksum += out[pos] + out[pos + 1];
+			pos += 2;
+		}
+	} else {
+		size_t limit = gdb_max_packet_size + 1;
+		uint32_t i = 0;
+
+		out[pos++] = 'b';
+		checksum += 'b';
+
+		while (i < len) {
+			uint8_t c = data[i];
+
+			if (gdb_binary_needs_escape(c)) {
+				if (pos + 2 > limit)
+					break;
+				out[pos++] = '}';
+				out[pos++] = c ^ 0x20;
+				checksum += '}' + (c ^ 0x20);
+				i++;
+				continue;
+			}
+
+			if (pos + 1 > limit)
+				break;
+			out[pos++] = c;
+			checksum += c;
+			i++;
+
+			/* Repeats of the character just sent are encoded as '*'
+			 * followed by the repeat count plus 29, which has to be a
+			 * printable character other than '#' and '$'. */
+			uint32_t run = 0;
+			while (i + run < len && data[i + run] == c && run < 97)
+				run++;
+			if (run == 6 || run == 7)
+				run = 5;
+			if (run >= 3 && pos + 2 <= limit) {
+				out[pos++] = '*';
+				out[pos++] = run + 29;
+				checksum += '*' + run + 29;
+				i += run;
+			}
+		}
+	}
+
+	gdb_con->busy = true;
+	int retval = gdb_put_frame(connection, gdb_finish_frame(gdb_con, pos, checksum));
+	gdb_con->busy = false;
+
+	/* we sent some data, reset timer for keep alive messages */
+	kept_alive();
+
+	return retval;
+}
+
 static inline int fetch_packet(struct connection *connection,
 		int *checksum_ok, int noack, int *len, char *buffer)
 {
@@ -900,6 +1034,13 @@ static void gdb_frontend_halted(struct target *target, struct connection *connec
 	}
 }
 
+static void gdb_invalidate_reg_packet(struct gdb_connection *gdb_connection)
+{
+	free(gdb_connection->reg_packet);
+	gdb_connection->reg_packet = NULL;
+	gdb_connection->reg_packet_size = 0;
+}
+
 static int gdb_target_callback_event_handler(struct target *target,
 		enum target_event event, void *priv)
 {
@@ -909,6 +1050,9 @@ static int gdb_target_callback_event_handler(struct target *target,
 	if (gdb_service->target != target)
 		return ERROR_OK;
 
+	/* halts, resumes, resets... all make the registers stale */
+	gdb_invalidate_reg_packet(connection->priv);
+
 	switch (event) {
 		case TARGET_EVENT_GDB_HALT:
 			gdb_frontend_halted(target, connection);
@@ -949,6 +1093,19 @@ static int gdb_new_connection(struct connection *connection)
 	gdb_connection->target_desc.tdesc = NULL;
 	gdb_connection->target_desc.tdesc_length = 0;
 	gdb_connection->thread_list = NULL;
+	gdb_connection->reg_packet = NULL;
+	gdb_connection->reg_packet_size = 0;
+	gdb_connection->out_buffer = NULL;
+	gdb_connection->out_buffer_size = 0;
+	gdb_connection->mem_buffer = NULL;
+	gdb_connection->mem_buffer_size = 0;
+	gdb_connection->packet_buffer = malloc(gdb_max_packet_size + 1);
+	if (gdb_connection->packet_buffer == NULL) {
+		LOG_ERROR("Out of memory");
+		free(gdb_connection);
+		connection->priv = NULL;
+		return ERROR_FAIL;
+	}
 
 	/* send ACK to GDB for debug request */
 	gdb_write(connection, "+", 1);
@@ -1052,6 +1209,10 @@ static int gdb_connection_closed(struct connection *connection)
 	delete_debug_msg_receiver(connection->cmd_ctx, target);
 
 	if (connection->priv) {
+		free(gdb_connection->packet_buffer);
+		free(gdb_connection->out_buffer);
+		free(gdb_connection->reg_packet);
+		free(gdb_connection->mem_buffer);
 		free(connection->priv);
 		connection->priv = NULL;
 	} else
@@ -1125,7 +1286,7 @@ static void gdb_str_to_target(struct target *target,
 
 	for (i = 0; i < buf_len; i++) {
 		int j = gdb_reg_pos(target, i, buf_len);
-		tstr += sprintf(tstr, "%02x", buf[j]);
+		tstr += hexify(tstr, &buf[j], 1, 3);
 	}
 }
 
@@ -1140,20 +1301,32 @@ static void gdb_target_to_reg(struct target *target,
 
 	int i;
 	for (i = 0; i < str_len; i += 2) {
-		unsigned t;
-		if (sscanf(tstr + i, "%02x", &t) != 1) {
+		int j = gdb_reg_pos(target, i/2, str_len/2);
+		if (unhexify(&bin[j], tstr + i, 1) != 1) {
 			LOG_ERROR("BUG: unable to convert register value");
 			exit(-1);
 		}
+	}
+}
 
-		int j = gdb_reg_pos(target, i/2, str_len/2);
-		bin[j] = t;
+/* the cached 'g' reply can be sent again as long as no register was
+ * invalidated or modified behind the back of this connection */
+static bool gdb_reg_packet_valid(struct reg **reg_list, int reg_list_size)
+{
+	for (int i = 0; i < reg_list_size; i++) {
+		if (reg_list[i] == NULL || reg_list[i]->exist == false)
+			continue;
+		if (!reg_list[i]->valid || reg_list[i]->dirty)
+			return false;
 	}
+
+	return true;
 }
 
 static int gdb_get_registers_packet(struct connection *connection,
 		char const *packet, int packet_size)
 {
+	struct gdb_connection *gdb_connection = connection->priv;
 	struct target *target = get_target_from_connection(connection);
 	struct reg **reg_list;
 	int reg_list_size;
@@ -1175,12 +1348,27 @@ static int gdb_get_registers_packet(struct connection *connection,
 	if (retval != ERROR_OK)
 		return gdb_error(connection, retval);
 
+	if (gdb_connection->reg_packet) {
+		if (gdb_reg_packet_valid(reg_list, reg_list_size)) {
+			free(reg_list);
+			return gdb_put_packet(connection, gdb_connection->reg_packet,
+					gdb_connection->reg_packet_size);
+		}
+		gdb_invalidate_reg_packet(gdb_connection);
+	}
+
 	for (i = 0; i < reg_list_size; i++) {
 		if (reg_list[i] == NULL || reg_list[i]->exist == false)
 			continue;
 		reg_packet_size += DIV_ROUND_UP(reg_list[i]->size, 8) * 2;
 	}
 
+	/* let the target read the invalid registers in a batch, the
+	 * loop below gets whatever is left one by one */
+	retval = target_fetch_registers(target, reg_list, reg_list_size);
+	if (retval != ERROR_OK)
+		LOG_DEBUG("Couldn't fetch registers in a batch.");
+
 	assert(reg_packet_size > 0);
 
 	reg_packet = malloc(reg_packet_size + 1); /* plus one for string termination null */
@@ -1215,7 +1403,13 @@ static int gdb_get_registers_packet(struct connection *connection,
 #endif
 
 	gdb_put_packet(connection, reg_packet, reg_packet_size);
-	free(reg_packet);
+
+	/* keep the reply if every value in it came from the target */
+	if (gdb_reg_packet_valid(reg_list, reg_list_size)) {
+		gdb_connection->reg_packet = reg_packet;
+		gdb_connection->reg_packet_size = reg_packet_size;
+	} else
+		free(reg_packet);
 
 	free(reg_list);
 
@@ -1401,17 +1595,21 @@ static int gdb_error(struct connection *connection, int retval)
 
 /* We don't have to worry about the default 2 second timeout for GDB packets,
  * because GDB breaks up large memory reads into smaller reads.
+ *
+ * Both the hex encoded 'm' packet and the binary 'x' packet are handled here.
  */
 static int gdb_read_memory_packet(struct connection *connection,
 		char const *packet, int packet_size)
 {
 	struct target *target = get_target_from_connection(connection);
+	struct gdb_connection *gdb_con = connection->priv;
+	bool binary = packet[0] == 'x';
 	char *separator;
 	uint64_t addr = 0;
 	uint32_t len = 0;
+	uint32_t max_len;
 
 	uint8_t *buffer;
-	char *hex_buffer;
 
 	int retval = ERROR_OK;
 
@@ -1428,12 +1626,27 @@ static int gdb_read_memory_packet(struct connection *connection,
 	len = strtoul(separator + 1, NULL, 16);
 
 	if (!len) {
+		/* gdb probes 'x' support with a zero length read and takes an
+		 * empty reply as "not supported", so answer with an empty
+		 * binary payload; only 'm' gets the empty reply */
+		if (binary) {
+			gdb_put_packet(connection, "b", 1);
+			return ERROR_OK;
+		}
 		LOG_WARNING("invalid read memory packet received (len == 0)");
 		gdb_put_packet(connection, "", 0);
 		return ERROR_OK;
 	}
 
-	buffer = malloc(len);
+	/* gdb accepts shorter replies, never read more than fits into one */
+	max_len = binary ? gdb_max_packet_size - 1 : gdb_max_packet_size / 2;
+	if (len > max_len)
+		len = max_len;
+
+	retval = gdb_reserve_buffer((void **)&gdb_con->mem_buffer, &gdb_con->mem_buffer_size, len);
+	if (retval != ERROR_OK)
+		return gdb_error(connection, retval);
+	buffer = gdb_con->mem_buffer;
 
 	LOG_DEBUG("addr: 0x%16.16" PRIx64 ", len: 0x%8.8" PRIx32 "", addr, len);
 
@@ -1457,19 +1670,11 @@ static int gdb_read_memory_packet(struct connection *connection,
 		retval = ERROR_OK;
 	}
 
-	if (retval == ERROR_OK) {
-		hex_buffer = malloc(len * 2 + 1);
-
-		size_t pkt_len = hexify(hex_buffer, buffer, len, len * 2 + 1);
-
-		gdb_put_packet(connection, hex_buffer, pkt_len);
-
-		free(hex_buffer);
-	} else
+	if (retval == ERROR_OK)
+		gdb_put_memory_packet(connection, buffer, len, binary);
+	else
 		retval = gdb_error(connection, retval);
 
-	free(buffer);
-
 	return retval;
 }
 
@@ -2605,8 +2810,8 @@ static int gdb_query_packet(struct connection *connection,
 			&buffer,
 			&pos,
 			&size,
-			"PacketSize=%x;qXfer:memory-map:read%c;qXfer:features:read%c;qXfer:threads:read+;QStartNoAckMode+;vContSupported+",
-			GDB_BUFFER_SIZE,
+			"PacketSize=%x;qXfer:memory-map:read%c;qXfer:features:read%c;qXfer:threads:read+;QStartNoAckMode+;vContSupported+;binary-upload+",
+			gdb_max_packet_size,
 			((gdb_use_memory_map == 1) && (flash_get_bank_count() > 0)) ? '+' : '-',
 			(gdb_target_desc_supported == 1) ? '+' : '-');
 
@@ -3108,14 +3313,12 @@ static void gdb_sig_halted(struct connection *connection)
 
 static int gdb_input_inner(struct connection *connection)
 {
-	/* Do not allocate this on the stack */
-	static char gdb_packet_buffer[GDB_BUFFER_SIZE + 1]; /* Extra byte for nul-termination */
-
+	struct gdb_connection *gdb_con = connection->priv;
+	char *gdb_packet_buffer = gdb_con->packet_buffer;
 	struct target *target;
 	char const *packet = gdb_packet_buffer;
 	int packet_size;
 	int retval;
-	struct gdb_connection *gdb_con = connection->priv;
 	static int extended_protocol;
 
 	target = get_target_from_connection(connection);
@@ -3132,7 +3335,7 @@ static int gdb_input_inner(struct connection *connection)
 	 * drain the rest of the buffer.
 	 */
 	do {
-		packet_size = GDB_BUFFER_SIZE;
+		packet_size = gdb_max_packet_size;
 		retval = gdb_get_packet(connection, gdb_packet_buffer, &packet_size);
 		if (retval != ERROR_OK)
 			return retval;
@@ -3155,6 +3358,11 @@ static int gdb_input_inner(struct connection *connection)
 
 		if (packet_size > 0) {
 			retval = ERROR_OK;
+
+			/* anything but reads may change the registers */
+			if (strchr("gpmx", packet[0]) == NULL)
+				gdb_invalidate_reg_packet(gdb_con);
+
 			switch (packet[0]) {
 				case 'T':	/* Is thread alive? */
 					gdb_thread_packet(connection, packet, packet_size);
@@ -3182,6 +3390,7 @@ static int gdb_input_inner(struct connection *connection)
 					retval = gdb_set_register_packet(connection, packet, packet_size);
 					break;
 				case 'm':
+				case 'x':
 					retval = gdb_read_memory_packet(connection, packet, packet_size);
 					break;
 				case 'M':
@@ -3534,6 +3743,27 @@ COMMAND_HANDLER(handle_gdb_report_data_abort_command)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(handle_gdb_max_packet_size_command)
+{
+	if (CMD_ARGC == 0) {
+		command_print(CMD, "%u", gdb_max_packet_size);
+		return ERROR_OK;
+	}
+
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	unsigned int size;
+	COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], size);
+	if (size < GDB_BUFFER_SIZE) {
+		LOG_ERROR("gdb packet size must be at least %d bytes", GDB_BUFFER_SIZE);
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+
+	gdb_max_packet_size = size;
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(handle_gdb_report_register_access_error)
 {
 	if (CMD_ARGC != 1)
@@ -3664,6 +3894,13 @@ static const struct command_registration gdb_command_handlers[] = {
 		.help = "enable or disable reporting data aborts",
 		.usage = "('enable'|'disable')"
 	},
+	{
+		.name = "gdb_max_packet_size",
+		.handler = handle_gdb_max_packet_size_command,
+		.mode = COMMAND_CONFIG,
+		.help = "Display or set the maximum packet size announced to gdb",
+		.usage = "[size]",
+	},
 	{
 		.name = "gdb_report_register_access_error",
 		.handler = handle_gdb_report_register_access_error,
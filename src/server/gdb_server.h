@@ -33,6 +33,8 @@ struct reg;
 #include <target/target.h>
 
 #define GDB_BUFFER_SIZE 16384
+/* default PacketSize announced to gdb, see the gdb_max_packet_size command */
+#define GDB_PACKET_SIZE_DEFAULT 65536
 
 int gdb_target_add_all(struct target *target);
 int gdb_register_commands(struct command_context *command_context);
@@ -27,6 +27,7 @@
 #endif
 
 #include "server.h"
+#include <helper/time_support.h>
 #include <target/target.h>
 #include <target/target_request.h>
 #include <target/openrisc/jsp_server.h>
@@ -57,12 +58,14 @@ static enum shutdown_reason shutdown_openocd = CONTINUE_MAIN_LOOP;
 /* store received signal to exit application by killing ourselves */
 static int last_signal;
 
-/* set the polling period to 100ms */
+/* longest time the server loop may sleep, 100ms by default */
 static int polling_period = 100;
 
 /* address by name on which to listen for incoming TCP/IP connections */
 static char *bindto_name;
 
+static int remove_connection(struct service *service, struct connection *connection);
+
 static int add_connection(struct service *service, struct command_context *cmd_ctx)
 {
 	socklen_t address_size;
@@ -77,6 +80,9 @@ static int add_connection(struct service *service, struct command_context *cmd_c
 	c->cmd_ctx = copy_command_context(cmd_ctx);
 	c->service = service;
 	c->input_pending = 0;
+	c->ev.fd = -1;
+	c->ev.readable = false;
+	c->ev.registered = false;
 	c->priv = NULL;
 	c->next = NULL;
 
@@ -116,6 +122,7 @@ static int add_connection(struct service *service, struct command_context *cmd_c
 #endif
 
 		/* do not check for new connections again on stdin */
+		eventloop_remove(&service->ev);
 		service->fd = -1;
 
 		LOG_INFO("accepting '%s' connection from pipe", service->name);
@@ -129,6 +136,7 @@ static int add_connection(struct service *service, struct command_context *cmd_c
 	} else if (service->type == CONNECTION_PIPE) {
 		c->fd = service->fd;
 		/* do not check for new connections again on stdin */
+		eventloop_remove(&service->ev);
 		service->fd = -1;
 
 		char *out_file = alloc_printf("%so", service->port);
@@ -159,6 +167,12 @@ static int add_connection(struct service *service, struct command_context *cmd_c
 	if (service->max_connections != CONNECTION_LIMIT_UNLIMITED)
 		service->max_connections--;
 
+	retval = eventloop_add(&c->ev, c->fd);
+	if (retval != ERROR_OK) {
+		remove_connection(service, c);
+		return retval;
+	}
+
 	return ERROR_OK;
 }
 
@@ -171,11 +185,13 @@ static int remove_connection(struct service *service, struct connection *connect
 	while ((c = *p)) {
 		if (c->fd == connection->fd) {
 			service->connection_closed(c);
+			eventloop_remove(&c->ev);
 			if (service->type == CONNECTION_TCP)
 				close_socket(c->fd);
 			else if (service->type == CONNECTION_PIPE) {
 				/* The service will listen to the pipe again */
 				c->service->fd = c->fd;
+				eventloop_add(&c->service->ev, c->service->fd);
 			}
 
 			command_done(c->cmd_ctx);
@@ -222,6 +238,9 @@ int add_service(char *name,
 	c->port = strdup(port);
 	c->max_connections = 1;	/* Only TCP/IP ports can support more than one connection */
 	c->fd = -1;
+	c->ev.fd = -1;
+	c->ev.readable = false;
+	c->ev.registered = false;
 	c->connections = NULL;
 	c->new_connection = new_connection_handler;
 	c->input = input_handler;
@@ -341,6 +360,13 @@ int add_service(char *name,
 #endif
 	}
 
+	if (eventloop_add(&c->ev, c->fd) != ERROR_OK) {
+		if (c->type != CONNECTION_STDINOUT)
+			close_socket(c->fd);
+		free_service(c);
+		return ERROR_FAIL;
+	}
+
 	/* add to the end of linked list */
 	for (p = &services; *p; p = &(*p)->next)
 		;
@@ -380,6 +406,7 @@ int remove_service(const char *name, const char *port)
 			else
 				prev->next = tmp->next;
 
+			eventloop_remove(&tmp->ev);
 			if (tmp->type != CONNECTION_STDINOUT)
 				close_socket(tmp->fd);
 
@@ -402,6 +429,7 @@ static int remove_services(void)
 		struct service *next = c->next;
 
 		remove_connections(c);
+		eventloop_remove(&c->ev);
 
 		if (c->name)
 			free(c->name);
@@ -428,15 +456,21 @@ static int remove_services(void)
 	return ERROR_OK;
 }
 
-int server_loop(struct command_context *command_context)
+static bool server_input_pending(void)
 {
-	struct service *service;
+	for (struct service *service = services; service; service = service->next) {
+		for (struct connection *c = service->connections; c; c = c->next) {
+			if (c->input_pending)
+				return true;
+		}
+	}
 
-	bool poll_ok = true;
+	return false;
+}
 
-	/* used in select() */
-	fd_set read_fds;
-	int fd_max;
+int server_loop(struct command_context *command_context)
+{
+	struct service *service;
 
 	/* used in accept() */
 	int retval;
@@ -447,98 +481,44 @@ int server_loop(struct command_context *command_context)
 #endif
 
 	while (shutdown_openocd == CONTINUE_MAIN_LOOP) {
-		/* monitor sockets for activity */
-		fd_max = 0;
-		FD_ZERO(&read_fds);
-
-		/* add service and connection fds to read_fds */
-		for (service = services; service; service = service->next) {
-			if (service->fd != -1) {
-				/* listen for new connections */
-				FD_SET(service->fd, &read_fds);
-
-				if (service->fd > fd_max)
-					fd_max = service->fd;
-			}
-
-			if (service->connections) {
-				struct connection *c;
+		/* Sleep until the next timer callback is due, but at most for
+		 * the polling period (can be changed with "poll_period" command)
+		 * so that Jim events keep being processed.
+		 */
+		int64_t timeout_ms = target_timer_next_event() - timeval_ms();
+		if (timeout_ms > polling_period)
+			timeout_ms = polling_period;
 
-				for (c = service->connections; c; c = c->next) {
-					/* check for activity on the connection */
-					FD_SET(c->fd, &read_fds);
-					if (c->fd > fd_max)
-						fd_max = c->fd;
-				}
-			}
-		}
+		/* Drain DCC messages and buffered input without sleeping,
+		 * this greatly improves performance of DCC.
+		 */
+		if (target_got_message() || server_input_pending())
+			timeout_ms = 0;
 
-		struct timeval tv;
-		tv.tv_sec = 0;
-		if (poll_ok) {
-			/* we're just polling this iteration, this is faster on embedded
-			 * hosts */
-			tv.tv_usec = 0;
-			retval = socket_select(fd_max + 1, &read_fds, NULL, NULL, &tv);
-		} else {
-			/* Every 100ms, can be changed with "poll_period" command */
-			tv.tv_usec = polling_period * 1000;
+		if (timeout_ms > 0) {
 			/* Only while we're sleeping we'll let others run */
 			openocd_sleep_prelude();
 			kept_alive();
-			retval = socket_select(fd_max + 1, &read_fds, NULL, NULL, &tv);
+			retval = eventloop_wait(timeout_ms);
 			openocd_sleep_postlude();
-		}
-
-		if (retval == -1) {
-#ifdef _WIN32
-
-			errno = WSAGetLastError();
+		} else
+			retval = eventloop_wait(0);
 
-			if (errno == WSAEINTR)
-				FD_ZERO(&read_fds);
-			else {
-				LOG_ERROR("error during select: %s", strerror(errno));
-				return ERROR_FAIL;
-			}
-#else
+		if (retval == -1)
+			return ERROR_FAIL;
 
-			if (errno == EINTR)
-				FD_ZERO(&read_fds);
-			else {
-				LOG_ERROR("error during select: %s", strerror(errno));
-				return ERROR_FAIL;
-			}
-#endif
-		}
+		/* Timer callbacks run as soon as they are due, even while
+		 * clients keep the server busy */
+		target_call_timer_callbacks();
 
-		if (retval == 0) {
-			/* We only execute these callbacks when there was nothing to do or we timed
-			 *out */
-			target_call_timer_callbacks();
+		/* Jim events are only processed when there was nothing to do */
+		if (retval == 0)
 			process_jim_events(command_context);
 
-			FD_ZERO(&read_fds);	/* eCos leaves read_fds unchanged in this case!  */
-
-			/* We timed out/there was nothing to do, timeout rather than poll next time
-			 **/
-			poll_ok = false;
-		} else {
-			/* There was something to do, next time we'll just poll */
-			poll_ok = true;
-		}
-
-		/* This is a simple back-off algorithm where we immediately
-		 * re-poll if we did something this time around.
-		 *
-		 * This greatly improves performance of DCC.
-		 */
-		poll_ok = poll_ok || target_got_message();
-
 		for (service = services; service; service = service->next) {
 			/* handle new connections on listeners */
-			if ((service->fd != -1)
-				&& (FD_ISSET(service->fd, &read_fds))) {
+			if (service->ev.readable) {
+				service->ev.readable = false;
 				if (service->max_connections != 0)
 					add_connection(service, command_context);
 				else {
@@ -562,7 +542,8 @@ int server_loop(struct command_context *command_context)
 				struct connection *c;
 
 				for (c = service->connections; c; ) {
-					if ((FD_ISSET(c->fd, &read_fds)) || c->input_pending) {
+					if (c->ev.readable || c->input_pending) {
+						c->ev.readable = false;
 						retval = service->input(c);
 						if (retval != ERROR_OK) {
 							struct connection *next = c->next;
@@ -662,7 +643,7 @@ int server_preinit(void)
 	signal(SIGTERM, sig_handler);
 	signal(SIGABRT, sig_handler);
 
-	return ERROR_OK;
+	return eventloop_init();
 }
 
 int server_init(struct command_context *cmd_ctx)
@@ -685,6 +666,7 @@ int server_init(struct command_context *cmd_ctx)
 int server_quit(void)
 {
 	remove_services();
+	eventloop_quit();
 	target_quit();
 
 #ifdef _WIN32
@@ -31,6 +31,8 @@
 
 #include <helper/log.h>
 
+#include "eventloop.h"
+
 #ifdef HAVE_NETINET_IN_H
 #include <netinet/in.h>
 #endif
@@ -50,6 +52,7 @@ struct connection {
 	struct command_context *cmd_ctx;
 	struct service *service;
 	int input_pending;
+	struct eventloop_source ev;
 	void *priv;
 	struct connection *next;
 };
@@ -66,6 +69,7 @@ struct service {
 	int fd;
 	struct sockaddr_in sin;
 	int max_connections;
+	struct eventloop_source ev;
 	struct connection *connections;
 	new_connection_handler_t new_connection;
 	input_handler_t input;
@@ -28,6 +28,19 @@
 #define TCL_LINE_INITIAL		(4*1024)
 #define TCL_LINE_MAX			(4*1024*1024)
 
+/* framed mode: requests are a little endian length and request id
+ * followed by the command, replies a length, the id, the kind of reply
+ * and a status, followed by the result */
+#define TCL_FRAME_REQUEST_HEADER	8
+#define TCL_FRAME_REPLY_HEADER		12
+
+#define TCL_FRAME_TEXT			0
+#define TCL_FRAME_BINARY		1
+#define TCL_FRAME_NOTIFICATION	2
+
+#define TCL_FRAME_OK			0
+#define TCL_FRAME_ERROR			1
+
 struct tcl_connection {
 	int tc_linedrop;
 	int tc_lineoffset;
@@ -37,6 +50,17 @@ struct tcl_connection {
 	enum target_state tc_laststate;
 	bool tc_notify;
 	bool tc_trace;
+	/* framed mode, requested with tcl_framing */
+	bool tc_framed;
+	/* result of the current request is binary */
+	bool tc_binary;
+	/* bytes of an oversized request still to be dropped */
+	uint32_t tc_skip;
+	/* replies collected while processing the input of one read */
+	bool tc_batching;
+	char *tc_out;
+	size_t tc_out_size;
+	size_t tc_out_used;
 };
 
 static char *tcl_port;
@@ -47,6 +71,70 @@ static int tcl_input(struct connection *connection);
 static int tcl_output(struct connection *connection, const void *buf, ssize_t len);
 static int tcl_closed(struct connection *connection);
 
+static int tcl_frame_flush(struct connection *connection)
+{
+	struct tcl_connection *tclc = connection->priv;
+	int retval = ERROR_OK;
+
+	if (tclc->tc_out_used)
+		retval = tcl_output(connection, tclc->tc_out, tclc->tc_out_used);
+	tclc->tc_out_used = 0;
+
+	return retval;
+}
+
+/* queue a framed reply; it is sent at the end of the current batch of
+ * requests, or right away outside of one */
+static int tcl_frame_reply(struct connection *connection, uint32_t id,
+		uint8_t kind, uint8_t status, const void *data, size_t len)
+{
+	struct tcl_connection *tclc = connection->priv;
+	size_t needed = tclc->tc_out_used + TCL_FRAME_REPLY_HEADER + len;
+
+	if (needed > tclc->tc_out_size) {
+		size_t size = MAX(needed, 2 * tclc->tc_out_size);
+		char *out = realloc(tclc->tc_out, size);
+		if (out == NULL) {
+			LOG_ERROR("Out of memory");
+			return ERROR_FAIL;
+		}
+		tclc->tc_out = out;
+		tclc->tc_out_size = size;
+	}
+
+	uint8_t *header = (uint8_t *)tclc->tc_out + tclc->tc_out_used;
+	h_u32_to_le(header, len);
+	h_u32_to_le(header + 4, id);
+	header[8] = kind;
+	header[9] = status;
+	header[10] = 0;
+	header[11] = 0;
+	if (len)
+		memcpy(header + TCL_FRAME_REPLY_HEADER, data, len);
+	tclc->tc_out_used = needed;
+
+	if (tclc->tc_batching)
+		return ERROR_OK;
+
+	return tcl_frame_flush(connection);
+}
+
+/* send an asynchronous message, "\r\n\x1a" terminated in text mode */
+static int tcl_notify(struct connection *connection, const char *msg)
+{
+	struct tcl_connection *tclc = connection->priv;
+
+	if (tclc->tc_framed)
+		return tcl_frame_reply(connection, 0, TCL_FRAME_NOTIFICATION,
+				TCL_FRAME_OK, msg, strlen(msg));
+
+	int retval = tcl_output(connection, msg, strlen(msg));
+	if (retval == ERROR_OK)
+		retval = tcl_output(connection, "\r\n\x1a", 3);
+
+	return retval;
+}
+
 static int tcl_target_callback_event_handler(struct target *target,
 		enum target_event event, void *priv)
 {
@@ -57,15 +145,15 @@ static int tcl_target_callback_event_handler(struct target *target,
 	tclc = connection->priv;
 
 	if (tclc->tc_notify) {
-		snprintf(buf, sizeof(buf), "type target_event event %s\r\n\x1a", target_event_name(event));
-		tcl_output(connection, buf, strlen(buf));
+		snprintf(buf, sizeof(buf), "type target_event event %s", target_event_name(event));
+		tcl_notify(connection, buf);
 	}
 
 	if (tclc->tc_laststate != target->state) {
 		tclc->tc_laststate = target->state;
 		if (tclc->tc_notify) {
-			snprintf(buf, sizeof(buf), "type target_state state %s\r\n\x1a", target_state_name(target));
-			tcl_output(connection, buf, strlen(buf));
+			snprintf(buf, sizeof(buf), "type target_state state %s", target_state_name(target));
+			tcl_notify(connection, buf);
 		}
 	}
 
@@ -82,8 +170,8 @@ static int tcl_target_callback_reset_handler(struct target *target,
 	tclc = connection->priv;
 
 	if (tclc->tc_notify) {
-		snprintf(buf, sizeof(buf), "type target_reset mode %s\r\n\x1a", target_reset_mode_name(reset_mode));
-		tcl_output(connection, buf, strlen(buf));
+		snprintf(buf, sizeof(buf), "type target_reset mode %s", target_reset_mode_name(reset_mode));
+		tcl_notify(connection, buf);
 	}
 
 	return ERROR_OK;
@@ -95,9 +183,8 @@ static int tcl_target_callback_trace_handler(struct target *target,
 	struct connection *connection = priv;
 	struct tcl_connection *tclc;
 	char *header = "type target_trace data ";
-	char *trailer = "\r\n\x1a";
 	size_t hex_len = len * 2 + 1;
-	size_t max_len = hex_len + strlen(header) + strlen(trailer);
+	size_t max_len = hex_len + strlen(header);
 	char *buf, *hex;
 
 	tclc = connection->priv;
@@ -106,8 +193,8 @@ static int tcl_target_callback_trace_handler(struct target *target,
 		hex = malloc(hex_len);
 		buf = malloc(max_len);
 		hexify(hex, data, len, hex_len);
-		snprintf(buf, max_len, "%s%s%s", header, hex, trailer);
-		tcl_output(connection, buf, strlen(buf));
+		snprintf(buf, max_len, "%s%s", header, hex);
+		tcl_notify(connection, buf);
 		free(hex);
 		free(buf);
 	}
@@ -171,6 +258,113 @@ static int tcl_new_connection(struct connection *connection)
 	return ERROR_OK;
 }
 
+/* make room for @a size bytes of input */
+static int tcl_line_reserve(struct tcl_connection *tclc, int size)
+{
+	if (size <= tclc->tc_line_size)
+		return ERROR_OK;
+
+	char *tc_line_new = realloc(tclc->tc_line, size);
+	if (tc_line_new == NULL)
+		return ERROR_FAIL;
+
+	tclc->tc_line = tc_line_new;
+	tclc->tc_line_size = size;
+	return ERROR_OK;
+}
+
+static int tcl_run_request(struct connection *connection, uint32_t id, char *cmd)
+{
+	Jim_Interp *interp = (Jim_Interp *)connection->cmd_ctx->interp;
+	struct tcl_connection *tclc = connection->priv;
+	const char *result;
+	int reslen;
+
+	tclc->tc_binary = false;
+	int retval = command_run_line(connection->cmd_ctx, cmd);
+	result = Jim_GetString(Jim_GetResult(interp), &reslen);
+
+	int status = (retval == ERROR_OK || retval == ERROR_COMMAND_CLOSE_CONNECTION) ?
+			TCL_FRAME_OK : TCL_FRAME_ERROR;
+	int kind = tclc->tc_binary ? TCL_FRAME_BINARY : TCL_FRAME_TEXT;
+	int ret = tcl_frame_reply(connection, id, kind, status, result, reslen);
+
+	/* "exit" ends the connection once its reply is out */
+	if (ret == ERROR_OK && retval == ERROR_COMMAND_CLOSE_CONNECTION)
+		ret = ERROR_SERVER_REMOTE_CLOSED;
+
+	return ret;
+}
+
+/* run every complete request of the framed input, replying in order */
+static int tcl_input_framed(struct connection *connection, const unsigned char *in, int len)
+{
+	struct tcl_connection *tclc = connection->priv;
+	int retval = ERROR_OK;
+
+	if (tclc->tc_skip) {
+		uint32_t n = MIN(tclc->tc_skip, (uint32_t)len);
+		tclc->tc_skip -= n;
+		in += n;
+		len -= n;
+	}
+
+	/* one more byte, to terminate the last command in place */
+	if (tcl_line_reserve(tclc, tclc->tc_lineoffset + len + 1) != ERROR_OK) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+	memcpy(tclc->tc_line + tclc->tc_lineoffset, in, len);
+	tclc->tc_lineoffset += len;
+
+	tclc->tc_batching = true;
+
+	int offset = 0;
+	while (retval == ERROR_OK && tclc->tc_lineoffset - offset >= TCL_FRAME_REQUEST_HEADER) {
+		uint8_t *header = (uint8_t *)tclc->tc_line + offset;
+		uint32_t size = le_to_h_u32(header);
+		uint32_t id = le_to_h_u32(header + 4);
+		int available = tclc->tc_lineoffset - offset - TCL_FRAME_REQUEST_HEADER;
+
+		if (size >= TCL_LINE_MAX) {
+			static const char msg[] = "request too large";
+
+			retval = tcl_frame_reply(connection, id, TCL_FRAME_TEXT,
+					TCL_FRAME_ERROR, msg, strlen(msg));
+			tclc->tc_skip = size - MIN(size, (uint32_t)available);
+			offset = tclc->tc_lineoffset;
+			break;
+		}
+
+		/* the rest of the request is yet to come */
+		if ((uint32_t)available < size)
+			break;
+
+		/* terminate the command in place, saving the byte after it
+		 * which may start the next request */
+		char *cmd = tclc->tc_line + offset + TCL_FRAME_REQUEST_HEADER;
+		char saved = cmd[size];
+		cmd[size] = '\0';
+
+		retval = tcl_run_request(connection, id, cmd);
+
+		cmd[size] = saved;
+		offset += TCL_FRAME_REQUEST_HEADER + size;
+	}
+
+	tclc->tc_lineoffset -= offset;
+	memmove(tclc->tc_line, tclc->tc_line + offset, tclc->tc_lineoffset);
+
+	tclc->tc_batching = false;
+	if (retval == ERROR_OK || retval == ERROR_SERVER_REMOTE_CLOSED) {
+		int ret = tcl_frame_flush(connection);
+		if (ret != ERROR_OK)
+			retval = ret;
+	}
+
+	return retval;
+}
+
 static int tcl_input(struct connection *connection)
 {
 	Jim_Interp *interp = (Jim_Interp *)connection->cmd_ctx->interp;
@@ -180,7 +374,7 @@ static int tcl_input(struct connection *connection)
 	const char *result;
 	int reslen;
 	struct tcl_connection *tclc;
-	unsigned char in[256];
+	unsigned char in[4096];
 	char *tc_line_new;
 	int tc_line_size_new;
 
@@ -195,6 +389,9 @@ static int tcl_input(struct connection *connection)
 	if (tclc == NULL)
 		return ERROR_CONNECTION_REJECTED;
 
+	if (tclc->tc_framed)
+		return tcl_input_framed(connection, in, rlen);
+
 	/* push as much data into the line as possible */
 	for (i = 0; i < rlen; i++) {
 		/* buffer the data */
@@ -252,6 +449,10 @@ static int tcl_input(struct connection *connection)
 
 		tclc->tc_lineoffset = 0;
 		tclc->tc_linedrop = 0;
+
+		/* whatever follows tcl_framing is framed */
+		if (tclc->tc_framed)
+			return tcl_input_framed(connection, in + i + 1, rlen - i - 1);
 	}
 
 	return ERROR_OK;
@@ -265,6 +466,7 @@ static int tcl_closed(struct connection *connection)
 	/* cleanup connection context */
 	if (tclc) {
 		free(tclc->tc_line);
+		free(tclc->tc_out);
 		free(tclc);
 		connection->priv = NULL;
 	}
@@ -327,6 +529,93 @@ COMMAND_HANDLER(handle_tcl_trace_command)
 	}
 }
 
+static struct tcl_connection *tcl_current_connection(struct command_invocation *cmd)
+{
+	struct connection *connection = CMD_CTX->output_handler_priv;
+
+	if (connection == NULL || strcmp(connection->service->name, "tcl"))
+		return NULL;
+
+	return connection->priv;
+}
+
+COMMAND_HANDLER(handle_tcl_framing_command)
+{
+	struct tcl_connection *tclc = tcl_current_connection(CMD);
+
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (tclc == NULL) {
+		LOG_ERROR("%s: can only be called from the tcl server", CMD_NAME);
+		return ERROR_COMMAND_SYNTAX_ERROR;
+	}
+
+	tclc->tc_framed = true;
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_tcl_read_memory_command)
+{
+	struct tcl_connection *tclc = tcl_current_connection(CMD);
+	target_addr_t address;
+	unsigned int width, count;
+	bool phys = false;
+
+	if (CMD_ARGC < 3 || CMD_ARGC > 4)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (tclc == NULL || !tclc->tc_framed) {
+		LOG_ERROR("%s: can only be called from a framed tcl server connection", CMD_NAME);
+		return ERROR_FAIL;
+	}
+
+	COMMAND_PARSE_ADDRESS(CMD_ARGV[0], address);
+	COMMAND_PARSE_NUMBER(uint, CMD_ARGV[1], width);
+	COMMAND_PARSE_NUMBER(uint, CMD_ARGV[2], count);
+	if (CMD_ARGC == 4) {
+		if (strcmp(CMD_ARGV[3], "phys"))
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		phys = true;
+	}
+
+	if (width != 8 && width != 16 && width != 32 && width != 64) {
+		command_print(CMD, "invalid width %u", width);
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+	width /= 8;
+
+	if (count > TCL_LINE_MAX / width) {
+		command_print(CMD, "at most %u bytes can be read at once", TCL_LINE_MAX);
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+
+	struct target *target = get_current_target(CMD_CTX);
+	uint8_t *buffer = malloc(count * width);
+	if (buffer == NULL && count) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	int retval;
+	if (phys)
+		retval = target_read_phys_memory(target, address, width, count, buffer);
+	else
+		retval = target_read_memory(target, address, width, count, buffer);
+
+	if (retval == ERROR_OK) {
+		/* the raw bytes, in target byte order, are the result */
+		Jim_AppendString(CMD_CTX->interp, CMD->output, (const char *)buffer, count * width);
+		tclc->tc_binary = true;
+	} else {
+		command_print(CMD, "failed reading memory at " TARGET_ADDR_FMT, address);
+	}
+
+	free(buffer);
+	return retval;
+}
+
 static const struct command_registration tcl_command_handlers[] = {
 	{
 		.name = "tcl_port",
@@ -351,6 +640,21 @@ static const struct command_registration tcl_command_handlers[] = {
 		.help = "Target trace output",
 		.usage = "[on|off]",
 	},
+	{
+		.name = "tcl_framing",
+		.handler = handle_tcl_framing_command,
+		.mode = COMMAND_EXEC,
+		.help = "Switch the current Tcl RPC connection to framed requests and replies",
+		.usage = "",
+	},
+	{
+		.name = "tcl_read_memory",
+		.handler = handle_tcl_read_memory_command,
+		.mode = COMMAND_EXEC,
+		.help = "Read target memory, replying with the raw bytes "
+			"(framed Tcl RPC connections only)",
+		.usage = "address width count ['phys']",
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
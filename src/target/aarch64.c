@@ -2200,7 +2200,8 @@ static int aarch64_handle_target_request(void *priv)
 				armv8->debug_base + CPUV8_DBG_DSCR, &dscr);
 
 		/* check if we have data */
-		while ((dscr & DSCR_DTR_TX_FULL) && (retval == ERROR_OK)) {
+		while ((dscr & DSCR_DTR_TX_FULL) && (retval == ERROR_OK) &&
+				target_request_ready()) {
 			retval = mem_ap_read_atomic_u32(armv8->debug_ap,
 					armv8->debug_base + CPUV8_DBG_DTRTX, &request);
 			if (retval == ERROR_OK) {
@@ -739,7 +739,8 @@ int arm7_9_target_request_data(struct target *target, uint32_t size, uint8_t *bu
 /**
  * Handles requests to an ARM7/9 target.  If debug messaging is enabled, the
  * target is running and the DCC control register has the W bit high, this will
- * execute the request on the target.
+ * execute the request on the target, repeating for up to TARGET_REQUEST_BATCH
+ * requests while the W bit stays high.
  *
  * @param priv Void pointer expected to be a struct target pointer
  * @return ERROR_OK unless there are issues with the JTAG queue or when reading
@@ -758,7 +759,11 @@ static int arm7_9_handle_target_request(void *priv)
 	if (!target->dbg_msg_enabled)
 		return ERROR_OK;
 
-	if (target->state == TARGET_RUNNING) {
+	/* drain up to a batch of requests while the target keeps sending */
+	for (int n = 0; n < TARGET_REQUEST_BATCH && target->state == TARGET_RUNNING; n++) {
+		if (!target_request_ready())
+			break;
+
 		/* read DCC control register */
 		embeddedice_read_reg(dcc_control);
 		retval = jtag_execute_queue();
@@ -766,16 +771,17 @@ static int arm7_9_handle_target_request(void *priv)
 			return retval;
 
 		/* check W bit */
-		if (buf_get_u32(dcc_control->value, 1, 1) == 1) {
-			uint32_t request;
+		if (buf_get_u32(dcc_control->value, 1, 1) != 1)
+			break;
 
-			retval = embeddedice_receive(jtag_info, &request, 1);
-			if (retval != ERROR_OK)
-				return retval;
-			retval = target_request(target, request);
-			if (retval != ERROR_OK)
-				return retval;
-		}
+		uint32_t request;
+
+		retval = embeddedice_receive(jtag_info, &request, 1);
+		if (retval != ERROR_OK)
+			return retval;
+		retval = target_request(target, request);
+		if (retval != ERROR_OK)
+			return retval;
 	}
 
 	return ERROR_OK;
@@ -314,18 +314,10 @@ int mem_ap_write_atomic_u32(struct adiv5_ap *ap, uint32_t address,
 }
 
 /**
- * Synchronous write of a block of memory, using a specific access size.
- *
- * @param ap The MEM-AP to access.
- * @param buffer The data buffer to write. No particular alignment is assumed.
- * @param size Which access size to use, in bytes. 1, 2 or 4.
- * @param count The number of writes to do (in size units, not bytes).
- * @param address Address to be written; it must be writable by the currently selected MEM-AP.
- * @param addrinc Whether the target address should be increased for each write or not. This
- *  should normally be true, except when writing to e.g. a FIFO.
- * @return ERROR_OK on success, otherwise an error code.
+ * Queue the write of a block of memory, using a specific access size.
+ * The writes are not run, see mem_ap_write().
  */
-static int mem_ap_write(struct adiv5_ap *ap, const uint8_t *buffer, uint32_t size, uint32_t count,
+static int mem_ap_queue_write(struct adiv5_ap *ap, const uint8_t *buffer, uint32_t size, uint32_t count,
 		uint32_t address, bool addrinc)
 {
 	struct adiv5_dap *dap = ap->dap;
@@ -428,9 +420,28 @@ static int mem_ap_write(struct adiv5_ap *ap, const uint8_t *buffer, uint32_t siz
 			address += this_size;
 	}
 
-	/* REVISIT: Might want to have a queued version of this function that does not run. */
+	return retval;
+}
+
+/**
+ * Synchronous write of a block of memory, using a specific access size.
+ *
+ * @param ap The MEM-AP to access.
+ * @param buffer The data buffer to write. No particular alignment is assumed.
+ * @param size Which access size to use, in bytes. 1, 2 or 4.
+ * @param count The number of writes to do (in size units, not bytes).
+ * @param address Address to be written; it must be writable by the currently selected MEM-AP.
+ * @param addrinc Whether the target address should be increased for each write or not. This
+ *  should normally be true, except when writing to e.g. a FIFO.
+ * @return ERROR_OK on success, otherwise an error code.
+ */
+static int mem_ap_write(struct adiv5_ap *ap, const uint8_t *buffer, uint32_t size, uint32_t count,
+		uint32_t address, bool addrinc)
+{
+	int retval = mem_ap_queue_write(ap, buffer, size, count, address, addrinc);
+
 	if (retval == ERROR_OK)
-		retval = dap_run(dap);
+		retval = dap_run(ap->dap);
 
 	if (retval != ERROR_OK) {
 		uint32_t tar;
@@ -444,34 +455,20 @@ static int mem_ap_write(struct adiv5_ap *ap, const uint8_t *buffer, uint32_t siz
 }
 
 /**
- * Synchronous read of a block of memory, using a specific access size.
- *
- * @param ap The MEM-AP to access.
- * @param buffer The data buffer to receive the data. No particular alignment is assumed.
- * @param size Which access size to use, in bytes. 1, 2 or 4.
- * @param count The number of reads to do (in size units, not bytes).
- * @param address Address to be read; it must be readable by the currently selected MEM-AP.
- * @param addrinc Whether the target address should be increased after each read or not. This
- *  should normally be true, except when reading from e.g. a FIFO.
- * @return ERROR_OK on success, otherwise an error code.
+ * Queue the read of a block of memory, using a specific access size.
+ * Each read stores the entire DRW word in @a read_buf, which must have room
+ * for @a count words; mem_ap_unpack_read() extracts the data once the reads
+ * have been run.
  */
-static int mem_ap_read(struct adiv5_ap *ap, uint8_t *buffer, uint32_t size, uint32_t count,
-		uint32_t adr, bool addrinc)
+static int mem_ap_queue_read(struct adiv5_ap *ap, uint32_t *read_buf, uint32_t size, uint32_t count,
+		uint32_t address, bool addrinc)
 {
-	struct adiv5_dap *dap = ap->dap;
 	size_t nbytes = size * count;
 	const uint32_t csw_addrincr = addrinc ? CSW_ADDRINC_SINGLE : CSW_ADDRINC_OFF;
 	uint32_t csw_size;
-	uint32_t address = adr;
+	uint32_t *read_ptr = read_buf;
 	int retval = ERROR_OK;
 
-	/* TI BE-32 Quirks mode:
-	 * Reads on big-endian TMS570 behave strangely differently than writes.
-	 * They read from the physical address requested, but with DRW byte-reversed.
-	 * For example, a byte read from address 0 will place the result in the high bytes of DRW.
-	 * Also, packed 8-bit and 16-bit transfers seem to sometimes return garbage in some bytes,
-	 * so avoid them. */
-
 	if (size == 4)
 		csw_size = CSW_32BIT;
 	else if (size == 2)
@@ -481,23 +478,11 @@ static int mem_ap_read(struct adiv5_ap *ap, uint8_t *buffer, uint32_t size, uint
 	else
 		return ERROR_TARGET_UNALIGNED_ACCESS;
 
-	if (ap->unaligned_access_bad && (adr % size != 0))
+	if (ap->unaligned_access_bad && (address % size != 0))
 		return ERROR_TARGET_UNALIGNED_ACCESS;
 
-	/* Allocate buffer to hold the sequence of DRW reads that will be made. This is a significant
-	 * over-allocation if packed transfers are going to be used, but determining the real need at
-	 * this point would be messy. */
-	uint32_t *read_buf = calloc(count, sizeof(uint32_t));
-	/* Multiplication count * sizeof(uint32_t) may overflow, calloc() is safe */
-	uint32_t *read_ptr = read_buf;
-	if (read_buf == NULL) {
-		LOG_ERROR("Failed to allocate read buffer");
-		return ERROR_FAIL;
-	}
-
-	/* Queue up all reads. Each read will store the entire DRW word in the read buffer. How many
-	 * useful bytes it contains, and their location in the word, depends on the type of transfer
-	 * and alignment. */
+	/* Queue up all reads. How many useful bytes each DRW word contains, and
+	 * their location in the word, depends on the type of transfer and alignment. */
 	while (nbytes > 0) {
 		uint32_t this_size = size;
 
@@ -527,30 +512,18 @@ static int mem_ap_read(struct adiv5_ap *ap, uint8_t *buffer, uint32_t size, uint
 		mem_ap_update_tar_cache(ap);
 	}
 
-	if (retval == ERROR_OK)
-		retval = dap_run(dap);
-
-	/* Restore state */
-	address = adr;
-	nbytes = size * count;
-	read_ptr = read_buf;
+	return retval;
+}
 
-	/* If something failed, read TAR to find out how much data was successfully read, so we can
-	 * at least give the caller what we have. */
-	if (retval != ERROR_OK) {
-		uint32_t tar;
-		if (mem_ap_read_tar(ap, &tar) == ERROR_OK) {
-			/* TAR is incremented after failed transfer on some devices (eg Cortex-M4) */
-			LOG_ERROR("Failed to read memory at 0x%08"PRIx32, tar);
-			if (nbytes > tar - address)
-				nbytes = tar - address;
-		} else {
-			LOG_ERROR("Failed to read memory and, additionally, failed to find out where");
-			nbytes = 0;
-		}
-	}
+/**
+ * Replay the reads queued by mem_ap_queue_read() to populate @a buffer with
+ * the first @a nbytes bytes read, taken from the correct word and byte lane.
+ */
+static void mem_ap_unpack_read(struct adiv5_ap *ap, uint8_t *buffer, const uint32_t *read_buf,
+		uint32_t size, size_t nbytes, uint32_t address, bool addrinc)
+{
+	const uint32_t *read_ptr = read_buf;
 
-	/* Replay loop to populate caller's buffer from the correct word and byte lane */
 	while (nbytes > 0) {
 		uint32_t this_size = size;
 
@@ -559,7 +532,7 @@ static int mem_ap_read(struct adiv5_ap *ap, uint8_t *buffer, uint32_t size, uint
 			this_size = 4;
 		}
 
-		if (dap->ti_be_32_quirks) {
+		if (ap->dap->ti_be_32_quirks) {
 			switch (this_size) {
 			case 4:
 				*buffer++ = *read_ptr >> 8 * (3 - (address++ & 3));
@@ -588,6 +561,67 @@ static int mem_ap_read(struct adiv5_ap *ap, uint8_t *buffer, uint32_t size, uint
 		read_ptr++;
 		nbytes -= this_size;
 	}
+}
+
+/**
+ * Synchronous read of a block of memory, using a specific access size.
+ *
+ * @param ap The MEM-AP to access.
+ * @param buffer The data buffer to receive the data. No particular alignment is assumed.
+ * @param size Which access size to use, in bytes. 1, 2 or 4.
+ * @param count The number of reads to do (in size units, not bytes).
+ * @param address Address to be read; it must be readable by the currently selected MEM-AP.
+ * @param addrinc Whether the target address should be increased after each read or not. This
+ *  should normally be true, except when reading from e.g. a FIFO.
+ * @return ERROR_OK on success, otherwise an error code.
+ */
+static int mem_ap_read(struct adiv5_ap *ap, uint8_t *buffer, uint32_t size, uint32_t count,
+		uint32_t adr, bool addrinc)
+{
+	size_t nbytes = size * count;
+
+	/* TI BE-32 Quirks mode:
+	 * Reads on big-endian TMS570 behave strangely differently than writes.
+	 * They read from the physical address requested, but with DRW byte-reversed.
+	 * For example, a byte read from address 0 will place the result in the high bytes of DRW.
+	 * Also, packed 8-bit and 16-bit transfers seem to sometimes return garbage in some bytes,
+	 * so avoid them. */
+
+	/* Allocate buffer to hold the sequence of DRW reads that will be made. This is a significant
+	 * over-allocation if packed transfers are going to be used, but determining the real need at
+	 * this point would be messy. */
+	uint32_t *read_buf = calloc(count, sizeof(uint32_t));
+	/* Multiplication count * sizeof(uint32_t) may overflow, calloc() is safe */
+	if (read_buf == NULL) {
+		LOG_ERROR("Failed to allocate read buffer");
+		return ERROR_FAIL;
+	}
+
+	int retval = mem_ap_queue_read(ap, read_buf, size, count, adr, addrinc);
+	if (retval == ERROR_TARGET_UNALIGNED_ACCESS) {
+		free(read_buf);
+		return retval;
+	}
+
+	if (retval == ERROR_OK)
+		retval = dap_run(ap->dap);
+
+	/* If something failed, read TAR to find out how much data was successfully read, so we can
+	 * at least give the caller what we have. */
+	if (retval != ERROR_OK) {
+		uint32_t tar;
+		if (mem_ap_read_tar(ap, &tar) == ERROR_OK) {
+			/* TAR is incremented after failed transfer on some devices (eg Cortex-M4) */
+			LOG_ERROR("Failed to read memory at 0x%08"PRIx32, tar);
+			if (nbytes > tar - adr)
+				nbytes = tar - adr;
+		} else {
+			LOG_ERROR("Failed to read memory and, additionally, failed to find out where");
+			nbytes = 0;
+		}
+	}
+
+	mem_ap_unpack_read(ap, buffer, read_buf, size, nbytes, adr, addrinc);
 
 	free(read_buf);
 	return retval;
@@ -617,6 +651,102 @@ int mem_ap_write_buf_noincr(struct adiv5_ap *ap,
 	return mem_ap_write(ap, buffer, size, count, address, false);
 }
 
+/**
+ * Read several blocks of memory with a single dap_run(), which saves a round
+ * trip to the adapter per block compared to mem_ap_read_buf().
+ *
+ * On error the contents of all the buffers are undefined.
+ */
+int mem_ap_read_buf_batch(struct adiv5_ap *ap,
+		struct target_memory_transfer *transfers, unsigned int num_transfers)
+{
+	size_t words = 0;
+	int retval = ERROR_OK;
+
+	for (unsigned int i = 0; i < num_transfers; i++)
+		words += transfers[i].count;
+
+	uint32_t *read_buf = calloc(words ? words : 1, sizeof(uint32_t));
+	if (read_buf == NULL) {
+		LOG_ERROR("Failed to allocate read buffer");
+		return ERROR_FAIL;
+	}
+
+	uint32_t *read_ptr = read_buf;
+	for (unsigned int i = 0; i < num_transfers; i++) {
+		struct target_memory_transfer *t = &transfers[i];
+
+		retval = mem_ap_queue_read(ap, read_ptr, t->size, t->count, t->address, true);
+		if (retval != ERROR_OK)
+			break;
+		read_ptr += t->count;
+	}
+
+	if (retval != ERROR_OK) {
+		/* the reads already queued still write to read_buf */
+		dap_run(ap->dap);
+		free(read_buf);
+		return retval;
+	}
+
+	retval = dap_run(ap->dap);
+	if (retval != ERROR_OK) {
+		uint32_t tar;
+		if (mem_ap_read_tar(ap, &tar) == ERROR_OK)
+			LOG_ERROR("Failed to read memory at 0x%08"PRIx32, tar);
+		else
+			LOG_ERROR("Failed to read memory and, additionally, failed to find out where");
+		free(read_buf);
+		return retval;
+	}
+
+	read_ptr = read_buf;
+	for (unsigned int i = 0; i < num_transfers; i++) {
+		struct target_memory_transfer *t = &transfers[i];
+
+		mem_ap_unpack_read(ap, t->buffer, read_ptr, t->size,
+				(size_t)t->size * t->count, t->address, true);
+		read_ptr += t->count;
+	}
+
+	free(read_buf);
+	return ERROR_OK;
+}
+
+/**
+ * Write several blocks of memory with a single dap_run().
+ */
+int mem_ap_write_buf_batch(struct adiv5_ap *ap,
+		const struct target_memory_transfer *transfers, unsigned int num_transfers)
+{
+	int retval = ERROR_OK;
+
+	for (unsigned int i = 0; i < num_transfers; i++) {
+		const struct target_memory_transfer *t = &transfers[i];
+
+		retval = mem_ap_queue_write(ap, t->buffer, t->size, t->count, t->address, true);
+		if (retval != ERROR_OK)
+			break;
+	}
+
+	if (retval != ERROR_OK) {
+		/* complete the writes already queued, as separate calls would have */
+		dap_run(ap->dap);
+		return retval;
+	}
+
+	retval = dap_run(ap->dap);
+	if (retval != ERROR_OK) {
+		uint32_t tar;
+		if (mem_ap_read_tar(ap, &tar) == ERROR_OK)
+			LOG_ERROR("Failed to write memory at 0x%08"PRIx32, tar);
+		else
+			LOG_ERROR("Failed to write memory and, additionally, failed to find out where");
+	}
+
+	return retval;
+}
+
 /*--------------------------------------------------------------------------*/
 
 
@@ -32,6 +32,8 @@
 #include <helper/list.h>
 #include "arm_jtag.h"
 
+struct target_memory_transfer;
+
 /* three-bit ACK values for SWD access (sent LSB first) */
 #define SWD_ACK_OK    0x1
 #define SWD_ACK_WAIT  0x2
@@ -507,6 +509,12 @@ int mem_ap_read_buf_noincr(struct adiv5_ap *ap,
 int mem_ap_write_buf_noincr(struct adiv5_ap *ap,
 		const uint8_t *buffer, uint32_t size, uint32_t count, uint32_t address);
 
+/* Synchronous MEM-AP block transfers, queued together and run at once. */
+int mem_ap_read_buf_batch(struct adiv5_ap *ap,
+		struct target_memory_transfer *transfers, unsigned int num_transfers);
+int mem_ap_write_buf_batch(struct adiv5_ap *ap,
+		const struct target_memory_transfer *transfers, unsigned int num_transfers);
+
 /* Initialisation of the debug system, power domains and registers */
 int dap_dp_init(struct adiv5_dap *dap);
 int mem_ap_init(struct adiv5_ap *ap);
@@ -24,31 +24,121 @@
 #include <target/cortex_m.h>
 #include <target/armv7m_trace.h>
 #include <jtag/interface.h>
+#include <helper/time_support.h>
+#include <server/server.h>
 
-#define TRACE_BUF_SIZE	4096
+/* room for about a second of trace at high SWO rates */
+#define TRACE_RING_SIZE		(1024 * 1024)
+/* write the captured data out when the ring is half full or this old */
+#define TRACE_FLUSH_INTERVAL_MS	100
+
+static bool trace_would_block(void)
+{
+#ifdef _WIN32
+	return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+	return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+}
+
+static int armv7m_flush_trace(struct armv7m_common *armv7m)
+{
+	struct armv7m_trace_config *trace_config = &armv7m->trace_config;
+	struct ringbuf *ring = &trace_config->trace_ring;
+	int retval = ERROR_OK;
+
+	trace_config->trace_flush_time = timeval_ms();
+
+	while (ringbuf_used(ring)) {
+		size_t size;
+		const uint8_t *buf = ringbuf_read_ptr(ring, &size);
+
+		if (trace_config->trace_connection) {
+			/* the socket is non-blocking, what it doesn't take now
+			 * stays in the ring for the next flush */
+			int written = connection_write(trace_config->trace_connection, buf, size);
+			if (written < 0 && !trace_would_block()) {
+				/* the server notices and closes the connection */
+				trace_config->stats.dropped += ringbuf_used(ring);
+				ringbuf_consume(ring, ringbuf_used(ring));
+				break;
+			}
+			if (written <= 0)
+				break;
+			trace_config->stats.written += written;
+			ringbuf_consume(ring, written);
+			continue;
+		}
+
+		if (trace_config->trace_file == NULL) {
+			/* nobody wants the data beyond the trace callbacks */
+		} else if (fwrite(buf, 1, size, trace_config->trace_file) == size) {
+			trace_config->stats.written += size;
+		} else {
+			LOG_ERROR("Error writing to the trace destination file");
+			trace_config->stats.dropped += size;
+			retval = ERROR_FAIL;
+		}
+
+		ringbuf_consume(ring, size);
+	}
+
+	if (trace_config->trace_file != NULL)
+		fflush(trace_config->trace_file);
+
+	return retval;
+}
 
 static int armv7m_poll_trace(void *target)
 {
 	struct armv7m_common *armv7m = target_to_armv7m(target);
-	uint8_t buf[TRACE_BUF_SIZE];
-	size_t size = sizeof(buf);
+	struct armv7m_trace_config *trace_config = &armv7m->trace_config;
+	struct ringbuf *ring = &trace_config->trace_ring;
 	int retval;
 
-	retval = adapter_poll_trace(buf, &size);
-	if (retval != ERROR_OK || !size)
-		return retval;
-
-	target_call_trace_callbacks(target, size, buf);
+	/* drain the adapter, straight into the ring */
+	for (;;) {
+		size_t space;
+		uint8_t *buf = ringbuf_write_ptr(ring, &space);
+
+		if (!space) {
+			trace_config->stats.overflows++;
+			retval = armv7m_flush_trace(armv7m);
+			if (retval != ERROR_OK)
+				return retval;
+			buf = ringbuf_write_ptr(ring, &space);
+		}
 
-	if (armv7m->trace_config.trace_file != NULL) {
-		if (fwrite(buf, 1, size, armv7m->trace_config.trace_file) == size)
-			fflush(armv7m->trace_config.trace_file);
-		else {
-			LOG_ERROR("Error writing to the trace destination file");
-			return ERROR_FAIL;
+		if (!space) {
+			/* a client too slow for the trace rate loses the oldest data */
+			trace_config->stats.dropped += ringbuf_used(ring);
+			ringbuf_consume(ring, ringbuf_used(ring));
+			buf = ringbuf_write_ptr(ring, &space);
 		}
+
+		size_t size = space;
+		retval = adapter_poll_trace(buf, &size);
+		if (retval != ERROR_OK)
+			return retval;
+		if (!size)
+			break;
+
+		ringbuf_commit(ring, size);
+		trace_config->stats.captured += size;
+		if (ringbuf_used(ring) > trace_config->stats.max_used)
+			trace_config->stats.max_used = ringbuf_used(ring);
+
+		target_call_trace_callbacks(target, size, buf);
+
+		/* the adapter had less than we asked for */
+		if (size < space)
+			break;
 	}
 
+	if (ringbuf_used(ring) >= ring->size / 2 ||
+			timeval_ms() - trace_config->trace_flush_time >= TRACE_FLUSH_INTERVAL_MS)
+		return armv7m_flush_trace(armv7m);
+
 	return ERROR_OK;
 }
 
@@ -61,6 +151,12 @@ int armv7m_trace_tpiu_config(struct target *target)
 
 	target_unregister_timer_callback(armv7m_poll_trace, target);
 
+	if (trace_config->config_type == TRACE_CONFIG_TYPE_INTERNAL &&
+			trace_config->trace_ring.data == NULL) {
+		retval = ringbuf_init(&trace_config->trace_ring, TRACE_RING_SIZE);
+		if (retval != ERROR_OK)
+			return retval;
+	}
 
 	retval = adapter_config_trace(trace_config->config_type == TRACE_CONFIG_TYPE_INTERNAL,
 				      trace_config->pin_protocol,
@@ -154,11 +250,101 @@ int armv7m_trace_itm_config(struct target *target)
 	return ERROR_OK;
 }
 
+/* the service private data, freed by remove_service() */
+struct armv7m_trace_service {
+	struct armv7m_common *armv7m;
+};
+
+static int armv7m_trace_new_connection(struct connection *connection)
+{
+	struct armv7m_trace_service *service = connection->service->priv;
+	struct armv7m_trace_config *trace_config = &service->armv7m->trace_config;
+
+	if (trace_config->trace_connection) {
+		LOG_ERROR("trace port already has a client");
+		return ERROR_CONNECTION_REJECTED;
+	}
+
+	socket_nonblock(connection->fd);
+	trace_config->trace_connection = connection;
+	return ERROR_OK;
+}
+
+static int armv7m_trace_input(struct connection *connection)
+{
+	uint8_t buf[64];
+
+	/* trace only flows to the client, whatever it sends is ignored */
+	int bytes_read = connection_read(connection, buf, sizeof(buf));
+	if (bytes_read == 0)
+		return ERROR_SERVER_REMOTE_CLOSED;
+	if (bytes_read < 0 && !trace_would_block())
+		return ERROR_SERVER_REMOTE_CLOSED;
+
+	return ERROR_OK;
+}
+
+static int armv7m_trace_connection_closed(struct connection *connection)
+{
+	struct armv7m_trace_service *service = connection->service->priv;
+	struct armv7m_trace_config *trace_config = &service->armv7m->trace_config;
+
+	if (trace_config->trace_connection == connection)
+		trace_config->trace_connection = NULL;
+	return ERROR_OK;
+}
+
+static int open_trace_port(struct armv7m_common *armv7m, const char *port)
+{
+	struct armv7m_trace_config *trace_config = &armv7m->trace_config;
+	struct armv7m_trace_service *service = malloc(sizeof(*service));
+	char *port_copy = strdup(port);
+
+	if (service == NULL || port_copy == NULL) {
+		LOG_ERROR("out of memory");
+		free(service);
+		free(port_copy);
+		return ERROR_FAIL;
+	}
+	service->armv7m = armv7m;
+
+	int retval = add_service("tpiu", port_copy, 1, armv7m_trace_new_connection,
+			armv7m_trace_input, armv7m_trace_connection_closed, service);
+	if (retval != ERROR_OK) {
+		free(service);
+		free(port_copy);
+		return retval;
+	}
+
+	trace_config->trace_port = port_copy;
+	return ERROR_OK;
+}
+
 static void close_trace_file(struct armv7m_common *armv7m)
 {
+	/* the data still in the ring belongs to the old file */
+	if (armv7m->trace_config.trace_ring.data)
+		armv7m_flush_trace(armv7m);
+
 	if (armv7m->trace_config.trace_file)
 		fclose(armv7m->trace_config.trace_file);
 	armv7m->trace_config.trace_file = NULL;
+
+	if (armv7m->trace_config.trace_port) {
+		remove_service("tpiu", armv7m->trace_config.trace_port);
+		free(armv7m->trace_config.trace_port);
+	}
+	armv7m->trace_config.trace_port = NULL;
+	armv7m->trace_config.trace_connection = NULL;
+}
+
+void armv7m_trace_free(struct target *target)
+{
+	struct armv7m_common *armv7m = target_to_armv7m(target);
+
+	target_unregister_timer_callback(armv7m_poll_trace, target);
+	close_trace_file(armv7m);
+	ringbuf_cleanup(&armv7m->trace_config.trace_ring);
 }
 
 COMMAND_HANDLER(handle_tpiu_config_command)
@@ -192,7 +378,13 @@ COMMAND_HANDLER(handle_tpiu_config_command)
 
 			armv7m->trace_config.config_type = TRACE_CONFIG_TYPE_INTERNAL;
 
-			if (strcmp(CMD_ARGV[cmd_idx], "-") != 0) {
+			if (CMD_ARGV[cmd_idx][0] == ':') {
+				uint16_t port;
+				COMMAND_PARSE_NUMBER(u16, CMD_ARGV[cmd_idx] + 1, port);
+				int retval = open_trace_port(armv7m, CMD_ARGV[cmd_idx] + 1);
+				if (retval != ERROR_OK)
+					return retval;
+			} else if (strcmp(CMD_ARGV[cmd_idx], "-") != 0) {
 				armv7m->trace_config.trace_file = fopen(CMD_ARGV[cmd_idx], "ab");
 				if (!armv7m->trace_config.trace_file) {
 					LOG_ERROR("Can't open trace destination file");
@@ -256,6 +448,33 @@ COMMAND_HANDLER(handle_tpiu_config_command)
 	return ERROR_COMMAND_SYNTAX_ERROR;
 }
 
+COMMAND_HANDLER(handle_tpiu_stats_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	struct armv7m_common *armv7m = target_to_armv7m(target);
+	struct armv7m_trace_config *trace_config = &armv7m->trace_config;
+	struct armv7m_trace_stats *stats = &trace_config->stats;
+
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		if (strcmp(CMD_ARGV[0], "reset"))
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		memset(stats, 0, sizeof(*stats));
+		return ERROR_OK;
+	}
+
+	command_print(CMD, "captured %" PRIu64 " bytes, written %" PRIu64
+			" bytes, dropped %" PRIu64 " bytes",
+			stats->captured, stats->written, stats->dropped);
+	command_print(CMD, "buffer %zu of %zu bytes used, peak %zu, %u overflows",
+			ringbuf_used(&trace_config->trace_ring), trace_config->trace_ring.size,
+			stats->max_used, stats->overflows);
+
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(handle_itm_port_command)
 {
 	struct target *target = get_current_target(CMD_CTX);
@@ -312,6 +531,13 @@ static const struct command_registration tpiu_command_handlers[] = {
 		"(sync <port width> | ((manchester | uart) <formatter enable>)) "
 		"<TRACECLKIN freq> [<trace freq>]))",
 	},
+	{
+		.name = "stats",
+		.handler = handle_tpiu_stats_command,
+		.mode = COMMAND_EXEC,
+		.help = "Show or reset trace capture statistics",
+		.usage = "[reset]",
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
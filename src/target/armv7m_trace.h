@@ -20,6 +20,7 @@
 
 #include <target/target.h>
 #include <command.h>
+#include <helper/ringbuf.h>
 
 /**
  * @file
@@ -45,6 +46,20 @@ enum itm_ts_prescaler {
 	ITM_TS_PRESCALE64,	/**< refclock divided by 64 for the timestamp counter */
 };
 
+struct armv7m_trace_stats {
+	/** Bytes received from the adapter */
+	uint64_t captured;
+	/** Bytes written to the trace file or client */
+	uint64_t written;
+	/** Bytes lost because the trace file or client couldn't take them */
+	uint64_t dropped;
+	/** Highest fill level of the ring buffer */
+	size_t max_used;
+	/** Times the ring buffer was full and had to be written out while
+	 * the adapter still had data */
+	unsigned int overflows;
+};
+
 struct armv7m_trace_config {
 	/** Currently active trace capture mode */
 	enum trace_config_type config_type;
@@ -75,6 +90,17 @@ struct armv7m_trace_config {
 	unsigned int trace_freq;
 	/** Handle to output trace data in INTERNAL capture mode */
 	FILE *trace_file;
+	/** TCP port serving trace data in INTERNAL capture mode, or NULL */
+	char *trace_port;
+	/** Client of trace_port, if any */
+	struct connection *trace_connection;
+
+	/** Trace data captured in INTERNAL mode, not yet written to trace_file */
+	struct ringbuf trace_ring;
+	/** Time trace_ring was last written out, in ms */
+	int64_t trace_flush_time;
+	/** Capture statistics, reported by "tpiu stats" */
+	struct armv7m_trace_stats stats;
 };
 
 extern const struct command_registration armv7m_trace_command_handlers[];
@@ -87,5 +113,9 @@ int armv7m_trace_tpiu_config(struct target *target);
  * Configure hardware accordingly to the current ITM target settings
  */
 int armv7m_trace_itm_config(struct target *target);
+/**
+ * Flush captured trace data and release the capture resources
+ */
+void armv7m_trace_free(struct target *target);
 
 #endif /* OPENOCD_TARGET_ARMV7M_TRACE_H */
@@ -0,0 +1,706 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+/**
+ * @file
+ * Reproducible throughput measurements of the target memory access paths.
+ *
+ * "benchmark memory" sweeps transfer sizes, start offsets and access widths
+ * over read, write, checksum and blank check and reports one result per
+ * combination, as text or in a machine-readable format (CSV or JSON) so
+ * that the numbers can be tracked over time per adapter and target.
+ *
+ * "benchmark bitcopy" times the host side bit field copy used to pack and
+ * unpack JTAG scans against a plain bit by bit copy.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <helper/binarybuffer.h>
+#include <helper/log.h>
+#include <helper/time_support.h>
+#include <jtag/jtag.h>
+#include "benchmark.h"
+#include "target.h"
+
+enum benchmark_format {
+	BENCHMARK_FORMAT_TEXT,
+	BENCHMARK_FORMAT_CSV,
+	BENCHMARK_FORMAT_JSON,
+};
+
+static const char * const benchmark_format_names[] = {
+	[BENCHMARK_FORMAT_TEXT] = "text",
+	[BENCHMARK_FORMAT_CSV] = "csv",
+	[BENCHMARK_FORMAT_JSON] = "json",
+};
+
+enum benchmark_op {
+	BENCHMARK_OP_READ,
+	BENCHMARK_OP_WRITE,
+	BENCHMARK_OP_CHECKSUM,
+	BENCHMARK_OP_BLANK_CHECK,
+	BENCHMARK_OP_COUNT,
+};
+
+static const char * const benchmark_op_names[] = {
+	[BENCHMARK_OP_READ] = "read",
+	[BENCHMARK_OP_WRITE] = "write",
+	[BENCHMARK_OP_CHECKSUM] = "checksum",
+	[BENCHMARK_OP_BLANK_CHECK] = "blank_check",
+};
+
+static enum benchmark_format benchmark_format = BENCHMARK_FORMAT_TEXT;
+/* results go to the command output if no file is set */
+static char *benchmark_output;
+static unsigned int benchmark_repeat = 1;
+
+/* destination of the results of one benchmark run */
+struct benchmark_sink {
+	struct command_invocation *cmd;
+	FILE *file;
+	/* JSON rows are held back until it is known whether a comma follows */
+	char *pending;
+};
+
+static void benchmark_put_line(struct benchmark_sink *sink, const char *line)
+{
+	if (sink->file)
+		fprintf(sink->file, "%s\n", line);
+	else
+		command_print(sink->cmd, "%s", line);
+}
+
+static int benchmark_flush_pending(struct benchmark_sink *sink, bool more)
+{
+	int retval = ERROR_OK;
+
+	if (!sink->pending)
+		return ERROR_OK;
+
+	if (more) {
+		char *line = alloc_printf("%s,", sink->pending);
+		if (line) {
+			benchmark_put_line(sink, line);
+			free(line);
+		} else {
+			LOG_ERROR("Out of memory");
+			retval = ERROR_FAIL;
+		}
+	} else
+		benchmark_put_line(sink, sink->pending);
+
+	free(sink->pending);
+	sink->pending = NULL;
+	return retval;
+}
+
+static int benchmark_print(struct benchmark_sink *sink, const char *format, ...)
+{
+	va_list ap;
+
+	va_start(ap, format);
+	char *line = alloc_vprintf(format, ap);
+	va_end(ap);
+
+	if (!line) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	benchmark_put_line(sink, line);
+	free(line);
+	return ERROR_OK;
+}
+
+/* escape a string for use inside a JSON string literal; caller frees */
+static char *benchmark_json_escape(const char *str)
+{
+	size_t len = 0;
+	for (const char *p = str; *p; p++) {
+		unsigned char c = *p;
+		if (c == '"' || c == '\\')
+			len += 2;
+		else if (c < 0x20)
+			len += 6;
+		else
+			len++;
+	}
+
+	char *out = malloc(len + 1);
+	if (!out)
+		return NULL;
+
+	char *q = out;
+	for (const char *p = str; *p; p++) {
+		unsigned char c = *p;
+		if (c == '"' || c == '\\') {
+			*q++ = '\\';
+			*q++ = c;
+		} else if (c < 0x20) {
+			sprintf(q, "\\u%04x", c);
+			q += 6;
+		} else {
+			*q++ = c;
+		}
+	}
+	*q = '\0';
+
+	return out;
+}
+
+/* quote a CSV field, doubling any quotes inside it; caller frees */
+static char *benchmark_csv_quote(const char *str)
+{
+	size_t len = 2;
+	for (const char *p = str; *p; p++)
+		len += *p == '"' ? 2 : 1;
+
+	char *out = malloc(len + 1);
+	if (!out)
+		return NULL;
+
+	char *q = out;
+	*q++ = '"';
+	for (const char *p = str; *p; p++) {
+		if (*p == '"')
+			*q++ = '"';
+		*q++ = *p;
+	}
+	*q++ = '"';
+	*q = '\0';
+
+	return out;
+}
+
+static const char *benchmark_access_name(unsigned int width)
+{
+	switch (width) {
+		case 1:
+			return "u8";
+		case 2:
+			return "u16";
+		case 4:
+			return "u32";
+		default:
+			return "buffer";
+	}
+}
+
+static const char *benchmark_status_name(int retval)
+{
+	switch (retval) {
+		case ERROR_OK:
+			return "ok";
+		case ERROR_TARGET_RESOURCE_NOT_AVAILABLE:
+			return "unsupported";
+		case ERROR_TARGET_UNALIGNED_ACCESS:
+			return "unaligned";
+		default:
+			return "error";
+	}
+}
+
+static int benchmark_print_header(struct benchmark_sink *sink, struct target *target)
+{
+	int retval = ERROR_FAIL;
+
+	switch (benchmark_format) {
+		case BENCHMARK_FORMAT_TEXT:
+			retval = benchmark_print(sink, "memory benchmark of %s (%s), adapter speed %u kHz",
+					target_name(target), target_type_name(target), jtag_get_speed_khz());
+			break;
+		case BENCHMARK_FORMAT_CSV:
+			retval = benchmark_print(sink, "target,type,adapter_khz,op,access,size,offset,"
+					"repeat,seconds,kib_per_s,status,code");
+			break;
+		case BENCHMARK_FORMAT_JSON:
+		{
+			char *name = benchmark_json_escape(target_name(target));
+			char *type = benchmark_json_escape(target_type_name(target));
+			if (name && type)
+				retval = benchmark_print(sink, "{\"target\": \"%s\", \"type\": \"%s\", \"adapter_khz\": %u, \"results\": [",
+						name, type, jtag_get_speed_khz());
+			else
+				LOG_ERROR("Out of memory");
+			free(name);
+			free(type);
+			break;
+		}
+	}
+
+	return retval;
+}
+
+static int benchmark_print_footer(struct benchmark_sink *sink)
+{
+	if (benchmark_format != BENCHMARK_FORMAT_JSON)
+		return ERROR_OK;
+
+	int retval = benchmark_flush_pending(sink, false);
+	if (retval != ERROR_OK)
+		return retval;
+
+	return benchmark_print(sink, "]}");
+}
+
+static int benchmark_print_result(struct benchmark_sink *sink, struct target *target,
+		enum benchmark_op op, unsigned int width, uint32_t size, unsigned int offset,
+		const struct duration *bench, int result)
+{
+	const char *op_name = benchmark_op_names[op];
+	const char *access = benchmark_access_name(width);
+	const char *status = benchmark_status_name(result);
+	float seconds = duration_elapsed(bench);
+	float kbps = result == ERROR_OK ? duration_kbps(bench, (size_t)size * benchmark_repeat) : 0;
+	int retval = ERROR_FAIL;
+
+	switch (benchmark_format) {
+		case BENCHMARK_FORMAT_TEXT:
+			if (result == ERROR_OK)
+				retval = benchmark_print(sink, "%-11s %-6s %8" PRIu32 " bytes @ +%u: %fs (%0.3f KiB/s)",
+						op_name, access, size, offset, seconds, kbps);
+			else
+				retval = benchmark_print(sink, "%-11s %-6s %8" PRIu32 " bytes @ +%u: %s (%d)",
+						op_name, access, size, offset, status, result);
+			break;
+		case BENCHMARK_FORMAT_CSV:
+		{
+			char *name = benchmark_csv_quote(target_name(target));
+			char *type = benchmark_csv_quote(target_type_name(target));
+			if (name && type)
+				retval = benchmark_print(sink, "%s,%s,%u,\"%s\",\"%s\",%" PRIu32 ",%u,%u,%f,%0.3f,\"%s\",%d",
+						name, type, jtag_get_speed_khz(),
+						op_name, access, size, offset, benchmark_repeat, seconds, kbps,
+						status, result);
+			else
+				LOG_ERROR("Out of memory");
+			free(name);
+			free(type);
+			break;
+		}
+		case BENCHMARK_FORMAT_JSON:
+			retval = benchmark_flush_pending(sink, true);
+			if (retval != ERROR_OK)
+				break;
+
+			/* op, access and status come from fixed tables, no escaping needed */
+			sink->pending = alloc_printf("  {\"op\": \"%s\", \"access\": \"%s\", "
+					"\"size\": %" PRIu32 ", \"offset\": %u, \"repeat\": %u, "
+					"\"seconds\": %f, \"kib_per_s\": %0.3f, \"status\": \"%s\", \"code\": %d}",
+					op_name, access, size, offset, benchmark_repeat, seconds, kbps,
+					status, result);
+			if (!sink->pending) {
+				LOG_ERROR("Out of memory");
+				retval = ERROR_FAIL;
+			}
+			break;
+	}
+
+	return retval;
+}
+
+static int benchmark_run_op(struct target *target, enum benchmark_op op,
+		unsigned int width, target_addr_t address, uint32_t size, uint8_t *buffer)
+{
+	switch (op) {
+		case BENCHMARK_OP_READ:
+			if (width == 0)
+				return target_read_buffer(target, address, size, buffer);
+			return target_read_memory(target, address, width, size / width, buffer);
+		case BENCHMARK_OP_WRITE:
+			if (width == 0)
+				return target_write_buffer(target, address, size, buffer);
+			return target_write_memory(target, address, width, size / width, buffer);
+		case BENCHMARK_OP_CHECKSUM:
+		{
+			uint32_t checksum;
+			return target_checksum_memory(target, address, size, &checksum);
+		}
+		case BENCHMARK_OP_BLANK_CHECK:
+		{
+			struct target_memory_check_block block = {
+				.address = address,
+				.size = size,
+				.result = 0,
+			};
+			/* returns the number of blocks checked */
+			int retval = target_blank_check_memory(target, &block, 1, 0xff);
+			if (retval < 0)
+				return retval;
+			return retval == 1 ? ERROR_OK : ERROR_FAIL;
+		}
+		default:
+			return ERROR_FAIL;
+	}
+}
+
+static int benchmark_sweep(struct benchmark_sink *sink, struct target *target,
+		enum benchmark_op op, target_addr_t address, uint32_t max_size, uint8_t *buffer)
+{
+	static const unsigned int widths[] = { 0, 1, 2, 4 };
+	/* checksum and blank check have no access width of their own */
+	unsigned int num_widths = op == BENCHMARK_OP_READ || op == BENCHMARK_OP_WRITE
+		? ARRAY_SIZE(widths) : 1;
+
+	for (unsigned int w = 0; w < num_widths; w++) {
+		unsigned int width = widths[w];
+		uint32_t size = 4;
+
+		while (size) {
+			for (unsigned int offset = 0; offset < 4; offset++) {
+				/* sized accesses are only measured naturally aligned,
+				 * the buffer functions deal with any alignment */
+				if (width && offset % width)
+					continue;
+
+				struct duration bench;
+				int retval = ERROR_OK;
+
+				duration_start(&bench);
+				for (unsigned int i = 0; i < benchmark_repeat && retval == ERROR_OK; i++)
+					retval = benchmark_run_op(target, op, width,
+							address + offset, size, buffer);
+				duration_measure(&bench);
+
+				retval = benchmark_print_result(sink, target, op, width, size,
+						offset, &bench, retval);
+				if (retval != ERROR_OK)
+					return retval;
+				keep_alive();
+			}
+
+			if (size == max_size)
+				break;
+			size = size <= max_size / 2 ? size * 2 : max_size;
+		}
+	}
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_benchmark_memory_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	bool ops[BENCHMARK_OP_COUNT];
+	target_addr_t address;
+	uint32_t max_size;
+	int retval = ERROR_OK;
+
+	if (CMD_ARGC < 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	COMMAND_PARSE_ADDRESS(CMD_ARGV[0], address);
+	COMMAND_PARSE_NUMBER(u32, CMD_ARGV[1], max_size);
+
+	if (max_size < 4) {
+		command_print(CMD, "size must be at least 4 bytes");
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+
+	for (unsigned int op = 0; op < BENCHMARK_OP_COUNT; op++)
+		ops[op] = CMD_ARGC == 2;
+
+	for (unsigned int i = 2; i < CMD_ARGC; i++) {
+		unsigned int op;
+		for (op = 0; op < BENCHMARK_OP_COUNT; op++) {
+			if (strcmp(CMD_ARGV[i], benchmark_op_names[op]) == 0)
+				break;
+		}
+		if (op == BENCHMARK_OP_COUNT)
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		ops[op] = true;
+	}
+
+	/* room for the largest transfer at the largest offset */
+	uint8_t *buffer = malloc((size_t)max_size + 3);
+	if (buffer == NULL) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	for (size_t i = 0; i < (size_t)max_size + 3; i++)
+		buffer[i] = rand();
+
+	struct benchmark_sink sink = {
+		.cmd = CMD,
+		.file = NULL,
+		.pending = NULL,
+	};
+
+	if (benchmark_output) {
+		sink.file = fopen(benchmark_output, "w");
+		if (sink.file == NULL) {
+			LOG_ERROR("Can't open %s: %s", benchmark_output, strerror(errno));
+			free(buffer);
+			return ERROR_FAIL;
+		}
+	}
+
+	retval = benchmark_print_header(&sink, target);
+
+	for (unsigned int op = 0; retval == ERROR_OK && op < BENCHMARK_OP_COUNT; op++) {
+		if (ops[op])
+			retval = benchmark_sweep(&sink, target, op, address, max_size, buffer);
+	}
+
+	/* don't close a JSON document whose header or rows went missing */
+	if (retval == ERROR_OK)
+		retval = benchmark_print_footer(&sink);
+
+	free(sink.pending);
+
+	if (sink.file) {
+		if (fclose(sink.file) != 0) {
+			LOG_ERROR("Can't write %s: %s", benchmark_output, strerror(errno));
+			retval = ERROR_FAIL;
+		} else if (retval == ERROR_OK)
+			command_print(CMD, "benchmark results written to %s", benchmark_output);
+	}
+
+	free(buffer);
+
+	return retval;
+}
+
+COMMAND_HANDLER(handle_benchmark_format_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		unsigned int i;
+		for (i = 0; i < ARRAY_SIZE(benchmark_format_names); i++) {
+			if (strcmp(CMD_ARGV[0], benchmark_format_names[i]) == 0)
+				break;
+		}
+		if (i == ARRAY_SIZE(benchmark_format_names))
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		benchmark_format = i;
+	}
+
+	command_print(CMD, "benchmark format: %s", benchmark_format_names[benchmark_format]);
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_benchmark_output_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		free(benchmark_output);
+		benchmark_output = NULL;
+		if (strcmp(CMD_ARGV[0], "-") != 0)
+			benchmark_output = strdup(CMD_ARGV[0]);
+	}
+
+	command_print(CMD, "benchmark output: %s",
+			benchmark_output ? benchmark_output : "command output");
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_benchmark_repeat_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		unsigned int repeat;
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], repeat);
+		if (repeat == 0)
+			return ERROR_COMMAND_ARGUMENT_INVALID;
+		benchmark_repeat = repeat;
+	}
+
+	command_print(CMD, "benchmark repeat: %u", benchmark_repeat);
+	return ERROR_OK;
+}
+
+/* reference: the bit by bit copy buf_set_buf() used for unaligned fields */
+static void benchmark_bitcopy_reference(const uint8_t *src, unsigned int src_start,
+		uint8_t *dst, unsigned int dst_start, unsigned int len)
+{
+	for (unsigned int i = 0; i < len; i++) {
+		unsigned int s = src_start + i;
+		unsigned int d = dst_start + i;
+
+		if ((src[s / 8] >> (s % 8)) & 1)
+			dst[d / 8] |= 1 << (d % 8);
+		else
+			dst[d / 8] &= ~(1 << (d % 8));
+	}
+}
+
+/* nanoseconds per copy, run for about 50 ms */
+static double benchmark_bitcopy_time(bool reference, const uint8_t *src,
+		unsigned int src_start, uint8_t *dst, unsigned int dst_start, unsigned int len)
+{
+	struct duration bench;
+	unsigned long copies = 0;
+	unsigned int batch = 1;
+
+	duration_start(&bench);
+	do {
+		for (unsigned int i = 0; i < batch; i++) {
+			if (reference)
+				benchmark_bitcopy_reference(src, src_start, dst, dst_start, len);
+			else
+				buf_set_buf(src, src_start, dst, dst_start, len);
+		}
+		copies += batch;
+		batch *= 2;
+		duration_measure(&bench);
+	} while (duration_elapsed(&bench) < 0.05);
+
+	return duration_elapsed(&bench) * 1e9 / copies;
+}
+
+COMMAND_HANDLER(handle_benchmark_bitcopy_command)
+{
+	static const unsigned int default_lengths[] = { 7, 32, 33, 128, 1024, 16384 };
+	/* aligned, source only, destination only and both unaligned */
+	static const unsigned int offsets[][2] = { { 0, 0 }, { 3, 0 }, { 0, 5 }, { 3, 5 } };
+	unsigned int lengths[ARRAY_SIZE(default_lengths)];
+	unsigned int num_lengths = ARRAY_SIZE(default_lengths);
+	int retval = ERROR_OK;
+
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	memcpy(lengths, default_lengths, sizeof(lengths));
+	if (CMD_ARGC == 1) {
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], lengths[0]);
+		if (lengths[0] == 0 || lengths[0] > 1024 * 1024)
+			return ERROR_COMMAND_ARGUMENT_INVALID;
+		num_lengths = 1;
+	}
+
+	unsigned int max_len = 0;
+	for (unsigned int i = 0; i < num_lengths; i++)
+		max_len = MAX(max_len, lengths[i]);
+
+	size_t size = DIV_ROUND_UP(max_len + 8, 8);
+	uint8_t *src = malloc(size);
+	uint8_t *dst = malloc(size);
+	uint8_t *check = malloc(size);
+	if (!src || !dst || !check) {
+		LOG_ERROR("Out of memory");
+		retval = ERROR_FAIL;
+		goto done;
+	}
+
+	for (size_t i = 0; i < size; i++)
+		src[i] = rand();
+
+	command_print(CMD, "%8s %4s %4s %14s %14s %8s", "bits", "src", "dst",
+			"bitwise ns", "buf_set_buf ns", "speedup");
+
+	for (unsigned int i = 0; i < num_lengths; i++) {
+		for (unsigned int j = 0; j < ARRAY_SIZE(offsets); j++) {
+			unsigned int len = lengths[i];
+			unsigned int src_start = offsets[j][0];
+			unsigned int dst_start = offsets[j][1];
+
+			/* both must agree, bits around the field included */
+			memset(dst, 0xa5, size);
+			memset(check, 0xa5, size);
+			buf_set_buf(src, src_start, dst, dst_start, len);
+			benchmark_bitcopy_reference(src, src_start, check, dst_start, len);
+			if (memcmp(dst, check, size)) {
+				command_print(CMD, "copy of %u bits from offset %u to %u is wrong",
+						len, src_start, dst_start);
+				retval = ERROR_FAIL;
+				goto done;
+			}
+
+			double reference = benchmark_bitcopy_time(true, src, src_start,
+					dst, dst_start, len);
+			double word = benchmark_bitcopy_time(false, src, src_start,
+					dst, dst_start, len);
+
+			command_print(CMD, "%8u %4u %4u %14.1f %14.1f %7.1fx", len,
+					src_start, dst_start, reference, word, reference / word);
+		}
+	}
+
+done:
+	free(check);
+	free(dst);
+	free(src);
+
+	return retval;
+}
+
+static const struct command_registration benchmark_subcommand_handlers[] = {
+	{
+		.name = "memory",
+		.handler = handle_benchmark_memory_command,
+		.mode = COMMAND_EXEC,
+		.help = "Measure memory throughput of the current target over "
+			"a sweep of sizes, offsets and access widths. "
+			"Memory in the range is overwritten by write tests.",
+		.usage = "address max_size ['read'|'write'|'checksum'|'blank_check']...",
+	},
+	{
+		.name = "bitcopy",
+		.handler = handle_benchmark_bitcopy_command,
+		.mode = COMMAND_ANY,
+		.help = "Compare the speed of buf_set_buf() with a bit by bit copy, "
+			"for aligned and unaligned bit fields",
+		.usage = "[bits]",
+	},
+	{
+		.name = "format",
+		.handler = handle_benchmark_format_command,
+		.mode = COMMAND_ANY,
+		.help = "Display or set the format of benchmark results",
+		.usage = "['text'|'csv'|'json']",
+	},
+	{
+		.name = "output",
+		.handler = handle_benchmark_output_command,
+		.mode = COMMAND_ANY,
+		.help = "Display or set the file benchmark results are written to, "
+			"'-' selects the command output",
+		.usage = "[filename|'-']",
+	},
+	{
+		.name = "repeat",
+		.handler = handle_benchmark_repeat_command,
+		.mode = COMMAND_ANY,
+		.help = "Display or set how often each measurement is repeated",
+		.usage = "[count]",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+static const struct command_registration benchmark_command_handlers[] = {
+	{
+		.name = "benchmark",
+		.mode = COMMAND_ANY,
+		.help = "benchmark command group",
+		.usage = "",
+		.chain = benchmark_subcommand_handlers,
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+int benchmark_register_commands(struct command_context *cmd_ctx)
+{
+	return register_commands(cmd_ctx, NULL, benchmark_command_handlers);
+}
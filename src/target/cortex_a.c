@@ -2590,7 +2590,8 @@ static int cortex_a_handle_target_request(void *priv)
 
 		/* check if we have data */
 		int64_t then = timeval_ms();
-		while ((dscr & DSCR_DTR_TX_FULL) && (retval == ERROR_OK)) {
+		while ((dscr & DSCR_DTR_TX_FULL) && (retval == ERROR_OK) &&
+				target_request_ready()) {
 			retval = mem_ap_read_atomic_u32(armv7a->debug_ap,
 					armv7a->debug_base + CPUDBG_DTRTX, &request);
 			if (retval == ERROR_OK) {
@@ -89,6 +89,150 @@ static int cortexm_dap_read_coreregister_u32(struct target *target,
 	return retval;
 }
 
+/* Debug Core Register Selector values go up to S31 */
+#define DCRSR_SEL_NUM	0x60
+
+/* DCRSR selector of the (first word of) a register read by
+ * cortex_m_fetch_core_regs(), -1 for registers it can't read */
+static int cortex_m_dcrsr_selector(unsigned int num)
+{
+	switch (num) {
+		case ARMV7M_R0 ... ARMV7M_PSP:
+			return num;
+		case ARMV7M_PRIMASK ... ARMV7M_CONTROL:
+			return 20;
+		case ARMV7M_FPSCR:
+			return 0x21;
+		case ARMV7M_S0 ... ARMV7M_S31:
+			return num - ARMV7M_S0 + 0x40;
+		case ARMV7M_D0 ... ARMV7M_D15:
+			return 2 * (num - ARMV7M_D0) + 0x40;
+		default:
+			return -1;
+	}
+}
+
+/**
+ * Read the invalid core registers of @a regs in a single DAP transaction:
+ * all the DCRSR writes and DCRDR reads are queued before the queue is run,
+ * instead of one round trip per register in cortex_m_load_core_reg_u32().
+ * Registers of other caches are left alone.
+ */
+static int cortex_m_fetch_core_regs(struct target *target,
+		struct reg **regs, int num_regs)
+{
+	struct armv7m_common *armv7m = target_to_armv7m(target);
+	struct reg_cache *cache = armv7m->arm.core_cache;
+	uint32_t values[DCRSR_SEL_NUM];
+	bool wanted[DCRSR_SEL_NUM] = { false };
+	bool any = false;
+	uint32_t dcrdr;
+	int retval = ERROR_OK;
+	int i, sel;
+
+	for (i = 0; i < num_regs; i++) {
+		struct reg *r = regs[i];
+
+		if (r == NULL || r->valid || r < cache->reg_list ||
+				r >= cache->reg_list + cache->num_regs)
+			continue;
+
+		struct arm_reg *arm_reg = r->arch_info;
+		sel = cortex_m_dcrsr_selector(arm_reg->num);
+		if (sel < 0)
+			continue;
+
+		wanted[sel] = true;
+		if (arm_reg->num >= ARMV7M_D0 && arm_reg->num <= ARMV7M_D15)
+			wanted[sel + 1] = true;
+		any = true;
+	}
+
+	if (!any)
+		return ERROR_OK;
+
+	/* the emulated dcc channel uses DCB_DCRDR, see
+	 * cortexm_dap_read_coreregister_u32() */
+	if (target->dbg_msg_enabled) {
+		retval = mem_ap_read_atomic_u32(armv7m->debug_ap, DCB_DCRDR, &dcrdr);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	for (sel = 0; sel < DCRSR_SEL_NUM && retval == ERROR_OK; sel++) {
+		if (!wanted[sel])
+			continue;
+		retval = mem_ap_write_u32(armv7m->debug_ap, DCB_DCRSR, sel);
+		if (retval == ERROR_OK)
+			retval = mem_ap_read_u32(armv7m->debug_ap, DCB_DCRDR, &values[sel]);
+	}
+
+	/* run what has been queued even after an error */
+	int run_retval = dap_run(armv7m->debug_ap->dap);
+	if (retval == ERROR_OK)
+		retval = run_retval;
+
+	if (target->dbg_msg_enabled) {
+		int restore_retval = mem_ap_write_atomic_u32(armv7m->debug_ap, DCB_DCRDR, dcrdr);
+		if (retval == ERROR_OK)
+			retval = restore_retval;
+	}
+
+	if (retval != ERROR_OK)
+		return retval;
+
+	for (i = 0; i < num_regs; i++) {
+		struct reg *r = regs[i];
+
+		if (r == NULL || r->valid || r < cache->reg_list ||
+				r >= cache->reg_list + cache->num_regs)
+			continue;
+
+		struct arm_reg *arm_reg = r->arch_info;
+		sel = cortex_m_dcrsr_selector(arm_reg->num);
+		if (sel < 0)
+			continue;
+
+		switch (arm_reg->num) {
+			case ARMV7M_PRIMASK:
+				buf_set_u32(r->value, 0, 32, values[sel] & 0x1);
+				break;
+			case ARMV7M_BASEPRI:
+				buf_set_u32(r->value, 0, 32, (values[sel] >> 8) & 0xff);
+				break;
+			case ARMV7M_FAULTMASK:
+				buf_set_u32(r->value, 0, 32, (values[sel] >> 16) & 0x1);
+				break;
+			case ARMV7M_CONTROL:
+				buf_set_u32(r->value, 0, 32, (values[sel] >> 24) & 0x3);
+				break;
+			case ARMV7M_D0 ... ARMV7M_D15:
+				buf_set_u32(r->value, 0, 32, values[sel]);
+				buf_set_u32((uint8_t *)r->value + 4, 0, 32, values[sel + 1]);
+				break;
+			default:
+				buf_set_u32(r->value, 0, 32, values[sel]);
+				break;
+		}
+
+		r->valid = true;
+		r->dirty = false;
+	}
+
+	return ERROR_OK;
+}
+
+static int cortex_m_fetch_registers(struct target *target,
+		struct reg **reg_list, int reg_list_size)
+{
+	if (target->state != TARGET_HALTED) {
+		LOG_WARNING("target not halted");
+		return ERROR_TARGET_NOT_HALTED;
+	}
+
+	return cortex_m_fetch_core_regs(target, reg_list, reg_list_size);
+}
+
 static int cortexm_dap_write_coreregister_u32(struct target *target,
 	uint32_t value, int regnum)
 {
@@ -497,6 +641,15 @@ static int cortex_m_debug_entry(struct target *target)
 	/* Examine target state and mode
 	 * First load register accessible through core debug port */
 	int num_regs = arm->core_cache->num_regs;
+	struct reg *regs[ARMV7M_LAST_REG];
+
+	for (i = 0; i < num_regs && i < ARMV7M_LAST_REG; i++)
+		regs[i] = &armv7m->arm.core_cache->reg_list[i];
+
+	/* read them all at once, then any stragglers one by one */
+	retval = cortex_m_fetch_core_regs(target, regs, i);
+	if (retval != ERROR_OK)
+		LOG_DEBUG("batched register read failed, reading one by one");
 
 	for (i = 0; i < num_regs; i++) {
 		r = &armv7m->arm.core_cache->reg_list[i];
@@ -1763,6 +1916,38 @@ static int cortex_m_write_memory(struct target *target, target_addr_t address,
 	return mem_ap_write_buf(armv7m->debug_ap, buffer, size, count, address);
 }
 
+static int cortex_m_read_memory_batch(struct target *target,
+	struct target_memory_transfer *transfers, unsigned int num_transfers)
+{
+	struct armv7m_common *armv7m = target_to_armv7m(target);
+
+	if (armv7m->arm.is_armv6m) {
+		for (unsigned int i = 0; i < num_transfers; i++) {
+			/* armv6m does not handle unaligned memory access */
+			if (transfers[i].address % transfers[i].size)
+				return ERROR_TARGET_UNALIGNED_ACCESS;
+		}
+	}
+
+	return mem_ap_read_buf_batch(armv7m->debug_ap, transfers, num_transfers);
+}
+
+static int cortex_m_write_memory_batch(struct target *target,
+	const struct target_memory_transfer *transfers, unsigned int num_transfers)
+{
+	struct armv7m_common *armv7m = target_to_armv7m(target);
+
+	if (armv7m->arm.is_armv6m) {
+		for (unsigned int i = 0; i < num_transfers; i++) {
+			/* armv6m does not handle unaligned memory access */
+			if (transfers[i].address % transfers[i].size)
+				return ERROR_TARGET_UNALIGNED_ACCESS;
+		}
+	}
+
+	return mem_ap_write_buf_batch(armv7m->debug_ap, transfers, num_transfers);
+}
+
 static int cortex_m_init_target(struct command_context *cmd_ctx,
 	struct target *target)
 {
@@ -1779,13 +1964,14 @@ void cortex_m_deinit_target(struct target *target)
 
 	cortex_m_dwt_free(target);
 	armv7m_free_reg_cache(target);
+	armv7m_trace_free(target);
 
 	free(target->private_config);
 	free(cortex_m);
 }
 
 int cortex_m_profiling(struct target *target, uint32_t *samples,
-			      uint32_t max_num_samples, uint32_t *num_samples, uint32_t seconds)
+			      uint32_t max_num_samples, uint32_t *num_samples, uint32_t duration_ms)
 {
 	struct timeval timeout, now;
 	struct armv7m_common *armv7m = target_to_armv7m(target);
@@ -1795,7 +1981,7 @@ int cortex_m_profiling(struct target *target, uint32_t *samples,
 	struct reg *reg;
 
 	gettimeofday(&timeout, NULL);
-	timeval_add_time(&timeout, seconds, 0);
+	timeval_add_time(&timeout, duration_ms / 1000, (duration_ms % 1000) * 1000);
 
 	retval = target_read_u32(target, DWT_PCSR, &reg_value);
 	if (retval != ERROR_OK) {
@@ -1805,9 +1991,9 @@ int cortex_m_profiling(struct target *target, uint32_t *samples,
 
 	if (reg_value != 0) {
 		use_pcsr = true;
-		LOG_INFO("Starting Cortex-M profiling. Sampling DWT_PCSR as fast as we can...");
+		LOG_DEBUG("Starting Cortex-M profiling. Sampling DWT_PCSR as fast as we can...");
 	} else {
-		LOG_INFO("Starting profiling. Halting and resuming the"
+		LOG_DEBUG("Starting profiling. Halting and resuming the"
 			 " target as often as we can...");
 		reg = register_get_by_name(target->reg_cache, "pc", 1);
 	}
@@ -1834,9 +2020,18 @@ int cortex_m_profiling(struct target *target, uint32_t *samples,
 				retval = mem_ap_read_buf_noincr(armv7m->debug_ap,
 							(void *)&samples[sample_count],
 							4, read_count, DWT_PCSR);
-				sample_count += read_count;
+
+				/* PCSR reads as all ones while the core is halted
+				 * or sleeping, such samples carry no PC */
+				for (uint32_t i = 0; i < read_count; i++) {
+					uint32_t pc = le_to_h_u32((uint8_t *)&samples[sample_count + i]);
+					if (pc != 0xffffffff)
+						samples[sample_count++] = pc;
+				}
 			} else {
-				target_read_u32(target, DWT_PCSR, &samples[sample_count++]);
+				retval = target_read_u32(target, DWT_PCSR, &samples[sample_count]);
+				if (samples[sample_count] != 0xffffffff)
+					sample_count++;
 			}
 		} else {
 			target_poll(target);
@@ -1865,7 +2060,7 @@ int cortex_m_profiling(struct target *target, uint32_t *samples,
 
 		gettimeofday(&now, NULL);
 		if (sample_count >= max_num_samples || timeval_compare(&now, &timeout) > 0) {
-			LOG_INFO("Profiling completed. %" PRIu32 " samples.", sample_count);
+			LOG_DEBUG("Profiling completed. %" PRIu32 " samples.", sample_count);
 			break;
 		}
 	}
@@ -2287,29 +2482,36 @@ static int cortex_m_handle_target_request(void *priv)
 	if (!target->dbg_msg_enabled)
 		return ERROR_OK;
 
-	if (target->state == TARGET_RUNNING) {
+	/* drain up to a batch of requests while the target keeps sending */
+	for (int n = 0; n < TARGET_REQUEST_BATCH && target->state == TARGET_RUNNING; n++) {
 		uint8_t data;
 		uint8_t ctrl;
 		int retval;
 
+		if (!target_request_ready())
+			break;
+
 		retval = cortex_m_dcc_read(target, &data, &ctrl);
 		if (retval != ERROR_OK)
 			return retval;
 
 		/* check if we have data */
-		if (ctrl & (1 << 0)) {
-			uint32_t request;
+		if (!(ctrl & (1 << 0)))
+			break;
 
-			/* we assume target is quick enough */
-			request = data;
-			for (int i = 1; i <= 3; i++) {
-				retval = cortex_m_dcc_read(target, &data, &ctrl);
-				if (retval != ERROR_OK)
-					return retval;
-				request |= ((uint32_t)data << (i * 8));
-			}
-			target_request(target, request);
+		uint32_t request;
+
+		/* we assume target is quick enough */
+		request = data;
+		for (int i = 1; i <= 3; i++) {
+			retval = cortex_m_dcc_read(target, &data, &ctrl);
+			if (retval != ERROR_OK)
+				return retval;
+			request |= ((uint32_t)data << (i * 8));
 		}
+		retval = target_request(target, request);
+		if (retval != ERROR_OK)
+			return retval;
 	}
 
 	return ERROR_OK;
@@ -2612,9 +2814,12 @@ struct target_type cortexm_target = {
 
 	.get_gdb_arch = arm_get_gdb_arch,
 	.get_gdb_reg_list = armv7m_get_gdb_reg_list,
+	.fetch_registers = cortex_m_fetch_registers,
 
 	.read_memory = cortex_m_read_memory,
 	.write_memory = cortex_m_write_memory,
+	.read_memory_batch = cortex_m_read_memory_batch,
+	.write_memory_batch = cortex_m_write_memory_batch,
 	.checksum_memory = armv7m_checksum_memory,
 	.blank_check_memory = armv7m_blank_check_memory,
 
@@ -293,37 +293,44 @@ static int hl_handle_target_request(void *priv)
 	if (!target->dbg_msg_enabled)
 		return ERROR_OK;
 
-	if (target->state == TARGET_RUNNING) {
+	/* drain up to a batch of requests while the target keeps sending */
+	for (int n = 0; n < TARGET_REQUEST_BATCH && target->state == TARGET_RUNNING; n++) {
 		uint8_t data;
 		uint8_t ctrl;
 
+		if (!target_request_ready())
+			break;
+
 		err = hl_dcc_read(hl_if, &data, &ctrl);
 		if (err != ERROR_OK)
 			return err;
 
 		/* check if we have data */
-		if (ctrl & (1 << 0)) {
-			uint32_t request;
-
-			/* we assume target is quick enough */
-			request = data;
-			err = hl_dcc_read(hl_if, &data, &ctrl);
-			if (err != ERROR_OK)
-				return err;
-
-			request |= (data << 8);
-			err = hl_dcc_read(hl_if, &data, &ctrl);
-			if (err != ERROR_OK)
-				return err;
-
-			request |= (data << 16);
-			err = hl_dcc_read(hl_if, &data, &ctrl);
-			if (err != ERROR_OK)
-				return err;
-
-			request |= (data << 24);
-			target_request(target, request);
-		}
+		if (!(ctrl & (1 << 0)))
+			break;
+
+		uint32_t request;
+
+		/* we assume target is quick enough */
+		request = data;
+		err = hl_dcc_read(hl_if, &data, &ctrl);
+		if (err != ERROR_OK)
+			return err;
+
+		request |= (data << 8);
+		err = hl_dcc_read(hl_if, &data, &ctrl);
+		if (err != ERROR_OK)
+			return err;
+
+		request |= (data << 16);
+		err = hl_dcc_read(hl_if, &data, &ctrl);
+		if (err != ERROR_OK)
+			return err;
+
+		request |= (data << 24);
+		err = target_request(target, request);
+		if (err != ERROR_OK)
+			return err;
 	}
 
 	return ERROR_OK;
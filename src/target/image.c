@@ -31,6 +31,7 @@
 
 #include "image.h"
 #include "target.h"
+#include <helper/binarybuffer.h>
 #include <helper/log.h>
 
 /* convert ELF header field to host endianness */
@@ -115,6 +116,30 @@ static int identify_image_type(struct image *image, const char *type_string, con
 	return ERROR_OK;
 }
 
+/**
+ * The data of text format images is decoded into a buffer sized for the
+ * worst case before parsing; give the unused tail back once the amount of
+ * data is known, keeping the sections pointing at their data.
+ */
+static void image_buffer_shrink(struct image *image, uint8_t **buffer, uint32_t used)
+{
+	size_t *offsets = malloc(image->num_sections * sizeof(*offsets));
+	if (offsets == NULL)
+		return;
+
+	for (int i = 0; i < image->num_sections; i++)
+		offsets[i] = (uint8_t *)image->sections[i].private - *buffer;
+
+	uint8_t *shrunk = realloc(*buffer, used ? used : 1);
+	if (shrunk) {
+		*buffer = shrunk;
+		for (int i = 0; i < image->num_sections; i++)
+			image->sections[i].private = shrunk + offsets[i];
+	}
+
+	free(offsets);
+}
+
 static int image_ihex_buffer_complete_inner(struct image *image,
 	char *lpszLine,
 	struct imagesection *section)
@@ -191,16 +216,15 @@ static int image_ihex_buffer_complete_inner(struct image *image,
 					full_address = (full_address & 0xffff0000) | address;
 				}
 
-				while (count-- > 0) {
-					unsigned value;
-					sscanf(&lpszLine[bytes_read], "%2x", &value);
-					ihex->buffer[cooked_bytes] = (uint8_t)value;
-					cal_checksum += (uint8_t)ihex->buffer[cooked_bytes];
-					bytes_read += 2;
-					cooked_bytes += 1;
-					section[image->num_sections].size += 1;
-					full_address++;
-				}
+				if (strlen(&lpszLine[bytes_read]) < 2 * count ||
+						unhexify(&ihex->buffer[cooked_bytes], &lpszLine[bytes_read], count) != count)
+					return ERROR_IMAGE_FORMAT_ERROR;
+				for (i = 0; i < (int)count; i++)
+					cal_checksum += ihex->buffer[cooked_bytes + i];
+				bytes_read += 2 * count;
+				cooked_bytes += count;
+				section[image->num_sections].size += count;
+				full_address += count;
 			} else if (record_type == 1) {	/* End of File Record */
 				/* finish the current section */
 				image->num_sections++;
@@ -316,9 +340,10 @@ static int image_ihex_buffer_complete_inner(struct image *image,
 		}
 	}
 
-	if (end_rec)
+	if (end_rec) {
+		image_buffer_shrink(image, &ihex->buffer, cooked_bytes);
 		return ERROR_OK;
-	else {
+	} else {
 		LOG_ERROR("premature end of IHEX file, no matching end-of-file record found");
 		return ERROR_IMAGE_FORMAT_ERROR;
 	}
@@ -624,6 +649,11 @@ static int image_mot_buffer_complete_inner(struct image *image,
 					 */
 					if (section[image->num_sections].size != 0) {
 						image->num_sections++;
+						if (image->num_sections >= IMAGE_MAX_SECTIONS) {
+							/* too many sections */
+							LOG_ERROR("Too many sections found in S19 file");
+							return ERROR_IMAGE_FORMAT_ERROR;
+						}
 						section[image->num_sections].size = 0x0;
 						section[image->num_sections].flags = 0;
 						section[image->num_sections].private =
@@ -633,16 +663,15 @@ static int image_mot_buffer_complete_inner(struct image *image,
 					full_address = address;
 				}
 
-				while (count-- > 0) {
-					unsigned value;
-					sscanf(&lpszLine[bytes_read], "%2x", &value);
-					mot->buffer[cooked_bytes] = (uint8_t)value;
-					cal_checksum += (uint8_t)mot->buffer[cooked_bytes];
-					bytes_read += 2;
-					cooked_bytes += 1;
-					section[image->num_sections].size += 1;
-					full_address++;
-				}
+				if (strlen(&lpszLine[bytes_read]) < 2 * count ||
+						unhexify(&mot->buffer[cooked_bytes], &lpszLine[bytes_read], count) != count)
+					return ERROR_IMAGE_FORMAT_ERROR;
+				for (i = 0; i < (int)count; i++)
+					cal_checksum += mot->buffer[cooked_bytes + i];
+				bytes_read += 2 * count;
+				cooked_bytes += count;
+				section[image->num_sections].size += count;
+				full_address += count;
 			} else if (record_type == 5 || record_type == 6) {
 				/* S5 and S6 are the data count records, we ignore them */
 				uint32_t dummy;
@@ -689,9 +718,10 @@ static int image_mot_buffer_complete_inner(struct image *image,
 		}
 	}
 
-	if (end_rec)
+	if (end_rec) {
+		image_buffer_shrink(image, &mot->buffer, cooked_bytes);
 		return ERROR_OK;
-	else {
+	} else {
 		LOG_ERROR("premature end of S19 file, no matching end-of-file record found");
 		return ERROR_IMAGE_FORMAT_ERROR;
 	}
@@ -841,6 +871,49 @@ int image_open(struct image *image, const char *url, const char *type_string)
 	return retval;
 };
 
+int image_section_view(struct image *image,
+	int section,
+	uint32_t offset,
+	uint32_t size,
+	const uint8_t **data)
+{
+	const uint8_t *map;
+	size_t filesize;
+
+	/* don't read past the end of a section */
+	if (offset + size > image->sections[section].size)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (image->type == IMAGE_BINARY) {
+		struct image_binary *image_binary = image->type_private;
+
+		if (fileio_map(image_binary->fileio, &map) != ERROR_OK)
+			return ERROR_IMAGE_TEMPORARILY_UNAVAILABLE;
+
+		*data = map + offset;
+	} else if (image->type == IMAGE_ELF) {
+		struct image_elf *elf = image->type_private;
+		Elf32_Phdr *segment = (Elf32_Phdr *)image->sections[section].private;
+		uint32_t file_offset = field32(elf, segment->p_offset);
+
+		if (fileio_size(elf->fileio, &filesize) != ERROR_OK ||
+				file_offset > filesize ||
+				filesize - file_offset < field32(elf, segment->p_filesz))
+			return ERROR_IMAGE_TEMPORARILY_UNAVAILABLE;
+
+		if (fileio_map(elf->fileio, &map) != ERROR_OK)
+			return ERROR_IMAGE_TEMPORARILY_UNAVAILABLE;
+
+		*data = map + file_offset + offset;
+	} else if (image->type == IMAGE_IHEX || image->type == IMAGE_SRECORD
+			|| image->type == IMAGE_BUILDER) {
+		*data = (uint8_t *)image->sections[section].private + offset;
+	} else
+		return ERROR_IMAGE_TEMPORARILY_UNAVAILABLE;
+
+	return ERROR_OK;
+}
+
 int image_read_section(struct image *image,
 	int section,
 	uint32_t offset,
@@ -848,6 +921,7 @@ int image_read_section(struct image *image,
 	uint8_t *buffer,
 	size_t *size_read)
 {
+	const uint8_t *view;
 	int retval;
 
 	/* don't read past the end of a section */
@@ -860,6 +934,14 @@ int image_read_section(struct image *image,
 		return ERROR_COMMAND_SYNTAX_ERROR;
 	}
 
+	/* mapped files are copied from directly instead of being read */
+	if ((image->type == IMAGE_BINARY || image->type == IMAGE_ELF)
+			&& image_section_view(image, section, offset, size, &view) == ERROR_OK) {
+		memcpy(buffer, view, size);
+		*size_read = size;
+		return ERROR_OK;
+	}
+
 	if (image->type == IMAGE_BINARY) {
 		struct image_binary *image_binary = image->type_private;
 
@@ -94,6 +94,18 @@ struct image_mot {
 int image_open(struct image *image, const char *url, const char *type_string);
 int image_read_section(struct image *image, int section, uint32_t offset,
 		uint32_t size, uint8_t *buffer, size_t *size_read);
+/**
+ * Get direct, read-only access to @a size bytes of an image @a section from
+ * @a offset, without copying them. This is possible for the formats whose
+ * data is held in host memory: mapped binary and ELF files, parsed IHEX and
+ * S19 files, images being built.
+ *
+ * @returns ERROR_OK and sets @a data, or ERROR_IMAGE_TEMPORARILY_UNAVAILABLE
+ * if the data has to be read with image_read_section() instead.
+ * The view remains valid until the image is closed or modified.
+ */
+int image_section_view(struct image *image, int section, uint32_t offset,
+		uint32_t size, const uint8_t **data);
 void image_close(struct image *image);
 
 int image_add_section(struct image *image, uint32_t base, uint32_t size,
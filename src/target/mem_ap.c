@@ -164,6 +164,26 @@ static int mem_ap_write_memory(struct target *target, target_addr_t address,
 	return mem_ap_write_buf(mem_ap->ap, buffer, size, count, address);
 }
 
+static int mem_ap_read_memory_batch(struct target *target,
+		struct target_memory_transfer *transfers, unsigned int num_transfers)
+{
+	struct mem_ap *mem_ap = target->arch_info;
+
+	LOG_DEBUG("Reading %u blocks of memory", num_transfers);
+
+	return mem_ap_read_buf_batch(mem_ap->ap, transfers, num_transfers);
+}
+
+static int mem_ap_write_memory_batch(struct target *target,
+		const struct target_memory_transfer *transfers, unsigned int num_transfers)
+{
+	struct mem_ap *mem_ap = target->arch_info;
+
+	LOG_DEBUG("Writing %u blocks of memory", num_transfers);
+
+	return mem_ap_write_buf_batch(mem_ap->ap, transfers, num_transfers);
+}
+
 struct target_type mem_ap_target = {
 	.name = "mem_ap",
 
@@ -184,4 +204,6 @@ struct target_type mem_ap_target = {
 
 	.read_memory = mem_ap_read_memory,
 	.write_memory = mem_ap_write_memory,
+	.read_memory_batch = mem_ap_read_memory_batch,
+	.write_memory_batch = mem_ap_write_memory_batch,
 };
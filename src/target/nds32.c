@@ -2492,10 +2492,10 @@ int nds32_gdb_fileio_end(struct target *target, int retcode, int fileio_errno, b
 }
 
 int nds32_profiling(struct target *target, uint32_t *samples,
-			uint32_t max_num_samples, uint32_t *num_samples, uint32_t seconds)
+			uint32_t max_num_samples, uint32_t *num_samples, uint32_t duration_ms)
 {
 	/* sample $PC every 10 milliseconds */
-	uint32_t iteration = seconds * 100;
+	uint32_t iteration = DIV_ROUND_UP(duration_ms, 10);
 	struct aice_port_s *aice = target_to_aice(target);
 	struct nds32 *nds32 = target_to_nds32(target);
 
@@ -426,7 +426,7 @@ extern int nds32_gdb_fileio_end(struct target *target, int retcode, int fileio_e
 extern int nds32_reset_halt(struct nds32 *nds32);
 extern int nds32_login(struct nds32 *nds32);
 extern int nds32_profiling(struct target *target, uint32_t *samples,
-			uint32_t max_num_samples, uint32_t *num_samples, uint32_t seconds);
+			uint32_t max_num_samples, uint32_t *num_samples, uint32_t duration_ms);
 
 /** Convert target handle to generic Andes target state handle. */
 static inline struct nds32 *target_to_nds32(struct target *target)
@@ -1213,7 +1213,7 @@ static int or1k_checksum_memory(struct target *target, target_addr_t address,
 }
 
 static int or1k_profiling(struct target *target, uint32_t *samples,
-		uint32_t max_num_samples, uint32_t *num_samples, uint32_t seconds)
+		uint32_t max_num_samples, uint32_t *num_samples, uint32_t duration_ms)
 {
 	struct timeval timeout, now;
 	struct or1k_common *or1k = target_to_or1k(target);
@@ -1221,7 +1221,7 @@ static int or1k_profiling(struct target *target, uint32_t *samples,
 	int retval = ERROR_OK;
 
 	gettimeofday(&timeout, NULL);
-	timeval_add_time(&timeout, seconds, 0);
+	timeval_add_time(&timeout, duration_ms / 1000, (duration_ms % 1000) * 1000);
 
 	LOG_INFO("Starting or1k profiling. Sampling npc as fast as we can...");
 
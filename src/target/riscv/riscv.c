@@ -926,6 +926,42 @@ static int riscv_write_memory(struct target *target, target_addr_t address,
 	return tt->write_memory(target, address, size, count, buffer);
 }
 
+/* Select the hart once for the whole batch, then let the version specific
+ * code either batch the DMI accesses itself or do one transfer at a time. */
+static int riscv_read_memory_batch(struct target *target,
+		struct target_memory_transfer *transfers, unsigned int num_transfers)
+{
+	if (riscv_select_current_hart(target) != ERROR_OK)
+		return ERROR_FAIL;
+	struct target_type *tt = get_target_type(target);
+	if (tt->read_memory_batch)
+		return tt->read_memory_batch(target, transfers, num_transfers);
+	for (unsigned int i = 0; i < num_transfers; i++) {
+		int result = tt->read_memory(target, transfers[i].address,
+				transfers[i].size, transfers[i].count, transfers[i].buffer);
+		if (result != ERROR_OK)
+			return result;
+	}
+	return ERROR_OK;
+}
+
+static int riscv_write_memory_batch(struct target *target,
+		const struct target_memory_transfer *transfers, unsigned int num_transfers)
+{
+	if (riscv_select_current_hart(target) != ERROR_OK)
+		return ERROR_FAIL;
+	struct target_type *tt = get_target_type(target);
+	if (tt->write_memory_batch)
+		return tt->write_memory_batch(target, transfers, num_transfers);
+	for (unsigned int i = 0; i < num_transfers; i++) {
+		int result = tt->write_memory(target, transfers[i].address,
+				transfers[i].size, transfers[i].count, transfers[i].buffer);
+		if (result != ERROR_OK)
+			return result;
+	}
+	return ERROR_OK;
+}
+
 static int riscv_get_gdb_reg_list_internal(struct target *target,
 		struct reg **reg_list[], int *reg_list_size,
 		enum target_register_class reg_class, bool read)
@@ -1979,6 +2015,8 @@ struct target_type riscv_target = {
 
 	.read_memory = riscv_read_memory,
 	.write_memory = riscv_write_memory,
+	.read_memory_batch = riscv_read_memory_batch,
+	.write_memory_batch = riscv_write_memory_batch,
 
 	.checksum_memory = riscv_checksum_memory,
 
@@ -51,6 +51,7 @@
 #include "breakpoints.h"
 #include "register.h"
 #include "trace.h"
+#include "benchmark.h"
 #include "image.h"
 #include "rtos/rtos.h"
 #include "transport/transport.h"
@@ -73,7 +74,7 @@ static int target_get_gdb_fileio_info_default(struct target *target,
 static int target_gdb_fileio_end_default(struct target *target, int retcode,
 		int fileio_errno, bool ctrl_c);
 static int target_profiling_default(struct target *target, uint32_t *samples,
-		uint32_t max_num_samples, uint32_t *num_samples, uint32_t seconds);
+		uint32_t max_num_samples, uint32_t *num_samples, uint32_t duration_ms);
 
 /* targets */
 extern struct target_type arm7tdmi_target;
@@ -1136,6 +1137,68 @@ int target_write_phys_memory(struct target *target,
 	return target->type->write_phys_memory(target, address, size, count, buffer);
 }
 
+void target_memory_transfer_init(struct target_memory_transfer *transfer,
+		target_addr_t address, uint32_t len, uint8_t *buffer)
+{
+	uint32_t size = 4;
+
+	while (size > 1 && ((address | len) & (size - 1)))
+		size /= 2;
+
+	transfer->address = address;
+	transfer->size = size;
+	transfer->count = len / size;
+	transfer->buffer = buffer;
+}
+
+int target_read_memory_batch(struct target *target,
+		struct target_memory_transfer *transfers, unsigned int num_transfers)
+{
+	if (!target_was_examined(target)) {
+		LOG_ERROR("Target not examined yet");
+		return ERROR_FAIL;
+	}
+
+	if (num_transfers == 0)
+		return ERROR_OK;
+
+	if (target->type->read_memory_batch)
+		return target->type->read_memory_batch(target, transfers, num_transfers);
+
+	for (unsigned int i = 0; i < num_transfers; i++) {
+		int retval = target_read_memory(target, transfers[i].address,
+				transfers[i].size, transfers[i].count, transfers[i].buffer);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	return ERROR_OK;
+}
+
+int target_write_memory_batch(struct target *target,
+		const struct target_memory_transfer *transfers, unsigned int num_transfers)
+{
+	if (!target_was_examined(target)) {
+		LOG_ERROR("Target not examined yet");
+		return ERROR_FAIL;
+	}
+
+	if (num_transfers == 0)
+		return ERROR_OK;
+
+	if (target->type->write_memory_batch)
+		return target->type->write_memory_batch(target, transfers, num_transfers);
+
+	for (unsigned int i = 0; i < num_transfers; i++) {
+		int retval = target_write_memory(target, transfers[i].address,
+				transfers[i].size, transfers[i].count, transfers[i].buffer);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	return ERROR_OK;
+}
+
 int target_add_breakpoint(struct target *target,
 		struct breakpoint *breakpoint)
 {
@@ -1218,6 +1281,15 @@ int target_get_gdb_reg_list(struct target *target,
 	return target->type->get_gdb_reg_list(target, reg_list, reg_list_size, reg_class);
 }
 
+int target_fetch_registers(struct target *target,
+		struct reg **reg_list, int reg_list_size)
+{
+	if (!target->type->fetch_registers)
+		return ERROR_OK;
+
+	return target->type->fetch_registers(target, reg_list, reg_list_size);
+}
+
 bool target_supports_gdb_connection(struct target *target)
 {
 	/*
@@ -1268,14 +1340,14 @@ unsigned target_address_bits(struct target *target)
 }
 
 int target_profiling(struct target *target, uint32_t *samples,
-			uint32_t max_num_samples, uint32_t *num_samples, uint32_t seconds)
+			uint32_t max_num_samples, uint32_t *num_samples, uint32_t duration_ms)
 {
 	if (target->state != TARGET_HALTED) {
 		LOG_WARNING("target %s is not halted (profiling)", target->cmd_name);
 		return ERROR_TARGET_NOT_HALTED;
 	}
 	return target->type->profiling(target, samples, max_num_samples,
-			num_samples, seconds);
+			num_samples, duration_ms);
 }
 
 /**
@@ -1695,6 +1767,24 @@ int target_call_timer_callbacks_now(void)
 	return target_call_timer_callbacks_check_time(0);
 }
 
+int64_t target_timer_next_event(void)
+{
+	int64_t next_event = INT64_MAX;
+
+	for (struct target_timer_callback *c = target_timer_callbacks; c; c = c->next) {
+		if (c->removed || !c->callback)
+			continue;
+
+		/* round up, so that a callback due in less than a millisecond
+		 * doesn't turn into a zero timeout and a busy loop */
+		int64_t when = (int64_t)c->when.tv_sec * 1000 + (c->when.tv_usec + 999) / 1000;
+		if (when < next_event)
+			next_event = when;
+	}
+
+	return next_event;
+}
+
 /* Prints the working area layout for debug purposes */
 static void print_wa_layout(struct target *target)
 {
@@ -2091,14 +2181,14 @@ static int target_gdb_fileio_end_default(struct target *target,
 }
 
 static int target_profiling_default(struct target *target, uint32_t *samples,
-		uint32_t max_num_samples, uint32_t *num_samples, uint32_t seconds)
+		uint32_t max_num_samples, uint32_t *num_samples, uint32_t duration_ms)
 {
 	struct timeval timeout, now;
 
 	gettimeofday(&timeout, NULL);
-	timeval_add_time(&timeout, seconds, 0);
+	timeval_add_time(&timeout, duration_ms / 1000, (duration_ms % 1000) * 1000);
 
-	LOG_INFO("Starting profiling. Halting and resuming the"
+	LOG_DEBUG("Starting profiling. Halting and resuming the"
 			" target as often as we can...");
 
 	uint32_t sample_count = 0;
@@ -2129,7 +2219,7 @@ static int target_profiling_default(struct target *target, uint32_t *samples,
 
 		gettimeofday(&now, NULL);
 		if ((sample_count >= max_num_samples) || timeval_compare(&now, &timeout) >= 0) {
-			LOG_INFO("Profiling completed. %" PRIu32 " samples.", sample_count);
+			LOG_DEBUG("Profiling completed. %" PRIu32 " samples.", sample_count);
 			break;
 		}
 	}
@@ -3382,6 +3472,7 @@ static COMMAND_HELPER(parse_load_image_command_CMD_ARGV, struct image *image,
 COMMAND_HANDLER(handle_load_image_command)
 {
 	uint8_t *buffer;
+	const uint8_t *data;
 	size_t buf_cnt;
 	uint32_t image_size;
 	target_addr_t min_address = 0;
@@ -3405,19 +3496,26 @@ COMMAND_HANDLER(handle_load_image_command)
 	image_size = 0x0;
 	retval = ERROR_OK;
 	for (i = 0; i < image.num_sections; i++) {
-		buffer = malloc(image.sections[i].size);
-		if (buffer == NULL) {
-			command_print(CMD,
-						  "error allocating buffer for section (%d bytes)",
-						  (int)(image.sections[i].size));
-			retval = ERROR_FAIL;
-			break;
-		}
+		buffer = NULL;
+		buf_cnt = image.sections[i].size;
+
+		/* use the image data in place if possible */
+		if (image_section_view(&image, i, 0x0, image.sections[i].size, &data) != ERROR_OK) {
+			buffer = malloc(image.sections[i].size);
+			if (buffer == NULL) {
+				command_print(CMD,
+							  "error allocating buffer for section (%d bytes)",
+							  (int)(image.sections[i].size));
+				retval = ERROR_FAIL;
+				break;
+			}
 
-		retval = image_read_section(&image, i, 0x0, image.sections[i].size, buffer, &buf_cnt);
-		if (retval != ERROR_OK) {
-			free(buffer);
-			break;
+			retval = image_read_section(&image, i, 0x0, image.sections[i].size, buffer, &buf_cnt);
+			if (retval != ERROR_OK) {
+				free(buffer);
+				break;
+			}
+			data = buffer;
 		}
 
 		uint32_t offset = 0;
@@ -3438,7 +3536,7 @@ COMMAND_HANDLER(handle_load_image_command)
 				length -= (image.sections[i].base_address + buf_cnt)-max_address;
 
 			retval = target_write_buffer(target,
-					image.sections[i].base_address + offset, length, buffer + offset);
+					image.sections[i].base_address + offset, length, data + offset);
 			if (retval != ERROR_OK) {
 				free(buffer);
 				break;
@@ -3943,8 +4041,100 @@ static void writeString(FILE *f, char *s)
 
 typedef unsigned char UNIT[2];  /* unit of profiling */
 
+/* the histogram coarsens its buckets rather than grow beyond this */
+#define PROFILE_MAX_BUCKETS	(1024 * 1024)
+
+/* PC samples, counted in buckets of (1 << shift) bytes starting at base;
+ * the covered range grows as samples fall outside of it */
+struct profile_histogram {
+	uint32_t *counts;
+	uint32_t num_buckets;
+	uint32_t base;
+	unsigned int shift;
+	uint64_t num_samples;
+};
+
+static void profile_histogram_init(struct profile_histogram *hist)
+{
+	memset(hist, 0, sizeof(*hist));
+	hist->shift = 1;	/* sizeof(UNIT) */
+}
+
+static void profile_histogram_free(struct profile_histogram *hist)
+{
+	free(hist->counts);
+	hist->counts = NULL;
+	hist->num_buckets = 0;
+}
+
+/* resize the histogram to also cover address */
+static int profile_histogram_grow(struct profile_histogram *hist, uint32_t address)
+{
+	uint64_t low = hist->base;
+	uint64_t high = hist->base + ((uint64_t)hist->num_buckets << hist->shift);
+	unsigned int shift = hist->shift;
+
+	if (hist->counts == NULL) {
+		low = address;
+		high = (uint64_t)address + 1;
+	} else if (address < low) {
+		/* leave room to grow further the same way */
+		uint64_t size = high - low;
+		low = MIN((uint64_t)address, low > size ? low - size : 0);
+	} else {
+		uint64_t size = high - low;
+		high = MAX((uint64_t)address + 1, MIN(high + size, 1ULL << 32));
+	}
+
+	while (((high - 1) >> shift) - (low >> shift) + 1 > PROFILE_MAX_BUCKETS)
+		shift++;
+
+	uint32_t base = (low >> shift) << shift;
+	uint32_t num_buckets = ((high - 1) >> shift) - (low >> shift) + 1;
+	uint32_t *counts = calloc(num_buckets, sizeof(*counts));
+	if (counts == NULL) {
+		LOG_ERROR("No memory to store samples.");
+		return ERROR_FAIL;
+	}
+
+	for (uint32_t i = 0; i < hist->num_buckets; i++) {
+		uint32_t bucket_address = hist->base + (i << hist->shift);
+		counts[(bucket_address - base) >> shift] += hist->counts[i];
+	}
+
+	free(hist->counts);
+	hist->counts = counts;
+	hist->num_buckets = num_buckets;
+	hist->base = base;
+	hist->shift = shift;
+
+	return ERROR_OK;
+}
+
+static int profile_histogram_add(struct profile_histogram *hist,
+		const uint32_t *samples, uint32_t num_samples)
+{
+	for (uint32_t i = 0; i < num_samples; i++) {
+		uint32_t address = samples[i];
+		uint64_t offset = (uint64_t)address - hist->base;
+
+		if (hist->counts == NULL || address < hist->base ||
+				(offset >> hist->shift) >= hist->num_buckets) {
+			int retval = profile_histogram_grow(hist, address);
+			if (retval != ERROR_OK)
+				return retval;
+			offset = address - hist->base;
+		}
+
+		hist->counts[offset >> hist->shift]++;
+	}
+
+	hist->num_samples += num_samples;
+	return ERROR_OK;
+}
+
 /* Dump a gmon.out histogram file. */
-static void write_gmon(uint32_t *samples, uint32_t sampleNum, const char *filename, bool with_range,
+static void write_gmon(struct profile_histogram *hist, const char *filename, bool with_range,
 			uint32_t start_address, uint32_t end_address, struct target *target, uint32_t duration_ms)
 {
 	uint32_t i;
@@ -3961,19 +4151,20 @@ static void write_gmon(uint32_t *samples, uint32_t sampleNum, const char *filena
 	writeData(f, &zero, 1);
 
 	/* figure out bucket size */
-	uint32_t min;
-	uint32_t max;
+	uint32_t min = 0;
+	uint32_t max = 0;
 	if (with_range) {
 		min = start_address;
 		max = end_address;
 	} else {
-		min = samples[0];
-		max = samples[0];
-		for (i = 0; i < sampleNum; i++) {
-			if (min > samples[i])
-				min = samples[i];
-			if (max < samples[i])
-				max = samples[i];
+		bool found = false;
+		for (i = 0; i < hist->num_buckets; i++) {
+			if (!hist->counts[i])
+				continue;
+			if (!found)
+				min = hist->base + (i << hist->shift);
+			max = hist->base + (i << hist->shift);
+			found = true;
 		}
 
 		/* max should be (largest sample + 1)
@@ -3981,8 +4172,11 @@ static void write_gmon(uint32_t *samples, uint32_t sampleNum, const char *filena
 		max++;
 	}
 
-	int addressSpace = max - min;
-	assert(addressSpace >= 2);
+	/* a single sampled address still needs a range */
+	if (max - min < 2)
+		max = min + 2;
+
+	uint32_t addressSpace = max - min;
 
 	/* FIXME: What is the reasonable number of buckets?
 	 * The profiling result will be more accurate if there are enough buckets. */
@@ -3990,30 +4184,26 @@ static void write_gmon(uint32_t *samples, uint32_t sampleNum, const char *filena
 	uint32_t numBuckets = addressSpace / sizeof(UNIT);
 	if (numBuckets > maxBuckets)
 		numBuckets = maxBuckets;
-	int *buckets = malloc(sizeof(int) * numBuckets);
+	uint32_t *buckets = calloc(numBuckets, sizeof(*buckets));
 	if (buckets == NULL) {
 		fclose(f);
 		return;
 	}
-	memset(buckets, 0, sizeof(int) * numBuckets);
-	for (i = 0; i < sampleNum; i++) {
-		uint32_t address = samples[i];
+	for (i = 0; i < hist->num_buckets; i++) {
+		uint32_t address = hist->base + (i << hist->shift);
 
-		if ((address < min) || (max <= address))
+		if (!hist->counts[i] || (address < min) || (max <= address))
 			continue;
 
-		long long a = address - min;
-		long long b = numBuckets;
-		long long c = addressSpace;
-		int index_t = (a * b) / c; /* danger!!!! int32 overflows */
-		buckets[index_t]++;
+		uint64_t a = address - min;
+		buckets[a * numBuckets / addressSpace] += hist->counts[i];
 	}
 
 	/* append binary memory gmon.out &profile_hist_hdr ((char*)&profile_hist_hdr + sizeof(struct gmon_hist_hdr)) */
 	writeLong(f, min, target);			/* low_pc */
 	writeLong(f, max, target);			/* high_pc */
 	writeLong(f, numBuckets, target);	/* # of buckets */
-	float sample_rate = sampleNum / (duration_ms / 1000.0);
+	float sample_rate = hist->num_samples / (duration_ms / 1000.0);
 	writeLong(f, sample_rate, target);
 	writeString(f, "seconds");
 	for (i = 0; i < (15-strlen("seconds")); i++)
@@ -4025,7 +4215,7 @@ static void write_gmon(uint32_t *samples, uint32_t sampleNum, const char *filena
 	char *data = malloc(2 * numBuckets);
 	if (data != NULL) {
 		for (i = 0; i < numBuckets; i++) {
-			int val;
+			uint32_t val;
 			val = buckets[i];
 			if (val > 65535)
 				val = 65535;
@@ -4046,10 +4236,18 @@ static void write_gmon(uint32_t *samples, uint32_t sampleNum, const char *filena
 COMMAND_HANDLER(handle_profile_command)
 {
 	struct target *target = get_current_target(CMD_CTX);
+	uint32_t snapshot_interval = 0;
+
+	if (CMD_ARGC >= 2 && strcmp(CMD_ARGV[0], "snapshot") == 0) {
+		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[1], snapshot_interval);
+		CMD_ARGV += 2;
+		CMD_ARGC -= 2;
+	}
 
 	if ((CMD_ARGC != 2) && (CMD_ARGC != 4))
 		return ERROR_COMMAND_SYNTAX_ERROR;
 
+	/* samples are collected in chunks and accumulated in a histogram */
 	const uint32_t MAX_PROFILE_SAMPLE_NUM = 10000;
 	uint32_t offset;
 	uint32_t num_of_samples;
@@ -4057,60 +4255,97 @@ COMMAND_HANDLER(handle_profile_command)
 
 	COMMAND_PARSE_NUMBER(u32, CMD_ARGV[0], offset);
 
+	uint32_t start_address = 0;
+	uint32_t end_address = 0;
+	bool with_range = false;
+	if (CMD_ARGC == 4) {
+		with_range = true;
+		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[2], start_address);
+		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[3], end_address);
+	}
+
 	uint32_t *samples = malloc(sizeof(uint32_t) * MAX_PROFILE_SAMPLE_NUM);
 	if (samples == NULL) {
 		LOG_ERROR("No memory to store samples.");
 		return ERROR_FAIL;
 	}
 
+	struct profile_histogram hist;
+	profile_histogram_init(&hist);
+
+	LOG_INFO("Starting profiling for %" PRIu32 " s...", offset);
+
 	uint64_t timestart_ms = timeval_ms();
-	/**
-	 * Some cores let us sample the PC without the
-	 * annoying halt/resume step; for example, ARMv7 PCSR.
-	 * Provide a way to use that more efficient mechanism.
-	 */
-	retval = target_profiling(target, samples, MAX_PROFILE_SAMPLE_NUM,
-				&num_of_samples, offset);
-	if (retval != ERROR_OK) {
-		free(samples);
-		return retval;
-	}
-	uint32_t duration_ms = timeval_ms() - timestart_ms;
+	uint64_t snapshot_ms = timestart_ms;
+	uint64_t elapsed_ms = 0;
+	bool first = true;
+	do {
+		/* the last chunk only gets the time remaining */
+		uint64_t chunk_ms = (uint64_t)offset * 1000 - elapsed_ms;
+		if (snapshot_interval && chunk_ms > snapshot_interval * 1000ULL)
+			chunk_ms = snapshot_interval * 1000ULL;
+		chunk_ms = MIN(chunk_ms, UINT32_MAX);
+
+		/**
+		 * Some cores let us sample the PC without the
+		 * annoying halt/resume step; for example, ARMv7 PCSR.
+		 * Provide a way to use that more efficient mechanism.
+		 * Only the first chunk starts from a halted target.
+		 */
+		if (first)
+			retval = target_profiling(target, samples, MAX_PROFILE_SAMPLE_NUM,
+					&num_of_samples, chunk_ms);
+		else
+			retval = target->type->profiling(target, samples, MAX_PROFILE_SAMPLE_NUM,
+					&num_of_samples, chunk_ms);
+		if (retval != ERROR_OK)
+			goto out;
+		first = false;
+
+		assert(num_of_samples <= MAX_PROFILE_SAMPLE_NUM);
+
+		retval = profile_histogram_add(&hist, samples, num_of_samples);
+		if (retval != ERROR_OK)
+			goto out;
+
+		uint64_t now = timeval_ms();
+		elapsed_ms = now - timestart_ms;
+
+		if (snapshot_interval && now - snapshot_ms >= snapshot_interval * 1000ULL) {
+			write_gmon(&hist, CMD_ARGV[1], with_range, start_address, end_address,
+					target, elapsed_ms);
+			snapshot_ms = now;
+		}
 
-	assert(num_of_samples <= MAX_PROFILE_SAMPLE_NUM);
+		/* the target stopped running */
+		if (num_of_samples == 0 && target->state != TARGET_RUNNING)
+			break;
+	} while (elapsed_ms < offset * 1000ULL);
+
+	uint32_t duration_ms = timeval_ms() - timestart_ms;
 
 	retval = target_poll(target);
-	if (retval != ERROR_OK) {
-		free(samples);
-		return retval;
-	}
+	if (retval != ERROR_OK)
+		goto out;
 	if (target->state == TARGET_RUNNING) {
 		retval = target_halt(target);
-		if (retval != ERROR_OK) {
-			free(samples);
-			return retval;
-		}
+		if (retval != ERROR_OK)
+			goto out;
 	}
 
 	retval = target_poll(target);
-	if (retval != ERROR_OK) {
-		free(samples);
-		return retval;
-	}
-
-	uint32_t start_address = 0;
-	uint32_t end_address = 0;
-	bool with_range = false;
-	if (CMD_ARGC == 4) {
-		with_range = true;
-		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[2], start_address);
-		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[3], end_address);
-	}
+	if (retval != ERROR_OK)
+		goto out;
 
-	write_gmon(samples, num_of_samples, CMD_ARGV[1],
+	write_gmon(&hist, CMD_ARGV[1],
 		   with_range, start_address, end_address, target, duration_ms);
 	command_print(CMD, "Wrote %s", CMD_ARGV[1]);
+	command_print(CMD, "%" PRIu64 " samples in %" PRIu32 " ms (%.0f samples/s)",
+			hist.num_samples, duration_ms,
+			duration_ms ? hist.num_samples * 1000.0 / duration_ms : 0.0);
 
+out:
+	profile_histogram_free(&hist);
 	free(samples);
 	return retval;
 }
@@ -6158,7 +6393,7 @@ static const struct command_registration target_exec_command_handlers[] = {
 		.name = "profile",
 		.handler = handle_profile_command,
 		.mode = COMMAND_EXEC,
-		.usage = "seconds filename [start end]",
+		.usage = "['snapshot' interval] seconds filename [start end]",
 		.help = "profiling samples the CPU PC",
 	},
 	/** @todo don't register virt2phys() unless target supports it */
@@ -6396,6 +6631,9 @@ static int target_register_user_commands(struct command_context *cmd_ctx)
 	if (retval != ERROR_OK)
 		return retval;
 
+	retval = benchmark_register_commands(cmd_ctx);
+	if (retval != ERROR_OK)
+		return retval;
 
 	return register_commands(cmd_ctx, NULL, target_exec_command_handlers);
 }
@@ -399,6 +399,12 @@ int target_call_timer_callbacks(void);
  * a synchronous command completes.
  */
 int target_call_timer_callbacks_now(void);
+/**
+ * @returns time in ms (same time base as timeval_ms()) at which the next
+ * timer callback is due, rounded up to the next millisecond, or INT64_MAX
+ * if no callback is registered.
+ */
+int64_t target_timer_next_event(void);
 
 struct target *get_target_by_num(int num);
 struct target *get_current_target(struct command_context *cmd_ctx);
@@ -502,6 +508,15 @@ int target_get_gdb_reg_list(struct target *target,
 		struct reg **reg_list[], int *reg_list_size,
 		enum target_register_class reg_class);
 
+/**
+ * Fetch the invalid registers of @a reg_list in a batch, if the target
+ * supports it; the registers it didn't fetch are left invalid.
+ *
+ * This routine is a wrapper for target->type->fetch_registers.
+ */
+int target_fetch_registers(struct target *target,
+		struct reg **reg_list, int reg_list_size);
+
 /**
  * Check if @a target allows GDB connections.
  *
@@ -593,6 +608,45 @@ int target_write_memory(struct target *target,
 int target_write_phys_memory(struct target *target,
 		target_addr_t address, uint32_t size, uint32_t count, const uint8_t *buffer);
 
+/**
+ * One contiguous transfer of a batched memory access: @a count items of
+ * @a size bytes at @a address, to or from @a buffer.
+ */
+struct target_memory_transfer {
+	target_addr_t address;
+	uint32_t size;
+	uint32_t count;
+	uint8_t *buffer;
+};
+
+/**
+ * Fill in @a transfer to access @a len bytes at @a address with the
+ * widest access size that suits the alignment of both, the same way
+ * target_read_buffer() would for short, naturally aligned objects.
+ */
+void target_memory_transfer_init(struct target_memory_transfer *transfer,
+		target_addr_t address, uint32_t len, uint8_t *buffer);
+
+/**
+ * Perform all the @a num_transfers reads described by @a transfers,
+ * as if target_read_memory() was called for each of them in turn.
+ *
+ * Targets implementing target->type->read_memory_batch queue all the
+ * transfers and flush the adapter queue once, which is much faster for
+ * many small, independent reads (RTOS thread lists, stack frames...).
+ * Other targets fall back to a loop over target_read_memory().
+ *
+ * If an error is returned the contents of all buffers are undefined.
+ */
+int target_read_memory_batch(struct target *target,
+		struct target_memory_transfer *transfers, unsigned int num_transfers);
+/**
+ * Perform all the @a num_transfers writes described by @a transfers,
+ * see target_read_memory_batch().
+ */
+int target_write_memory_batch(struct target *target,
+		const struct target_memory_transfer *transfers, unsigned int num_transfers);
+
 /*
  * Write to target memory using the virtual address.
  *
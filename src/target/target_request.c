@@ -28,6 +28,8 @@
 
 #include <helper/log.h>
 #include <helper/binarybuffer.h>
+#include <helper/time_support.h>
+#include <server/server.h>
 
 #include "target.h"
 #include "target_request.h"
@@ -45,6 +47,123 @@ bool target_got_message(void)
 
 static int charmsg_mode;
 
+/* Bulk data sent with TARGET_REQ_STREAM goes to a file or to the client
+ * of a TCP port.  Data the client has not taken yet waits in a ring
+ * buffer; while that is too full to hold another message the channel
+ * is not drained any further. */
+#define STREAM_MSG_MAX		0xffff
+#define STREAM_BUFFER_SIZE	(4 * (STREAM_MSG_MAX + 1))
+
+enum stream_sink {
+	STREAM_OFF,
+	STREAM_FILE,
+	STREAM_TCP,
+};
+
+static struct {
+	enum stream_sink sink;
+	struct target *target;
+	FILE *file;
+	char *port;
+	struct connection *connection;
+
+	uint8_t *buffer;
+	uint32_t head;
+	uint32_t count;
+
+	uint64_t messages;
+	uint64_t bytes;
+	uint64_t drops;
+	uint64_t dropped_bytes;
+	struct duration bench;
+} stream;
+
+static bool stream_would_block(void)
+{
+#ifdef _WIN32
+	return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+	return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+}
+
+static void stream_flush(void)
+{
+	while (stream.connection && stream.count) {
+		uint32_t len = MIN(stream.count, STREAM_BUFFER_SIZE - stream.head);
+		int written = connection_write(stream.connection, stream.buffer + stream.head, len);
+
+		if (written <= 0) {
+			if (written < 0 && !stream_would_block()) {
+				/* the server notices and closes the connection */
+				LOG_DEBUG("stream client went away");
+				stream.count = 0;
+			}
+			return;
+		}
+
+		stream.head = (stream.head + written) % STREAM_BUFFER_SIZE;
+		stream.count -= written;
+	}
+}
+
+static void stream_drop(uint32_t length)
+{
+	stream.drops++;
+	stream.dropped_bytes += length;
+}
+
+static void stream_put(const uint8_t *data, uint32_t length)
+{
+	switch (stream.sink) {
+		case STREAM_OFF:
+			stream_drop(length);
+			return;
+		case STREAM_FILE:
+			if (fwrite(data, 1, length, stream.file) != length) {
+				stream_drop(length);
+				return;
+			}
+			break;
+		case STREAM_TCP:
+			if (!stream.connection || STREAM_BUFFER_SIZE - stream.count < length) {
+				stream_drop(length);
+				return;
+			}
+			for (uint32_t done = 0; done < length; ) {
+				uint32_t tail = (stream.head + stream.count) % STREAM_BUFFER_SIZE;
+				uint32_t len = MIN(length - done, STREAM_BUFFER_SIZE - tail);
+				memcpy(stream.buffer + tail, data + done, len);
+				stream.count += len;
+				done += len;
+			}
+			stream_flush();
+			break;
+	}
+
+	stream.messages++;
+	stream.bytes += length;
+}
+
+/* flush the file sink periodically, so readers see the data live */
+#define STREAM_FILE_FLUSH_MS	100
+
+static int stream_flush_file(void *priv)
+{
+	if (stream.sink == STREAM_FILE)
+		fflush(stream.file);
+	return ERROR_OK;
+}
+
+bool target_request_ready(void)
+{
+	if (stream.sink != STREAM_TCP || !stream.connection)
+		return true;
+
+	stream_flush();
+	return STREAM_BUFFER_SIZE - stream.count > STREAM_MSG_MAX;
+}
+
 static int target_asciimsg(struct target *target, uint32_t length)
 {
 	char *msg = malloc(DIV_ROUND_UP(length + 1, 4) * 4);
@@ -63,6 +182,25 @@ static int target_asciimsg(struct target *target, uint32_t length)
 	return ERROR_OK;
 }
 
+static int target_streammsg(struct target *target, uint32_t length)
+{
+	if (length == 0)
+		return ERROR_OK;
+
+	uint8_t *data = malloc(DIV_ROUND_UP(length, 4) * 4);
+	if (data == NULL) {
+		LOG_ERROR("out of memory");
+		return ERROR_FAIL;
+	}
+
+	int retval = target->type->target_request_data(target, DIV_ROUND_UP(length, 4), data);
+	if (retval == ERROR_OK)
+		stream_put(data, length);
+
+	free(data);
+	return retval;
+}
+
 static int target_charmsg(struct target *target, uint8_t msg)
 {
 	LOG_USER_N("%c", msg);
@@ -143,6 +281,8 @@ int target_request(struct target *target, uint32_t request)
 		case TARGET_REQ_DEBUGCHAR:
 			target_charmsg(target, (request & 0x00ff0000) >> 16);
 			break;
+		case TARGET_REQ_STREAM:
+			return target_streammsg(target, (request & 0xffff0000) >> 16);
 /*		case TARGET_REQ_SEMIHOSTING:
  *			break;
  */
@@ -234,7 +374,7 @@ int delete_debug_msg_receiver(struct command_context *cmd_ctx, struct target *ta
 			if (c->cmd_ctx == cmd_ctx) {
 				*p = next;
 				free(c);
-				if (*p == NULL) {
+				if (*p == NULL && stream.target != target) {
 					/* disable callback */
 					target->dbg_msg_enabled = 0;
 				}
@@ -288,6 +428,159 @@ COMMAND_HANDLER(handle_target_request_debugmsgs_command)
 	return ERROR_OK;
 }
 
+static int stream_new_connection(struct connection *connection)
+{
+	if (stream.connection) {
+		LOG_ERROR("stream port already has a client");
+		return ERROR_CONNECTION_REJECTED;
+	}
+
+	socket_nonblock(connection->fd);
+	stream.connection = connection;
+	stream.head = 0;
+	stream.count = 0;
+	return ERROR_OK;
+}
+
+static int stream_input(struct connection *connection)
+{
+	uint8_t buf[64];
+
+	/* the stream is one way, whatever the client sends is ignored */
+	int bytes_read = connection_read(connection, buf, sizeof(buf));
+	if (bytes_read == 0)
+		return ERROR_SERVER_REMOTE_CLOSED;
+	if (bytes_read < 0 && !stream_would_block())
+		return ERROR_SERVER_REMOTE_CLOSED;
+
+	return ERROR_OK;
+}
+
+static int stream_connection_closed(struct connection *connection)
+{
+	if (stream.connection == connection)
+		stream.connection = NULL;
+	return ERROR_OK;
+}
+
+static void stream_stop(void)
+{
+	if (stream.sink == STREAM_FILE) {
+		target_unregister_timer_callback(stream_flush_file, NULL);
+		fclose(stream.file);
+		stream.file = NULL;
+	} else if (stream.sink == STREAM_TCP) {
+		remove_service("dcc_stream", stream.port);
+		free(stream.port);
+		stream.port = NULL;
+		free(stream.buffer);
+		stream.buffer = NULL;
+	}
+
+	if (stream.target && stream.target->dbgmsg == NULL)
+		stream.target->dbg_msg_enabled = 0;
+
+	stream.target = NULL;
+	stream.sink = STREAM_OFF;
+}
+
+static void stream_clear_stats(void)
+{
+	stream.messages = 0;
+	stream.bytes = 0;
+	stream.drops = 0;
+	stream.dropped_bytes = 0;
+	duration_start(&stream.bench);
+}
+
+COMMAND_HANDLER(handle_target_request_stream_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+
+	if (CMD_ARGC == 1 && !strcmp(CMD_ARGV[0], "off")) {
+		stream_stop();
+		return ERROR_OK;
+	}
+
+	if (CMD_ARGC == 1 && !strcmp(CMD_ARGV[0], "reset")) {
+		stream_clear_stats();
+		return ERROR_OK;
+	}
+
+	if (CMD_ARGC == 2) {
+		if (target->type->target_request_data == NULL) {
+			LOG_ERROR("Target %s does not support target requests", target_name(target));
+			return ERROR_FAIL;
+		}
+
+		stream_stop();
+
+		if (!strcmp(CMD_ARGV[0], "file")) {
+			stream.file = fopen(CMD_ARGV[1], "wb");
+			if (stream.file == NULL) {
+				LOG_ERROR("can't open %s: %s", CMD_ARGV[1], strerror(errno));
+				return ERROR_FAIL;
+			}
+			stream.sink = STREAM_FILE;
+			target_register_timer_callback(stream_flush_file, STREAM_FILE_FLUSH_MS,
+					TARGET_TIMER_TYPE_PERIODIC, NULL);
+		} else if (!strcmp(CMD_ARGV[0], "port")) {
+			uint16_t port;
+			COMMAND_PARSE_NUMBER(u16, CMD_ARGV[1], port);
+
+			stream.buffer = malloc(STREAM_BUFFER_SIZE);
+			stream.port = strdup(CMD_ARGV[1]);
+			if (stream.buffer == NULL || stream.port == NULL) {
+				LOG_ERROR("out of memory");
+				free(stream.buffer);
+				free(stream.port);
+				stream.buffer = NULL;
+				stream.port = NULL;
+				return ERROR_FAIL;
+			}
+
+			int retval = add_service("dcc_stream", stream.port, 1,
+					stream_new_connection, stream_input,
+					stream_connection_closed, NULL);
+			if (retval != ERROR_OK) {
+				free(stream.buffer);
+				free(stream.port);
+				stream.buffer = NULL;
+				stream.port = NULL;
+				return retval;
+			}
+			stream.sink = STREAM_TCP;
+		} else
+			return ERROR_COMMAND_SYNTAX_ERROR;
+
+		stream.target = target;
+		target->dbg_msg_enabled = 1;
+		stream_clear_stats();
+		return ERROR_OK;
+	}
+
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	static const char * const sink_names[] = { "off", "file", "port" };
+	float elapsed = 0;
+	if (duration_measure(&stream.bench) == ERROR_OK)
+		elapsed = duration_elapsed(&stream.bench);
+
+	command_print(CMD, "stream: %s%s%s", sink_names[stream.sink],
+			stream.sink == STREAM_TCP ? " " : "",
+			stream.sink == STREAM_TCP ? stream.port : "");
+	command_print(CMD, "%" PRIu64 " messages, %" PRIu64 " bytes in %fs (%0.3f KiB/s)",
+			stream.messages, stream.bytes, elapsed,
+			elapsed > 0 ? stream.bytes / elapsed / 1024 : 0.0);
+	command_print(CMD, "%" PRIu64 " messages dropped, %" PRIu64 " bytes",
+			stream.drops, stream.dropped_bytes);
+	if (stream.sink == STREAM_TCP)
+		command_print(CMD, "%" PRIu32 " bytes waiting for the client", stream.count);
+
+	return ERROR_OK;
+}
+
 static const struct command_registration target_req_exec_command_handlers[] = {
 	{
 		.name = "debugmsgs",
@@ -296,6 +589,14 @@ static const struct command_registration target_req_exec_command_handlers[] = {
 		.help = "display and/or modify reception of debug messages from target",
 		.usage = "['enable'|'charmsg'|'disable']",
 	},
+	{
+		.name = "stream",
+		.handler = handle_target_request_stream_command,
+		.mode = COMMAND_EXEC,
+		.help = "send bulk data from the current target to a file or "
+			"TCP port, or show the transfer statistics",
+		.usage = "['file' filename|'port' port_number|'off'|'reset']",
+	},
 	COMMAND_REGISTRATION_DONE
 };
 static const struct command_registration target_req_command_handlers[] = {
@@ -33,14 +33,25 @@ typedef enum target_req_cmd {
 	TARGET_REQ_DEBUGMSG,
 	TARGET_REQ_DEBUGCHAR,
 /*	TARGET_REQ_SEMIHOSTING, */
+	TARGET_REQ_STREAM = 0x04,
 } target_req_cmd_t;
 
+/* most requests a poll handler takes from the target in one go */
+#define TARGET_REQUEST_BATCH	64
+
 struct debug_msg_receiver {
 	struct command_context *cmd_ctx;
 	struct debug_msg_receiver *next;
 };
 
 int target_request(struct target *target, uint32_t request);
+/**
+ * Flush pending stream data and tell whether another request can be
+ * taken from the target.  Poll handlers stop draining the channel
+ * while this is false, so a slow stream consumer stalls the target
+ * rather than losing data.
+ */
+bool target_request_ready(void);
 int delete_debug_msg_receiver(struct command_context *cmd_ctx,
 		struct target *target);
 int target_request_register_commands(struct command_context *cmd_ctx);
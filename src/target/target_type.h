@@ -28,6 +28,7 @@
 #include <jim-nvp.h>
 
 struct target;
+struct target_memory_transfer;
 
 /**
  * This holds methods shared between all instances of a given target
@@ -111,6 +112,15 @@ struct target_type {
 	int (*get_gdb_reg_list)(struct target *target, struct reg **reg_list[],
 			int *reg_list_size, enum target_register_class reg_class);
 
+	/**
+	 * Optional: fetch the values of the registers of @a reg_list which are
+	 * not valid, using as few debug transactions as possible. Registers the
+	 * target can't fetch this way are left invalid; callers fall back to
+	 * reg->type->get() for them.
+	 */
+	int (*fetch_registers)(struct target *target, struct reg **reg_list,
+			int reg_list_size);
+
 	/* target memory access
 	* size: 1 = byte (8bit), 2 = half-word (16bit), 4 = word (32bit)
 	* count: number of items of <size>
@@ -128,6 +138,19 @@ struct target_type {
 	 */
 	int (*write_memory)(struct target *target, target_addr_t address,
 			uint32_t size, uint32_t count, const uint8_t *buffer);
+	/**
+	 * Optional batched memory read callback, queueing all the transfers
+	 * before flushing the adapter queue once.  Do @b not call this
+	 * function directly, use target_read_memory_batch() instead.
+	 */
+	int (*read_memory_batch)(struct target *target,
+			struct target_memory_transfer *transfers, unsigned int num_transfers);
+	/**
+	 * Optional batched memory write callback.  Do @b not call this
+	 * function directly, use target_write_memory_batch() instead.
+	 */
+	int (*write_memory_batch)(struct target *target,
+			const struct target_memory_transfer *transfers, unsigned int num_transfers);
 
 	/* Default implementation will do some fancy alignment to improve performance, target can override */
 	int (*read_buffer)(struct target *target, target_addr_t address,
@@ -280,10 +303,10 @@ struct target_type {
 	 */
 	int (*gdb_fileio_end)(struct target *target, int retcode, int fileio_errno, bool ctrl_c);
 
-	/* do target profiling
+	/* do target profiling for duration_ms milliseconds
 	 */
 	int (*profiling)(struct target *target, uint32_t *samples,
-			uint32_t max_num_samples, uint32_t *num_samples, uint32_t seconds);
+			uint32_t max_num_samples, uint32_t *num_samples, uint32_t duration_ms);
 
 	/* Return the number of address bits this target supports. This will
 	 * typically be 32 for 32-bit targets, and 64 for 64-bit targets. If not